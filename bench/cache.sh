@@ -0,0 +1,60 @@
+#!/bin/bash
+# Function cache benchmark
+#
+# Generates a MiniC file of NUM_FUNCTIONS functions, then times
+# `mccomp -O2 --cache-dir` on it three times: with an empty cache, again with
+# nothing changed, and after editing one function in the middle of the file.
+# Each run prints the cache hit/miss counts; the last two should miss on no
+# functions and on one function respectively. A plain -O2 build without the
+# cache is timed first for reference.
+#
+# ./bench/cache.sh [num_functions] [mccomp]
+set -e
+
+DIR="$(cd "$(dirname "$0")/.." && pwd)"
+NUM_FUNCTIONS=${1:-5000}
+BIN=${2:-$DIR/mccomp}
+
+WORK=$(mktemp -d /tmp/mccomp_cache_XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+SRC=$WORK/functions.c
+
+# Each function has a loop, a branch and a call to the one before it
+awk -v n=$NUM_FUNCTIONS 'BEGIN {
+    print "extern int print_int(int X);"
+    print "int step_0(int count, int seed) {"
+    print "    return count + seed;"
+    print "}"
+    for (i = 1; i < n; i++) {
+        printf "int step_%d(int count, int seed) {\n", i
+        print "    int index;"
+        print "    int total;"
+        print "    index = 0;"
+        print "    total = seed;"
+        print "    while (index < count) {"
+        printf "        total = total * 3 + index %% %d;\n", i % 13 + 2
+        print "        if (total > 100000) {"
+        print "            total = total / 7;"
+        print "        }"
+        print "        index = index + 1;"
+        print "    }"
+        printf "    return step_%d(count - 1, total);\n", i - 1
+        print "}"
+    }
+}' > "$SRC"
+
+# Milliseconds taken by one compile, followed by its cache statistics
+run() {
+    local Start=$(date +%s%N)
+    "$BIN" -O2 "$@" "$SRC" 2> "$WORK/log" || { cat "$WORK/log"; exit 1; }
+    local End=$(date +%s%N)
+    echo "$(( (End - Start) / 1000000 )) ms  $(grep "Function cache" "$WORK/log" || true)"
+}
+
+cd "$WORK"
+echo "Input: $NUM_FUNCTIONS functions, $(wc -l < "$SRC") lines"
+echo "no cache:    $(run)"
+echo "cold cache:  $(run --cache-dir="$WORK/cache")"
+echo "warm cache:  $(run --cache-dir="$WORK/cache")"
+sed -i "/^int step_$((NUM_FUNCTIONS / 2))(/,/^}/s/total \/ 7/total \/ 5/" "$SRC"
+echo "one edited:  $(run --cache-dir="$WORK/cache")"
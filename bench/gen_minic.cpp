@@ -0,0 +1,284 @@
+// Random MiniC program generator for the compiler throughput benchmark
+//
+// Writes a valid, type-correct MiniC program to stdout, following
+// grammar.bnf plus the array extension: globals, functions with parameters,
+// nested if/while blocks, assignments, calls and arithmetic, boolean and
+// comparison expressions. Programs are meant to be compiled, not run; loops
+// need not terminate.
+//
+//   clang++ -O2 -std=c++17 bench/gen_minic.cpp -o gen_minic
+//   ./gen_minic --lines=100000 > big.c
+//
+// Options:
+//   --lines=<n>       Keep adding functions until about n lines (default 1000)
+//   --functions=<n>   Generate exactly n functions instead
+//   --statements=<n>  Statements in each block (default 8)
+//   --depth=<n>       Maximum nesting of if/while blocks (default 3)
+//   --expr-depth=<n>  Maximum nesting of binary operators (default 4)
+//   --arrays=<pct>    Percentage of variable uses that are array elements
+//                     (default 20, 0 for no arrays)
+//   --seed=<n>        Random seed (default 1)
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum Type { INT, FLOAT, BOOL, VOID };
+
+const char* typeName(Type T) {
+  static const char* Names[] = {"int", "float", "bool", "void"};
+  return Names[T];
+}
+
+// A scalar variable or array in scope
+struct Var {
+  std::string Name;
+  Type Ty;
+  int Dims; // 0 for scalars
+};
+
+struct Func {
+  std::string Name;
+  Type Ret;
+  std::vector<Type> Params;
+};
+
+// Array dimensions; indices are reduced modulo these
+constexpr int ArraySize = 16;
+
+class Generator {
+  std::mt19937 Rng;
+  unsigned Statements, MaxDepth, MaxExprDepth, ArrayPercent;
+  std::vector<Func> Funcs; // callable so far, the externs first
+  unsigned NumDefined = 0;
+  std::vector<Var> Globals;
+  std::vector<Var> Scope; // globals, then params and locals of enclosing blocks
+  unsigned NextLocal = 0;
+  std::string Out;
+  size_t Lines = 0;
+
+  unsigned pick(unsigned N) { return std::uniform_int_distribution<unsigned>(0, N - 1)(Rng); }
+  bool chance(unsigned Percent) { return pick(100) < Percent; }
+
+  void line(unsigned Indent, const std::string& Text) {
+    Out.append(Indent * 4, ' ');
+    Out += Text;
+    Out += '\n';
+    Lines++;
+  }
+
+  std::string literal(Type T) {
+    switch (T) {
+      case INT: return std::to_string(pick(1000));
+      case FLOAT: return std::to_string(pick(1000)) + "." + std::to_string(pick(100));
+      default: return chance(50) ? "true" : "false";
+    }
+  }
+
+  // A variable, or an array element, whose type converts to T by widening
+  std::string varUse(Type T, unsigned Depth, bool ForAssignment) {
+    std::vector<const Var*> Scalars, Arrays;
+    for (const Var& V : Scope) {
+      bool Fits = ForAssignment ? V.Ty == T
+                                : V.Ty == T || T == FLOAT || (T == INT && V.Ty == BOOL);
+      if (Fits)
+        (V.Dims ? Arrays : Scalars).push_back(&V);
+    }
+    if (!Arrays.empty() && (Scalars.empty() || chance(ArrayPercent))) {
+      const Var* A = Arrays[pick(Arrays.size())];
+      std::string S = A->Name;
+      for (int D = 0; D < A->Dims; D++)
+        S += "[(" + expr(INT, Depth + 1) + ") % " + std::to_string(ArraySize) + "]";
+      return S;
+    }
+    if (Scalars.empty())
+      return ForAssignment ? "" : literal(T);
+    return Scalars[pick(Scalars.size())]->Name;
+  }
+
+  // A call to an earlier function returning a type that widens to T
+  std::string call(Type T, unsigned Depth) {
+    std::vector<const Func*> Callees;
+    for (const Func& F : Funcs)
+      if (F.Ret == T || (T == FLOAT && F.Ret != VOID) || (T == INT && F.Ret == BOOL) ||
+          T == VOID)
+        Callees.push_back(&F);
+    if (Callees.empty())
+      return "";
+    const Func* F = Callees[pick(Callees.size())];
+    std::string S = F->Name + "(";
+    for (size_t i = 0; i < F->Params.size(); i++)
+      S += (i ? ", " : "") + expr(F->Params[i], Depth + 1);
+    return S + ")";
+  }
+
+  std::string expr(Type T, unsigned Depth) {
+    if (Depth >= MaxExprDepth || chance(30)) {
+      if (chance(10)) {
+        std::string C = call(T, MaxExprDepth);
+        if (!C.empty())
+          return C;
+      }
+      return chance(60) ? varUse(T, Depth, false) : literal(T);
+    }
+    if (T == BOOL) {
+      switch (pick(4)) {
+        case 0: return "!(" + expr(BOOL, Depth + 1) + ")";
+        case 1: return "(" + expr(BOOL, Depth + 1) + (chance(50) ? " && " : " || ") +
+                       expr(BOOL, Depth + 1) + ")";
+        default: {
+          static const char* Cmp[] = {" == ", " != ", " < ", " <= ", " > ", " >= "};
+          Type Operand = chance(50) ? INT : FLOAT;
+          return "(" + expr(Operand, Depth + 1) + Cmp[pick(6)] + expr(Operand, Depth + 1) + ")";
+        }
+      }
+    }
+    if (chance(10))
+      return "-(" + expr(T, Depth + 1) + ")";
+    static const char* Arith[] = {" + ", " - ", " * ", " / ", " % "};
+    const char* Op = Arith[pick(T == INT ? 5 : 4)];
+    return "(" + expr(T, Depth + 1) + Op + expr(T, Depth + 1) + ")";
+  }
+
+  Type scalarType() { return Type(pick(3)); }
+
+  std::string freshName() { return "v" + std::to_string(NextLocal++); }
+
+  // Local declarations followed by statements, at nesting depth Depth
+  void block(unsigned Indent, unsigned Depth, Type Ret, bool IsBody) {
+    size_t ScopeSize = Scope.size();
+    unsigned NumLocals = 1 + pick(4);
+    for (unsigned i = 0; i < NumLocals; i++) {
+      Var V{freshName(), scalarType(), 0};
+      if (ArrayPercent && chance(25)) {
+        V.Dims = 1 + pick(2);
+        line(Indent, std::string(typeName(V.Ty)) + " " + V.Name + "[" +
+                         std::to_string(ArraySize) + "]" +
+                         (V.Dims == 2 ? "[" + std::to_string(ArraySize) + "]" : "") + ";");
+      } else {
+        line(Indent, std::string(typeName(V.Ty)) + " " + V.Name + ";");
+      }
+      Scope.push_back(V);
+    }
+
+    for (unsigned i = 0; i < Statements; i++)
+      statement(Indent, Depth);
+
+    if (IsBody && Ret != VOID)
+      line(Indent, "return " + expr(Ret, 0) + ";");
+    Scope.resize(ScopeSize);
+  }
+
+  void statement(unsigned Indent, unsigned Depth) {
+    unsigned Kind = pick(10);
+    if (Depth < MaxDepth && Kind == 0) {
+      line(Indent, "if (" + expr(BOOL, 0) + ") {");
+      block(Indent + 1, Depth + 1, VOID, false);
+      if (chance(50)) {
+        line(Indent, "} else {");
+        block(Indent + 1, Depth + 1, VOID, false);
+      }
+      line(Indent, "}");
+    } else if (Depth < MaxDepth && Kind == 1) {
+      line(Indent, "while (" + expr(BOOL, 0) + ") {");
+      block(Indent + 1, Depth + 1, VOID, false);
+      line(Indent, "}");
+    } else if (Kind == 2) {
+      std::string C = call(VOID, 0);
+      line(Indent, (C.empty() ? literal(INT) : C) + ";");
+    } else {
+      Type T = scalarType();
+      std::string Target = varUse(T, 0, true);
+      if (Target.empty())
+        line(Indent, expr(T, 0) + ";");
+      else
+        line(Indent, Target + " = " + expr(T, 0) + ";");
+    }
+  }
+
+  void function() {
+    Func F{"f" + std::to_string(NumDefined++), Type(pick(4)), {}};
+    unsigned NumParams = pick(4);
+    NextLocal = 0;
+    size_t ScopeSize = Scope.size();
+    std::string Header = std::string(typeName(F.Ret)) + " " + F.Name + "(";
+    for (unsigned i = 0; i < NumParams; i++) {
+      Var P{"p" + std::to_string(i), scalarType(), 0};
+      F.Params.push_back(P.Ty);
+      Scope.push_back(P);
+      Header += (i ? ", " : "") + std::string(typeName(P.Ty)) + " " + P.Name;
+    }
+    line(0, Header + ") {");
+    block(1, 0, F.Ret, true);
+    line(0, "}");
+    line(0, "");
+    Scope.resize(ScopeSize);
+    // Only later functions call this one, so there is no recursion
+    Funcs.push_back(F);
+  }
+
+public:
+  Generator(unsigned Seed, unsigned Statements, unsigned MaxDepth, unsigned MaxExprDepth,
+            unsigned ArrayPercent)
+      : Rng(Seed), Statements(Statements), MaxDepth(MaxDepth), MaxExprDepth(MaxExprDepth),
+        ArrayPercent(ArrayPercent) {}
+
+  void program(size_t TargetLines, size_t NumFunctions) {
+    line(0, "extern int print_int(int X);");
+    line(0, "extern float print_float(float X);");
+    Funcs.push_back({"print_int", INT, {INT}});
+    Funcs.push_back({"print_float", FLOAT, {FLOAT}});
+    for (unsigned i = 0; i < 8; i++) {
+      Var G{"g" + std::to_string(i), scalarType(), ArrayPercent && i % 4 == 3 ? 1 : 0};
+      line(0, std::string(typeName(G.Ty)) + " " + G.Name +
+                  (G.Dims ? "[" + std::to_string(ArraySize) + "]" : "") + ";");
+      Globals.push_back(G);
+    }
+    Scope = Globals;
+    line(0, "");
+
+    for (size_t i = 0; NumFunctions ? i < NumFunctions : Lines < TargetLines; i++) {
+      function();
+      // Flush as we go so memory stays flat for very large programs
+      fputs(Out.c_str(), stdout);
+      Out.clear();
+    }
+  }
+};
+
+// Parse "--name=<n>" into Value; returns false if Arg is a different option
+bool parseOption(const std::string& Arg, const char* Name, unsigned long& Value) {
+  std::string Prefix = std::string("--") + Name + "=";
+  if (Arg.compare(0, Prefix.size(), Prefix) != 0)
+    return false;
+  Value = strtoul(Arg.c_str() + Prefix.size(), nullptr, 10);
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  unsigned long Lines = 1000, Functions = 0, Statements = 8, Depth = 3, ExprDepth = 4,
+                Arrays = 20, Seed = 1;
+  for (int i = 1; i < argc; i++) {
+    std::string Arg = argv[i];
+    if (!parseOption(Arg, "lines", Lines) && !parseOption(Arg, "functions", Functions) &&
+        !parseOption(Arg, "statements", Statements) && !parseOption(Arg, "depth", Depth) &&
+        !parseOption(Arg, "expr-depth", ExprDepth) && !parseOption(Arg, "arrays", Arrays) &&
+        !parseOption(Arg, "seed", Seed)) {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (Statements == 0) {
+    fprintf(stderr, "--statements must be at least 1\n");
+    return 1;
+  }
+
+  Generator Gen(Seed, Statements, Depth, ExprDepth, Arrays > 100 ? 100 : Arrays);
+  Gen.program(Lines, Functions);
+}
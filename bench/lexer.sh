@@ -0,0 +1,80 @@
+#!/bin/bash
+# Lexer throughput benchmark
+#
+# Generates an identifier-heavy MiniC source of about SIZE_MB megabytes and
+# times `mccomp --lex-only` on it. Pass more than one mccomp binary to compare
+# builds against each other. CORPUS=identifiers swaps the program for a
+# stream of bare identifiers and keywords, isolating keyword recognition.
+#
+# ./bench/lexer.sh [size_mb] [mccomp ...]
+# CORPUS=identifiers ./bench/lexer.sh [size_mb] [mccomp ...]
+set -e
+
+DIR="$(cd "$(dirname "$0")/.." && pwd)"
+SIZE_MB=${1:-16}
+CORPUS=${CORPUS:-program}
+shift || true
+BINARIES=("$@")
+if [ ${#BINARIES[@]} == 0 ]; then
+    BINARIES=("$DIR/mccomp")
+fi
+
+SRC=$(mktemp /tmp/mccomp_lex_XXXXXX.c)
+trap 'rm -f "$SRC"' EXIT
+
+if [ "$CORPUS" == "identifiers" ]; then
+# Identifiers of every keyword length, one in five of them a keyword
+awk -v target=$((SIZE_MB * 1024 * 1024)) 'BEGIN {
+    n = split("if int bool else true void false while float extern return", kw, " ")
+    n2 = split("i j k n x if_ it in index bo boolean el elsewhere tr tree vo value fa flag wh whilst fl floor ex exit re result", id, " ")
+    bytes = 0
+    for (i = 0; bytes < target; i++) {
+        line = ""
+        for (j = 0; j < 10; j++) {
+            if ((i + j) % 5 == 0)
+                w = kw[(i * 7 + j) % n + 1]
+            else
+                w = id[(i * 3 + j) % n2 + 1]
+            line = line w " "
+        }
+        print line
+        bytes += length(line) + 1
+    }
+}' > "$SRC"
+else
+# Each function is ~1KB of typical MiniC: declarations, loops, arithmetic,
+# comparisons, calls and comments
+awk -v target=$((SIZE_MB * 1024 * 1024)) 'BEGIN {
+    print "extern int print_int(int X);"
+    print "extern float print_float(float X);"
+    bytes = 0
+    for (i = 0; bytes < target; i++) {
+        f = sprintf("int compute_value_%d(int count, float scale, bool enabled) {\n", i)
+        f = f "    int index_counter;\n    int running_total;\n    float accumulated_value;\n"
+        f = f "    // accumulate a weighted running total\n"
+        f = f "    index_counter = 0;\n    running_total = 0;\n    accumulated_value = 0.5;\n"
+        f = f "    while (index_counter < count && enabled) {\n"
+        f = f "        running_total = running_total + index_counter * 3 - (index_counter % 7);\n"
+        f = f "        accumulated_value = accumulated_value * scale + 1.25;\n"
+        f = f "        if (running_total >= 1000 || accumulated_value != 0.0) {\n"
+        f = f "            running_total = running_total / 2;\n"
+        f = f "        } else {\n"
+        f = f "            running_total = -running_total + !enabled;\n"
+        f = f "        }\n"
+        f = f "        index_counter = index_counter + 1;\n"
+        f = f "    }\n"
+        f = f sprintf("    print_int(running_total + %d);\n", i)
+        f = f "    return running_total;\n}\n"
+        printf "%s", f
+        bytes += length(f)
+    }
+}' > "$SRC"
+fi
+
+echo "Input: $(du -h "$SRC" | cut -f1), $(wc -l < "$SRC") lines"
+for BIN in "${BINARIES[@]}"; do
+    echo "== $BIN"
+    for run in 1 2 3; do
+        "$BIN" --lex-only "$SRC"
+    done
+done
@@ -0,0 +1,66 @@
+#!/bin/bash
+# Generated-code benchmark
+#
+# Compiles each kernel in bench/runtime with mccomp and, for reference, its C
+# equivalent with clang, at -O0 to -O3, links both against the shared driver
+# and times the kernel. Results are appended to a CSV file, one row per
+# kernel, compiler and -O level, so that runs can be compared over time:
+#   date,commit,kernel,compiler,opt_level,runtime_ms,result,ratio_to_clang
+# ratio_to_clang is mccomp's time over clang's at the same level. The result
+# column is the kernel's output; a mccomp result that disagrees with clang's
+# is reported on stderr. MCCOMP_FLAGS are passed to mccomp and recorded in
+# the compiler column, e.g. to measure the cost of -fbounds-check.
+#
+# ./bench/runtime.sh [results.csv] [mccomp]
+# KERNELS="pi cosine" LEVELS="2" REPS=5 ./bench/runtime.sh
+# MCCOMP_FLAGS=-fbounds-check KERNELS=matrix_mul ./bench/runtime.sh
+set -e
+
+DIR="$(cd "$(dirname "$0")/.." && pwd)"
+RESULTS=${1:-$DIR/bench/results.csv}
+BIN=${2:-$DIR/mccomp}
+CC=${CC:-clang}
+CXX=${CXX:-clang++}
+KERNELS=${KERNELS:-matrix_mul pi fibonacci palindrome cosine}
+LEVELS=${LEVELS:-0 1 2 3}
+REPS=${REPS:-3}
+MCCOMP="mccomp${MCCOMP_FLAGS:+ $MCCOMP_FLAGS}"
+
+WORK=$(mktemp -d /tmp/mccomp_runtime_XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+COMMIT=$(git -C "$DIR" rev-parse --short HEAD 2> /dev/null || echo unknown)
+if [ ! -s "$RESULTS" ]; then
+    echo "date,commit,kernel,compiler,opt_level,runtime_ms,result,ratio_to_clang" > "$RESULTS"
+fi
+
+# Link the kernel object $2 with the driver and run it, printing "<ms> <result>"
+run() {
+    local Kernel=$1
+    $CXX -O2 -DBENCH_$(echo $Kernel | tr a-z A-Z) "$DIR/bench/runtime/driver.cpp" "$2" \
+        -o "$WORK/bench"
+    "$WORK/bench" $REPS
+}
+
+printf "%-12s %-6s %12s %12s %8s\n" kernel level "mccomp ms" "clang ms" ratio
+for Kernel in $KERNELS; do
+    SRC=$DIR/bench/runtime/$Kernel
+    for Level in $LEVELS; do
+        "$BIN" -q -O$Level $MCCOMP_FLAGS -c -o "$WORK/mccomp.o" "$SRC/$Kernel.c"
+        $CC -O$Level -c -o "$WORK/clang.o" "$SRC/reference.c"
+        read MccompMs MccompResult <<< "$(run $Kernel "$WORK/mccomp.o")"
+        read ClangMs ClangResult <<< "$(run $Kernel "$WORK/clang.o")"
+
+        if ! awk -v a=$MccompResult -v b=$ClangResult \
+                'BEGIN { d = a - b; if (d < 0) d = -d; m = b < 0 ? -b : b; exit !(d <= m * 1e-4) }'; then
+            echo "$Kernel -O$Level: $MCCOMP result $MccompResult differs from clang's $ClangResult" >&2
+        fi
+
+        Ratio=$(awk -v a=$MccompMs -v b=$ClangMs 'BEGIN { printf "%.3f", (b > 0 ? a / b : 0) }')
+        echo "$DATE,$COMMIT,$Kernel,$MCCOMP,$Level,$MccompMs,$MccompResult,$Ratio" >> "$RESULTS"
+        echo "$DATE,$COMMIT,$Kernel,clang,$Level,$ClangMs,$ClangResult,1.000" >> "$RESULTS"
+        printf "%-12s -O%-4s %12s %12s %8s\n" $Kernel $Level $MccompMs $ClangMs $Ratio
+    done
+done
+echo "Results appended to $RESULTS"
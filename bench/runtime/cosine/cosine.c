@@ -0,0 +1,41 @@
+// MiniC benchmark: the cosine series at samples points across [0, pi)
+
+float cosine(float x) {
+
+  float cos;
+  float n;
+  float term;
+  float eps;
+  float alt;
+
+  eps = 0.000001;
+  n = 1.0;
+  cos = 1.0;
+  term = 1.0;
+  alt = -1.0;
+
+  while (term > eps) {
+    term = term * x * x / n / (n + 1);
+    cos = cos + alt * term;
+    alt = -alt;
+    n = n + 2;
+  }
+
+  return cos;
+}
+
+float cosine_sum(int samples) {
+
+  float total;
+  float x;
+  int i;
+
+  total = 0.0;
+  i = 0;
+  while (i < samples) {
+    x = i;
+    total = total + cosine(x * 3.14159 / samples);
+    i = i + 1;
+  }
+  return total;
+}
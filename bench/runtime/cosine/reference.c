@@ -0,0 +1,42 @@
+// C equivalent of cosine.c, compiled by clang for comparison. MiniC float
+// literals are single precision, hence the f suffixes.
+
+float cosine(float x) {
+
+  float cos;
+  float n;
+  float term;
+  float eps;
+  float alt;
+
+  eps = 0.000001f;
+  n = 1.0f;
+  cos = 1.0f;
+  term = 1.0f;
+  alt = -1.0f;
+
+  while (term > eps) {
+    term = term * x * x / n / (n + 1);
+    cos = cos + alt * term;
+    alt = -alt;
+    n = n + 2;
+  }
+
+  return cos;
+}
+
+float cosine_sum(int samples) {
+
+  float total;
+  float x;
+  int i;
+
+  total = 0.0f;
+  i = 0;
+  while (i < samples) {
+    x = i;
+    total = total + cosine(x * 3.14159f / samples);
+    i = i + 1;
+  }
+  return total;
+}
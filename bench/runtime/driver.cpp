@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Benchmark driver shared by every kernel. Build it with -DBENCH_<KERNEL>
+// and link it against the kernel compiled by mccomp or by clang:
+//   clang++ -O2 -DBENCH_PI driver.cpp pi.o -o pi
+//   ./pi [repetitions]
+// It calls the kernel once to warm up and then the given number of times
+// (default 3), and prints the fastest call and the kernel's result:
+//   <milliseconds> <result>
+
+extern "C" int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+#if defined(BENCH_MATRIX_MUL)
+#define N 512
+extern "C" int matrix_mul(float a[N][N], float b[N][N], float c[N][N], int n);
+
+static float (*A)[N], (*B)[N], (*C)[N];
+
+static void setup() {
+  A = new float[N][N];
+  B = new float[N][N];
+  C = new float[N][N];
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      A[i][j] = (i + j) % 7 * 0.25f, B[i][j] = (i * j) % 5 * 0.5f;
+}
+
+static double run() {
+  for (int i = 0; i < N; i++)
+    std::fill(C[i], C[i] + N, 0.0f);
+  matrix_mul(A, B, C, N);
+  double Sum = 0;
+  for (int i = 0; i < N; i++)
+    for (int j = 0; j < N; j++)
+      Sum += C[i][j];
+  return Sum;
+}
+#elif defined(BENCH_PI)
+extern "C" float pi(int terms);
+static void setup() {}
+static double run() { return pi(100000000); }
+#elif defined(BENCH_FIBONACCI)
+extern "C" int fibonacci(int n);
+static void setup() {}
+static double run() { return fibonacci(35); }
+#elif defined(BENCH_PALINDROME)
+extern "C" int count_palindromes(int lo, int hi);
+static void setup() {}
+static double run() { return count_palindromes(0, 20000000); }
+#elif defined(BENCH_COSINE)
+extern "C" float cosine_sum(int samples);
+static void setup() {}
+static double run() { return cosine_sum(2000000); }
+#else
+#error "define BENCH_<KERNEL> to pick the kernel to run"
+#endif
+
+int main(int argc, char** argv) {
+  int Reps = argc > 1 ? atoi(argv[1]) : 3;
+  setup();
+  double Result = run();
+
+  double Best = 0;
+  for (int i = 0; i < Reps; i++) {
+    auto Start = std::chrono::steady_clock::now();
+    run();
+    double Ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - Start).count();
+    if (i == 0 || Ms < Best)
+      Best = Ms;
+  }
+  printf("%.3f %.6g\n", Best, Result);
+}
@@ -0,0 +1,14 @@
+// MiniC benchmark: naive recursive fibonacci, dominated by call overhead
+
+int fibonacci(int n)
+{
+  int result;
+
+  if (n < 2) {
+    result = n;
+  }
+  else {
+    result = fibonacci(n - 1) + fibonacci(n - 2);
+  }
+  return result;
+}
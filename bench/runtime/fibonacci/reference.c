@@ -0,0 +1,14 @@
+// C equivalent of fibonacci.c, compiled by clang for comparison
+
+int fibonacci(int n)
+{
+  int result;
+
+  if (n < 2) {
+    result = n;
+  }
+  else {
+    result = fibonacci(n - 1) + fibonacci(n - 2);
+  }
+  return result;
+}
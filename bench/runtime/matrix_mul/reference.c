@@ -0,0 +1,24 @@
+// C equivalent of matrix_mul.c, compiled by clang for comparison
+
+int matrix_mul(float a[512][512], float b[512][512], float c[512][512], int n)
+{
+    int i;
+    int j;
+    int k;
+
+    i = 0;
+    while (i < n) {
+        j = 0;
+        while (j < n) {
+            k = 0;
+            while (k < n) {
+                c[i][j] = c[i][j] + (a[i][k] * b[k][j]);
+                k = k + 1;
+            }
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+
+    return 0;
+}
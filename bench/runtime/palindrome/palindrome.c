@@ -0,0 +1,34 @@
+// MiniC benchmark: count the palindromic numbers in [lo, hi)
+
+bool palindrome(int number) {
+
+   int t;
+   int rev;
+   int rmndr;
+
+   rev = 0;
+   t = number;
+
+   while (number > 0)
+   {
+      rmndr = number % 10;
+      rev = rev * 10 + rmndr;
+      number = number / 10;
+   }
+
+   return t == rev;
+}
+
+int count_palindromes(int lo, int hi) {
+
+   int count;
+
+   count = 0;
+   while (lo < hi) {
+      if (palindrome(lo)) {
+         count = count + 1;
+      }
+      lo = lo + 1;
+   }
+   return count;
+}
@@ -0,0 +1,27 @@
+// MiniC benchmark: pi from the Nilakantha series, summed over terms terms
+
+float pi(int terms) {
+
+  bool flag;
+  float PI;
+  float x;
+  int i;
+
+  flag = true;
+  PI = 3.0;
+  i = 2;
+
+  while (i < 2 * terms) {
+    x = i;
+    if (flag) {
+      PI = PI + (4.0 / (x * (x + 1.0) * (x + 2.0)));
+    }
+    else {
+      PI = PI - (4.0 / (x * (x + 1.0) * (x + 2.0)));
+    }
+    flag = !flag;
+    i = i + 2;
+  }
+
+  return PI;
+}
@@ -0,0 +1,29 @@
+// C equivalent of pi.c, compiled by clang for comparison. MiniC float
+// literals are single precision, hence the f suffixes.
+#include <stdbool.h>
+
+float pi(int terms) {
+
+  bool flag;
+  float PI;
+  float x;
+  int i;
+
+  flag = true;
+  PI = 3.0f;
+  i = 2;
+
+  while (i < 2 * terms) {
+    x = i;
+    if (flag) {
+      PI = PI + (4.0f / (x * (x + 1.0f) * (x + 2.0f)));
+    }
+    else {
+      PI = PI - (4.0f / (x * (x + 1.0f) * (x + 2.0f)));
+    }
+    flag = !flag;
+    i = i + 2;
+  }
+
+  return PI;
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Compiler throughput benchmark
+#
+# Generates random MiniC programs of increasing size with bench/gen_minic.cpp
+# and measures mccomp on each in three modes:
+#   lex      --lex-only, the lexer alone
+#   parse    -fsyntax-only, lexing and parsing
+#   codegen  -O0 through to an IR file, so the front end and IR generation
+# For each it prints lines/second and the process's peak RSS. Lines/second
+# should stay roughly flat as the size grows, and peak RSS should grow in
+# proportion; anything else points at super-linear behaviour. Extra
+# arguments are passed to the generator.
+#
+# ./bench/throughput.sh [mccomp] [generator options...]
+# SIZES="1000 100000" ./bench/throughput.sh ./mccomp --arrays=0 --depth=5
+set -e
+
+DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BIN=${1:-$DIR/mccomp}
+shift || true
+CXX=${CXX:-clang++}
+SIZES=${SIZES:-1000 10000 100000 1000000 10000000}
+
+WORK=$(mktemp -d /tmp/mccomp_throughput_XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+$CXX -O2 -std=c++17 "$DIR/bench/gen_minic.cpp" -o "$WORK/gen_minic"
+
+# Run mccomp on $SRC, printing "<lines/s> <peak RSS MB>" from its own report
+measure() {
+    local Start=$(date +%s%N)
+    "$BIN" "$@" "$SRC" 2> "$WORK/log" > /dev/null || { cat "$WORK/log"; exit 1; }
+    local End=$(date +%s%N)
+    local Rss=$(grep -o "peak RSS [0-9.]*\|Peak RSS (whole process) *[0-9.]*" "$WORK/log" \
+                    | grep -o "[0-9.]*$")
+    awk -v l=$Lines -v ns=$((End - Start)) -v rss=$Rss \
+        'BEGIN { printf "%12.0f %9.1f", l / (ns / 1e9), rss }'
+}
+
+printf "%10s %10s  %12s %9s  %12s %9s  %12s %9s\n" lines MB \
+       "lex lines/s" "RSS MB" "parse l/s" "RSS MB" "codegen l/s" "RSS MB"
+for Size in $SIZES; do
+    SRC=$WORK/program_$Size.c
+    "$WORK/gen_minic" --lines=$Size "$@" > "$SRC"
+    Lines=$(wc -l < "$SRC")
+    MBytes=$(awk -v b=$(wc -c < "$SRC") 'BEGIN { printf "%.1f", b / 1048576 }')
+    printf "%10s %10s  %s  %s  %s\n" $Lines $MBytes "$(measure --lex-only)" \
+           "$(measure -fsyntax-only)" "$(measure -q -O0 -ftime-report -o "$WORK/out.ll")"
+    rm -f "$SRC" "$WORK/out.ll"
+done
@@ -1,36 +1,78 @@
 // 2241543 Compiler Design Coursework
 
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/AbsoluteSymbols.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassTimingInfo.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cctype>
+#include <cmath>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <new>
+#include <optional>
 #include <queue>
 #include <string.h>
 #include <string>
+#include <string_view>
+#include <sys/resource.h>
 #include <system_error>
 #include <utility>
 #include <vector>
@@ -38,8 +80,6 @@
 using namespace llvm;
 using namespace llvm::sys;
 
-FILE *pFile;
-
 //===----------------------------------------------------------------------===//
 // Lexer
 //===----------------------------------------------------------------------===//
@@ -72,6 +112,8 @@ enum TOKEN_TYPE {
   ELSE = -8,    // "else"
   WHILE = -9,   // "while"
   RETURN = -10, // "return"
+  PRAGMA = -11, // "#pragma", starting a loop hint
+  FOR = -12,    // "for"
 
   // literals
   INT_LIT = -14,   // [0-9]+
@@ -105,305 +147,839 @@ enum TOKEN_TYPE {
   INVALID = -100 // signal invalid token
 };
 
+//===----------------------------------------------------------------------===//
+// Verbosity
+//===----------------------------------------------------------------------===//
+
+// How much progress output goes to stderr. Errors are always reported.
+enum VerbosityLevel {
+  QUIET = 0,   // -q: errors only
+  NORMAL = 1,  // default: one line per compiler phase
+  VERBOSE = 2  // -v: trace every parsed construct and generated declaration
+};
+static VerbosityLevel Verbosity = NORMAL;
+
+// printf-style progress message, shown when Verbosity is at least Level
+static void logProgress(VerbosityLevel Level, const char* Fmt, ...) {
+  if (Verbosity < Level)
+    return;
+  va_list Args;
+  va_start(Args, Fmt);
+  vfprintf(stderr, Fmt, Args);
+  va_end(Args);
+}
+
+//===----------------------------------------------------------------------===//
+// Diagnostics
+//===----------------------------------------------------------------------===//
+
+/// SourceLoc - Line and column of the token a node was built from.
+struct SourceLoc {
+  int Line = 0;
+  int Col = 0;
+};
+
+/// DiagnosticsEngine - Collects the errors of a translation unit so that one
+/// run reports all of them. The parser recovers after a syntax error and sema
+/// carries on past a semantic one; the driver checks hasErrors() before
+/// generating code. Text diagnostics are printed to stderr as they are
+/// reported, JSON ones to stdout as a single array for the whole run by
+/// finishDiagnostics(), away from the progress output on stderr.
+class DiagnosticsEngine {
+public:
+  enum DiagKind { Syntax, Semantic };
+
+private:
+  struct Diagnostic {
+    DiagKind Kind;
+    SourceLoc Loc; // Line 0 if there is no position
+    std::string Message;
+  };
+
+  std::vector<Diagnostic> Diags;
+
+public:
+  std::string FileName;      // input file, for JSON output
+  unsigned MaxErrors = 20;   // stop after this many errors, 0 for no limit
+  bool JSONOutput = false;
+  bool ShowFileName = false; // prefix text diagnostics with FileName
+
+  bool hasErrors() const { return !Diags.empty(); }
+  unsigned getNumErrors() const { return Diags.size(); }
+
+  // Once MaxErrors errors have been reported the rest are dropped, and the
+  // driver abandons the file after parsing
+  bool hasReachedLimit() const { return MaxErrors && Diags.size() >= MaxErrors; }
+
+  void report(DiagKind Kind, SourceLoc Loc, std::string Message) {
+    if (hasReachedLimit())
+      return;
+    // Build the whole line first so that files compiled on other threads
+    // cannot interleave with it
+    std::string Prefix = ShowFileName ? FileName + ":" : "";
+    if (!JSONOutput) {
+      std::string Line = Prefix;
+      if (Loc.Line)
+        Line += std::to_string(Loc.Line) + ":" + std::to_string(Loc.Col) + " ";
+      else if (ShowFileName)
+        Line += " ";
+      Line += (Kind == Syntax ? "Syntax Error: " : "Semantic Error: ") + Message + "\n";
+      fputs(Line.c_str(), stderr);
+    }
+    Diags.push_back({Kind, Loc, std::move(Message)});
+
+    if (hasReachedLimit() && !JSONOutput) {
+      fprintf(stderr, "%sToo many errors emitted, stopping now (--max-errors=%u)\n",
+              ShowFileName ? (Prefix + " ").c_str() : "", MaxErrors);
+    }
+  }
+
+  // Add one JSON object per error to the array being written to J
+  void writeJSON(json::OStream& J) const {
+    for (const Diagnostic& D : Diags) {
+      J.object([&] {
+        J.attribute("file", FileName);
+        J.attribute("line", D.Loc.Line);
+        J.attribute("column", D.Loc.Col);
+        J.attribute("severity", "error");
+        J.attribute("category", D.Kind == Syntax ? "syntax" : "semantic");
+        J.attribute("message", D.Message);
+      });
+    }
+  }
+};
+
+// Once every input has been compiled, write the errors of all of them as one
+// JSON array to stdout, or their total count in text mode. Returns the exit
+// status for the diagnostics.
+static int finishDiagnostics(ArrayRef<DiagnosticsEngine> AllDiags, bool JSONOutput) {
+  unsigned NumErrors = 0;
+  for (const DiagnosticsEngine& Diags : AllDiags)
+    NumErrors += Diags.getNumErrors();
+
+  if (JSONOutput) {
+    json::OStream J(outs(), 2);
+    J.array([&] {
+      for (const DiagnosticsEngine& Diags : AllDiags)
+        Diags.writeJSON(J);
+    });
+    outs() << "\n";
+    outs().flush();
+  } else if (NumErrors) {
+    fprintf(stderr, "%u error%s generated.\n", NumErrors, NumErrors == 1 ? "" : "s");
+  }
+  return NumErrors ? 2 : 0;
+}
+
+//===----------------------------------------------------------------------===//
+// Identifier Interning
+//===----------------------------------------------------------------------===//
+
+/// Symbol - 32-bit handle for an interned identifier. Two symbols are equal
+/// exactly when their spellings are, so later stages compare and hash the ID
+/// instead of the string.
+class Symbol {
+  uint32_t Id = 0; // 0 means "no symbol"
+
+public:
+  Symbol() = default;
+  explicit Symbol(uint32_t id) : Id(id) {}
+  uint32_t getId() const { return Id; }
+  bool isValid() const { return Id != 0; }
+  bool operator==(Symbol Other) const { return Id == Other.Id; }
+  bool operator!=(Symbol Other) const { return Id != Other.Id; }
+};
+
+namespace llvm {
+template <> struct DenseMapInfo<Symbol> {
+  static Symbol getEmptyKey() { return Symbol(~0u); }
+  static Symbol getTombstoneKey() { return Symbol(~0u - 1); }
+  static unsigned getHashValue(Symbol S) { return DenseMapInfo<uint32_t>::getHashValue(S.getId()); }
+  static bool isEqual(Symbol A, Symbol B) { return A == B; }
+};
+} // namespace llvm
+
+/// StringInterner - Stores each distinct identifier once and hands out
+/// Symbols for it.
+class StringInterner {
+  BumpPtrAllocator Storage;          // owns the characters of every name
+  DenseMap<StringRef, Symbol> Ids;   // spelling -> symbol
+  std::vector<StringRef> Names;      // symbol ID -> spelling
+
+public:
+  StringInterner() { Names.push_back(""); } // reserve ID 0
+
+  Symbol intern(std::string_view Str) {
+    auto It = Ids.find(StringRef(Str.data(), Str.size()));
+    if (It != Ids.end())
+      return It->second;
+    char* Copy = Storage.Allocate<char>(Str.size());
+    std::copy(Str.begin(), Str.end(), Copy);
+    StringRef Name(Copy, Str.size());
+    Symbol Sym(Names.size());
+    Names.push_back(Name);
+    Ids[Name] = Sym;
+    return Sym;
+  }
+
+  StringRef getName(Symbol Sym) const { return Names[Sym.getId()]; }
+};
+
 // TOKEN class is used to keep track of information about a token
 class TOKEN {
 public:
   TOKEN() = default;
   int type = -100;
-  std::string lexeme;
+  std::string_view lexeme; // slice of the source buffer, no copy is made
+  Symbol Sym;              // interned spelling, IDENT tokens only
   int lineNo;
   int columnNo;
-  const std::string getIdentifierStr() const;
+  const Symbol getIdentifier() const;
   const int getIntVal() const;
   const float getFloatVal() const;
   const bool getBoolVal() const;
 };
 
-static std::string globalLexeme;
-static int lineNo, columnNo;
+//===----------------------------------------------------------------------===//
+// Compile-Time Profiling
+//===----------------------------------------------------------------------===//
+
+// Heap allocations made on this thread. The replacement operator new below
+// counts them, so -ftime-report can charge them to the compiler phases.
+static thread_local uint64_t NumAllocations = 0;
+static thread_local uint64_t BytesAllocated = 0;
+
+void* operator new(std::size_t Size) {
+  NumAllocations++;
+  BytesAllocated += Size;
+  if (void* P = std::malloc(Size ? Size : 1))
+    return P;
+  report_bad_alloc_error("operator new failed");
+}
+
+void* operator new(std::size_t Size, std::align_val_t Align) {
+  NumAllocations++;
+  BytesAllocated += Size;
+  void* P = nullptr;
+  if (posix_memalign(&P, std::max<size_t>(size_t(Align), sizeof(void*)), Size ? Size : 1))
+    report_bad_alloc_error("operator new failed");
+  return P;
+}
+
+void operator delete(void* P) noexcept { std::free(P); }
+void operator delete(void* P, std::size_t) noexcept { std::free(P); }
+void operator delete(void* P, std::align_val_t) noexcept { std::free(P); }
+void operator delete(void* P, std::size_t, std::align_val_t) noexcept { std::free(P); }
+
+/// CompilerPhase - The parts of a compile that -ftime-report times, in
+/// pipeline order
+enum CompilerPhase {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_PRINT_AST,
+  PHASE_SEMA,
+  PHASE_CODEGEN_EXTERNS,
+  PHASE_CODEGEN_DECLS,
+  PHASE_VERIFY,
+  PHASE_OPTIMISE,
+  PHASE_EMIT,
+  NUM_PHASES
+};
+
+static const char* getPhaseName(CompilerPhase Phase) {
+  switch (Phase) {
+    case PHASE_LEX: return "Lexing";
+    case PHASE_PARSE: return "Parsing";
+    case PHASE_PRINT_AST: return "AST printing";
+    case PHASE_SEMA: return "Semantic analysis";
+    case PHASE_CODEGEN_EXTERNS: return "Codegen (externs)";
+    case PHASE_CODEGEN_DECLS: return "Codegen (top-level declarations)";
+    case PHASE_VERIFY: return "Verification";
+    case PHASE_OPTIMISE: return "Optimisation";
+    case PHASE_EMIT: return "Emission";
+    default: return "unknown";
+  }
+}
+
+// Peak resident set size of the whole process so far, in megabytes
+static double getPeakRSSMB() {
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return Usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+  return Usage.ru_maxrss / 1024.0; // kilobytes
+#endif
+}
+
+// Time and allocations charged to one phase of a translation unit
+struct PhaseStats {
+  double Seconds = 0;
+  uint64_t Allocations = 0;
+  uint64_t Bytes = 0;
+};
+
+//===----------------------------------------------------------------------===//
+// Symbol Table
+//===----------------------------------------------------------------------===//
+
+/// TypeKind - The MiniC type an expression or declaration resolves to.
+enum TypeKind : uint8_t { TY_UNKNOWN = 0, TY_VOID, TY_BOOL, TY_INT, TY_FLOAT };
+
+/// SymbolEntry - The declaration a variable name resolves to. The declaring
+/// node owns it and sema points every use of the name at it; codegen fills
+/// in the storage when it emits the declaration, which always precedes the
+/// uses.
+struct SymbolEntry {
+  enum EntryKind { Scalar, Array, ArrayParam };
+
+  EntryKind Kind = Scalar;
+  TypeKind Ty = TY_UNKNOWN;   // arrays: the element type
+  ArrayRef<int> Dims;         // arrays: dimensions, owned by the AST arena
+  Value* Storage = nullptr;   // AllocaInst for local arrays, Argument for array
+                              // parameters, GlobalVariable for globals, null for
+                              // scalar locals
+  Type* StoredType = nullptr; // type held in Storage (a pointer for array parameters)
+
+  bool isArray() const { return Kind != Scalar; }
+};
+
+/// SymbolTable - Scoped variable bindings. Visible maps every name to its
+/// innermost binding, so a lookup is a single hash probe whatever the
+/// nesting depth; declaring over an existing binding saves it in an undo log
+/// that popScope() replays to restore the outer scope.
+class SymbolTable {
+  struct SavedBinding {
+    Symbol Name;
+    SymbolEntry* Outer; // null if the name was unbound before the scope
+  };
+
+  DenseMap<Symbol, SymbolEntry*> Visible;
+  std::vector<SavedBinding> UndoLog;
+  std::vector<size_t> ScopeStarts; // UndoLog size at each pushScope()
+
+public:
+  // Depth 0 is the global scope
+  bool isGlobalScope() const { return ScopeStarts.empty(); }
+
+  void pushScope() { ScopeStarts.push_back(UndoLog.size()); }
+
+  void popScope() {
+    size_t Start = ScopeStarts.back();
+    ScopeStarts.pop_back();
+    while (UndoLog.size() > Start) {
+      SavedBinding& Saved = UndoLog.back();
+      if (Saved.Outer)
+        Visible[Saved.Name] = Saved.Outer;
+      else
+        Visible.erase(Saved.Name);
+      UndoLog.pop_back();
+    }
+  }
+
+  void declare(Symbol Name, SymbolEntry* Entry) {
+    SymbolEntry*& Slot = Visible[Name];
+    if (!isGlobalScope())
+      UndoLog.push_back({Name, Slot});
+    Slot = Entry;
+  }
+
+  SymbolEntry* lookup(Symbol Name) const { return Visible.lookup(Name); }
+};
+
+//===----------------------------------------------------------------------===//
+// SSA Construction
+//===----------------------------------------------------------------------===//
+
+/// SSABuilder - Keeps scalar locals and parameters in SSA registers while
+/// codegen emits a function, so they never touch memory. This is the
+/// algorithm of Braun et al., "Simple and Efficient Construction of Static
+/// Single Assignment Form" (CC 2013): a read looks for the variable's last
+/// definition in the current block and otherwise asks the predecessors,
+/// placing a PHI where they may disagree. A block is sealed once all its
+/// predecessors have been emitted; reads in an unsealed block (a loop
+/// condition before the back edge exists) get placeholder PHIs whose
+/// operands are filled in by sealBlock(). PHIs that turn out to merge a
+/// single value are removed again, so the result matches mem2reg.
+class SSABuilder {
+  // The value of each variable at the end of each block it is defined in.
+  // Tracking handles follow a trivial PHI to its replacement.
+  DenseMap<std::pair<SymbolEntry*, BasicBlock*>, WeakTrackingVH> CurrentDef;
+  DenseMap<BasicBlock*, SmallVector<std::pair<SymbolEntry*, PHINode*>, 4>> IncompletePhis;
+  SmallPtrSet<BasicBlock*, 32> Sealed;
+  SmallPtrSet<PHINode*, 8> Filling; // PHIs whose operands are being added
+  DenseMap<SymbolEntry*, StringRef> Names; // for naming PHIs
+
+  Value* readVariableRecursive(SymbolEntry* Var, BasicBlock* BB) {
+    Value* Val;
+    if (!Sealed.count(BB)) {
+      // Not all predecessors are known yet; sealBlock() completes the PHI
+      PHINode* Phi = createPhi(Var, BB);
+      IncompletePhis[BB].push_back({Var, Phi});
+      Val = Phi;
+    } else if (BasicBlock* Pred = BB->getSinglePredecessor()) {
+      // No merge, so no PHI needed
+      Val = readVariable(Var, Pred);
+    } else {
+      // Record the PHI first to break cycles through loops
+      PHINode* Phi = createPhi(Var, BB);
+      writeVariable(Var, BB, Phi);
+      Val = addPhiOperands(Var, Phi);
+    }
+    writeVariable(Var, BB, Val);
+    return Val;
+  }
+
+  PHINode* createPhi(SymbolEntry* Var, BasicBlock* BB) {
+    IRBuilder<> TmpB(BB, BB->begin());
+    return TmpB.CreatePHI(Var->StoredType, 2, Names.lookup(Var));
+  }
+
+  Value* addPhiOperands(SymbolEntry* Var, PHINode* Phi) {
+    BasicBlock* BB = Phi->getParent();
+    Filling.insert(Phi);
+    for (BasicBlock* Pred : predecessors(BB))
+      Phi->addIncoming(readVariable(Var, Pred), Pred);
+    Filling.erase(Phi);
+    return tryRemoveTrivialPhi(Phi);
+  }
+
+  // A PHI whose operands are all one value (or the PHI itself) is replaced
+  // by that value. Removing it may make PHIs that used it trivial in turn,
+  // except those still being filled in, which are checked once complete.
+  Value* tryRemoveTrivialPhi(PHINode* Phi) {
+    Value* Same = nullptr;
+    for (Value* Op : Phi->incoming_values()) {
+      if (Op == Same || Op == Phi)
+        continue;
+      if (Same)
+        return Phi; // merges at least two values
+      Same = Op;
+    }
+    // No operands at all: the block is unreachable or the variable unset
+    if (!Same)
+      Same = PoisonValue::get(Phi->getType());
+
+    SmallVector<WeakVH, 8> PhiUsers;
+    for (User* U : Phi->users())
+      if (U != Phi && isa<PHINode>(U))
+        PhiUsers.push_back(U);
+    Phi->replaceAllUsesWith(Same);
+    Phi->eraseFromParent();
+
+    // Same may itself be one of the PHIs removed below; follow it
+    WeakTrackingVH Result = Same;
+    for (WeakVH& U : PhiUsers)
+      if (auto* UserPhi = dyn_cast_or_null<PHINode>(U); UserPhi && !Filling.count(UserPhi))
+        tryRemoveTrivialPhi(UserPhi);
+    return Result;
+  }
+
+public:
+  // Forget the previous function
+  void startFunction() {
+    CurrentDef.clear();
+    IncompletePhis.clear();
+    Sealed.clear();
+    Names.clear();
+  }
+
+  // Var comes into scope in BB with an initial value
+  void declareVariable(SymbolEntry* Var, StringRef Name, BasicBlock* BB, Value* Init) {
+    Names[Var] = Name;
+    writeVariable(Var, BB, Init);
+  }
+
+  void writeVariable(SymbolEntry* Var, BasicBlock* BB, Value* Val) {
+    CurrentDef[{Var, BB}] = Val;
+  }
+
+  Value* readVariable(SymbolEntry* Var, BasicBlock* BB) {
+    auto It = CurrentDef.find({Var, BB});
+    if (It != CurrentDef.end())
+      return It->second;
+    return readVariableRecursive(Var, BB);
+  }
+
+  // Every predecessor of BB has been emitted
+  void sealBlock(BasicBlock* BB) {
+    auto It = IncompletePhis.find(BB);
+    if (It != IncompletePhis.end()) {
+      auto Phis = std::move(It->second);
+      IncompletePhis.erase(It);
+      for (auto& [Var, Phi] : Phis)
+        addPhiOperands(Var, Phi);
+    }
+    Sealed.insert(BB);
+  }
+};
+
+//===----------------------------------------------------------------------===//
+// Compiler Instance
+//===----------------------------------------------------------------------===//
+
+/// LoopHints - The #pragma lines before a while loop, lowered to llvm.loop
+/// metadata on its back edge. A count or width of 0 leaves the factor to
+/// the optimiser.
+struct LoopHints {
+  enum Hint : uint8_t { NONE, ENABLE, DISABLE };
+  Hint Unroll = NONE;       // "unroll" or "nounroll"
+  Hint Vectorize = NONE;    // "vectorize" or "novectorize"
+  unsigned UnrollCount = 0;
+  unsigned VectorizeWidth = 0;
+  SourceLoc UnrollLoc, VectorizeLoc; // of each '#pragma', for -Rloop-hints
+
+  bool empty() const { return Unroll == NONE && Vectorize == NONE; }
+};
+
+// One hint as written after '#pragma', e.g. "unroll 4" or "novectorize"
+static std::string getLoopHintSpelling(const LoopHints& Hints, bool Unroll) {
+  LoopHints::Hint Hint = Unroll ? Hints.Unroll : Hints.Vectorize;
+  unsigned Factor = Unroll ? Hints.UnrollCount : Hints.VectorizeWidth;
+  std::string S = std::string(Hint == LoopHints::DISABLE ? "no" : "") +
+                  (Unroll ? "unroll" : "vectorize");
+  if (Factor)
+    S += " " + std::to_string(Factor);
+  return S;
+}
 
-const std::string TOKEN::getIdentifierStr() const {
+/// LoopHintSite - A hinted loop as -Rloop-hints finds it again after
+/// optimisation: by its function and its number among the hinted loops there.
+struct LoopHintSite {
+  std::string Function;
+  unsigned Index;
+  LoopHints Hints;
+};
+
+class ASTnode;
+class FunctionPrototypeAST;
+struct LoopSummary;
+class VariableASTnode;
+
+/// CompilerInstance - The state of one translation unit, from the source
+/// buffer to the LLVM module. The driver gives every input file its own
+/// instance, so files share nothing and can be compiled on separate threads;
+/// the lexer, parser, sema and codegen reach the instance being compiled on
+/// their thread through CI.
+struct CompilerInstance {
+  DiagnosticsEngine& Diags; // owned by the driver, which reports after all files
+  StringInterner Identifiers;
+
+  // Lexer input. The whole file is held in one buffer (memory-mapped when
+  // large) and scanned with raw pointers. The buffer is null-terminated, so
+  // the terminator doubles as an end-of-input sentinel.
+  std::unique_ptr<MemoryBuffer> SourceBuffer;
+  const char* CurPtr = nullptr;    // next character to lex
+  const char* BufferEnd = nullptr; // the null terminator
+  const char* LineStart = nullptr; // start of the current line, for column numbers
+  int LineNo = 1;
+
+  // Parser
+  TOKEN CurTok;
+  std::deque<TOKEN> tok_buffer;
+  bool Panicking = false;   // set by a syntax error until the parser resynchronises
+  BumpPtrAllocator ASTArena; // every AST node, see newNode()
+  std::vector<ASTnode*> ProgramAST;
+  std::vector<FunctionPrototypeAST*> ExternAST;
+
+  // Semantic analysis
+  SymbolTable Symbols;                                // Variables in scope
+  DenseMap<Symbol, FunctionPrototypeAST*> Prototypes; // First declaration of each function
+  TypeKind CurrentReturnType = TY_VOID;               // Return type of the function being analysed
+  SmallVector<LoopSummary*, 4> Loops; // -fbounds-check: loops around the statement being analysed
+
+  // -ftime-report
+  bool TimeReport = false;
+  PhaseStats Phases[NUM_PHASES];
+
+  // Code generation. The context is heap-owned so that --run can hand it to
+  // the JIT together with the module; TheContext stays valid for as long as
+  // either owns it.
+  std::unique_ptr<LLVMContext> TheContextPtr;
+  LLVMContext& TheContext;
+  IRBuilder<> Builder;
+  std::unique_ptr<Module> TheModule;
+  SSABuilder SSA; // scalar locals of the function being emitted
+  bool NoAliasArrayParams = false;   // -fno-alias-array-params
+  MDNode* TBAATags[TY_FLOAT + 1] = {}; // access tag of each type, see addTBAATag()
+
+  // -fbounds-check
+  bool BoundsCheck = false;
+  DenseMap<SymbolEntry*, int> InBounds; // variables known to be in [0, n) here
+  BasicBlock* BoundsTrapBB = nullptr;   // the current function's trap, made on first use
+  bool CountBoundsChecks = true;        // false while emitting the checked copy of a loop
+  unsigned BoundsChecks = 0;            // array indices
+  unsigned BoundsChecksEliminated = 0;  // of which needed no check
+  unsigned LoopsVersioned = 0;
+
+  // -Rloop-hints
+  bool RemarkLoopHints = false;
+  std::vector<LoopHintSite> HintedLoops; // in source order
+  unsigned FunctionHintedLoops = 0;      // hinted loops emitted so far in the current function
+
+  explicit CompilerInstance(DiagnosticsEngine& Diags)
+      : Diags(Diags), TheContextPtr(std::make_unique<LLVMContext>()), TheContext(*TheContextPtr),
+        Builder(TheContext) {}
+};
+
+// The instance being compiled on this thread
+static thread_local CompilerInstance* CI = nullptr;
+
+// Spelling of an interned identifier
+static StringRef symbolName(Symbol Sym) { return CI->Identifiers.getName(Sym); }
+
+/// PhaseTimer - Charges the wall time and heap allocations of its lifetime
+/// to a phase of the current instance, and records it as a --time-trace span.
+/// Phases may nest; the inner phase is then counted in both.
+class PhaseTimer {
+  PhaseStats& Stats;
+  std::optional<TimeTraceScope> Trace;
+  std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+  uint64_t StartAllocations = NumAllocations;
+  uint64_t StartBytes = BytesAllocated;
+
+public:
+  // Trace is false for phases too fine-grained to be worth a span each
+  explicit PhaseTimer(CompilerPhase Phase, bool Trace = true) : Stats(CI->Phases[Phase]) {
+    if (Trace)
+      this->Trace.emplace(getPhaseName(Phase));
+  }
+
+  ~PhaseTimer() {
+    Stats.Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    Stats.Allocations += NumAllocations - StartAllocations;
+    Stats.Bytes += BytesAllocated - StartBytes;
+  }
+};
+
+// Load Filename as the lexer input. Returns false if it cannot be read.
+static bool openSourceFile(const std::string& Filename) {
+  auto BufOrErr = MemoryBuffer::getFile(Filename);
+  if (!BufOrErr) {
+    fprintf(stderr, "Error opening file: %s\n", BufOrErr.getError().message().c_str());
+    return false;
+  }
+  CI->SourceBuffer = std::move(*BufOrErr);
+  CI->CurPtr = CI->LineStart = CI->SourceBuffer->getBufferStart();
+  CI->BufferEnd = CI->SourceBuffer->getBufferEnd();
+  CI->LineNo = 1;
+  return true;
+}
+
+const Symbol TOKEN::getIdentifier() const {
   if (type != IDENT) {
-    fprintf(stderr, "%d:%d Error: %s\n", lineNo, columnNo,
-            "getIdentifierStr called on non-IDENT token");
-    exit(2);
+    CI->Diags.report(DiagnosticsEngine::Syntax, {lineNo, columnNo},
+                     "getIdentifier called on non-IDENT token");
+    return Symbol();
   }
-  return lexeme;
+  return Sym;
 }
 
 const int TOKEN::getIntVal() const {
   if (type != INT_LIT) {
-    fprintf(stderr, "%d:%d Error: %s\n", lineNo, columnNo,
-            "getIntVal called on non-INT_LIT token");
-    exit(2);
+    CI->Diags.report(DiagnosticsEngine::Syntax, {lineNo, columnNo},
+                     "getIntVal called on non-INT_LIT token");
+    return 0;
   }
-  return strtod(lexeme.c_str(), nullptr);
+  // lexeme is digits only and not null-terminated, so convert in place
+  unsigned Val = 0;
+  for (char C : lexeme)
+    Val = Val * 10 + (C - '0');
+  return (int)Val;
 }
 
 const float TOKEN::getFloatVal() const {
   if (type != FLOAT_LIT) {
-    fprintf(stderr, "%d:%d Error: %s\n", lineNo, columnNo,
-            "getFloatVal called on non-FLOAT_LIT token");
-    exit(2);
+    CI->Diags.report(DiagnosticsEngine::Syntax, {lineNo, columnNo},
+                     "getFloatVal called on non-FLOAT_LIT token");
+    return 0.0f;
   }
-  return strtof(lexeme.c_str(), nullptr);
+  return strtof(std::string(lexeme).c_str(), nullptr);
 }
 
 const bool TOKEN::getBoolVal() const {
   if (type != BOOL_LIT) {
-    fprintf(stderr, "%d:%d Error: %s\n", lineNo, columnNo,
-            "getBoolVal called on non-BOOL_LIT token");
-    exit(2);
+    CI->Diags.report(DiagnosticsEngine::Syntax, {lineNo, columnNo},
+                     "getBoolVal called on non-BOOL_LIT token");
+    return false;
   }
   return (lexeme == "true");
 }
 
-static TOKEN returnTok(std::string lexVal, int tok_type) {
+static TOKEN returnTok(const char* TokStart, const char* TokEnd, int tok_type) {
   TOKEN return_tok;
-  return_tok.lexeme = lexVal;
+  return_tok.lexeme = std::string_view(TokStart, TokEnd - TokStart);
   return_tok.type = tok_type;
-  return_tok.lineNo = lineNo;
-  return_tok.columnNo = columnNo - lexVal.length() - 1;
+  return_tok.lineNo = CI->LineNo;
+  return_tok.columnNo = TokStart - CI->LineStart + 1;
+  CI->CurPtr = TokEnd;
   return return_tok;
 }
 
-// Read file line by line -- or look for \n and if found add 1 to line number
-// and reset column number to 0
-/// gettok - Return the next token from standard input.
-static TOKEN gettok() {
-
-  static int LastChar = ' ';
-  static int NextChar = ' ';
-
-  // Skip any whitespace.
-  while (isspace(LastChar)) {
-    if (LastChar == '\n' || LastChar == '\r') {
-      lineNo++;
-      columnNo = 1;
-    }
-    LastChar = getc(pFile);
-    columnNo++;
-  }
-
-  if (isalpha(LastChar) || (LastChar == '_')) { // identifier: [a-zA-Z_][a-zA-Z_0-9]*
-    globalLexeme = LastChar;
-    columnNo++;
-
-    while (isalnum((LastChar = getc(pFile))) || (LastChar == '_')) {
-      globalLexeme += LastChar;
-      columnNo++;
-    }
-
-    // Check if identifier matches a reserved keyword
-    if (globalLexeme == "int")
-      return returnTok("int", INT_TOK);
-    if (globalLexeme == "bool")
-      return returnTok("bool", BOOL_TOK);
-    if (globalLexeme == "float")
-      return returnTok("float", FLOAT_TOK);
-    if (globalLexeme == "void")
-      return returnTok("void", VOID_TOK);
-    if (globalLexeme == "bool")
-      return returnTok("bool", BOOL_TOK);
-    if (globalLexeme == "extern")
-      return returnTok("extern", EXTERN);
-    if (globalLexeme == "if")
-      return returnTok("if", IF);
-    if (globalLexeme == "else")
-      return returnTok("else", ELSE);
-    if (globalLexeme == "while")
-      return returnTok("while", WHILE);
-    if (globalLexeme == "return")
-      return returnTok("return", RETURN);
-    if (globalLexeme == "true") {
-      //   BoolVal = true;
-      return returnTok("true", BOOL_LIT);
-    }
-    if (globalLexeme == "false") {
-      //   BoolVal = false;
-      return returnTok("false", BOOL_LIT);
-    }
-    return returnTok(globalLexeme.c_str(), IDENT);
-  }
-
-  // Handle '=' and '==' operators
-  if (LastChar == '=') {
-    NextChar = getc(pFile);
-    if (NextChar == '=') { // EQ: ==
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok("==", EQ);
-    } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok("=", ASSIGN);
-    }
-  }
-
-  // Single-character delimiters
-  if (LastChar == '{') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok("{", LBRA);
-  }
-  if (LastChar == '}') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok("}", RBRA);
-  }
-  if (LastChar == '(') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok("(", LPAR);
-  }
-  if (LastChar == ')') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok(")", RPAR);
-  }
-  if (LastChar == ';') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok(";", SC);
-  }
-  if (LastChar == ',') {
-    LastChar = getc(pFile);
-    columnNo++;
-    return returnTok(",", COMMA);
-  }
-
-  // Numeric literals: integers and floating-point
-  if (isdigit(LastChar) || LastChar == '.') { // Number: [0-9]+.
-    std::string NumStr;
+// Locale-independent character classes (llvm::isAlpha etc. from StringExtras)
+static bool isIdentStart(char C) {
+  return isAlpha(C) || C == '_';
+}
 
-    if (LastChar == '.') { // Floatingpoint Number: .[0-9]+
-      do {
-        NumStr += LastChar;
-        LastChar = getc(pFile);
-        columnNo++;
-      } while (isdigit(LastChar));
+static bool isIdentChar(char C) {
+  return isAlnum(C) || C == '_';
+}
 
-      return returnTok(NumStr, FLOAT_LIT);
-    } else {
-      do { // Start of Number: [0-9]+
-        NumStr += LastChar;
-        LastChar = getc(pFile);
-        columnNo++;
-      } while (isdigit(LastChar));
-
-      if (LastChar == '.') { // Floatingpoint Number: [0-9]+.[0-9]+)
-        do {
-          NumStr += LastChar;
-          LastChar = getc(pFile);
-          columnNo++;
-        } while (isdigit(LastChar));
-
-        return returnTok(NumStr, FLOAT_LIT);
-      } else { // Integer : [0-9]+
-        return returnTok(NumStr, INT_LIT);
+// Classify an identifier as a keyword or IDENT. The length and one
+// distinguishing character select the only keyword it could be, so each
+// identifier costs at most one string comparison.
+static int getKeywordOrIdent(std::string_view Ident) {
+  auto match = [&](std::string_view Keyword, int Tok) {
+    return Ident == Keyword ? Tok : int(IDENT);
+  };
+
+  switch (Ident.size()) {
+    case 2:
+      return match("if", IF);
+    case 3:
+      switch (Ident[0]) {
+        case 'f': return match("for", FOR);
+        case 'i': return match("int", INT_TOK);
       }
-    }
+      break;
+    case 4:
+      switch (Ident[0]) {
+        case 'b': return match("bool", BOOL_TOK);
+        case 'e': return match("else", ELSE);
+        case 't': return match("true", BOOL_LIT);
+        case 'v': return match("void", VOID_TOK);
+      }
+      break;
+    case 5:
+      switch (Ident[1]) { // "float" and "false" share their first letter
+        case 'a': return match("false", BOOL_LIT);
+        case 'h': return match("while", WHILE);
+        case 'l': return match("float", FLOAT_TOK);
+      }
+      break;
+    case 6:
+      switch (Ident[0]) {
+        case 'e': return match("extern", EXTERN);
+        case 'r': return match("return", RETURN);
+      }
+      break;
   }
+  return IDENT;
+}
 
-  // Handle '&' and '&&' operators
-  if (LastChar == '&') {
-    NextChar = getc(pFile);
-    if (NextChar == '&') { // AND: &&
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok("&&", AND);
+/// gettok - Return the next token from the source buffer.
+static TOKEN gettok() {
+  const char* P = CI->CurPtr;
+
+  // Skip whitespace and '//' comments. A newline is '\n', '\r' or "\r\n".
+  while (true) {
+    if (*P == '\n' || *P == '\r') {
+      if (P[0] == '\r' && P[1] == '\n')
+        P++;
+      P++;
+      CI->LineNo++;
+      CI->LineStart = P;
+    } else if (*P == ' ' || *P == '\t' || *P == '\v' || *P == '\f') {
+      P++;
+    } else if (P[0] == '/' && P[1] == '/') {
+      P += 2;
+      while (*P != '\n' && *P != '\r' && P != CI->BufferEnd)
+        P++;
     } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok("&", int('&'));
+      break;
     }
   }
 
-  // Handle '|' and '||' operators
-  if (LastChar == '|') {
-    NextChar = getc(pFile);
-    if (NextChar == '|') { // OR: ||
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok("||", OR);
-    } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok("|", int('|'));
-    }
-  }
+  const char* TokStart = P;
 
-  // Handle '!' and '!=' operators
-  if (LastChar == '!') {
-    NextChar = getc(pFile);
-    if (NextChar == '=') { // NE: !=
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok("!=", NE);
-    } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok("!", NOT);
-      ;
-    }
-  }
+  if (isIdentStart(*P)) { // identifier: [a-zA-Z_][a-zA-Z_0-9]*
+    do
+      P++;
+    while (isIdentChar(*P));
 
-  // Handle '<' and '<=' operators
-  if (LastChar == '<') {
-    NextChar = getc(pFile);
-    if (NextChar == '=') { // LE: <=
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok("<=", LE);
-    } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok("<", LT);
-    }
+    std::string_view Ident(TokStart, P - TokStart);
+    int Type = getKeywordOrIdent(Ident);
+    TOKEN Tok = returnTok(TokStart, P, Type);
+    if (Type == IDENT)
+      Tok.Sym = CI->Identifiers.intern(Ident);
+    return Tok;
   }
 
-  // Handle '>' and '>=' operators
-  if (LastChar == '>') {
-    NextChar = getc(pFile);
-    if (NextChar == '=') { // GE: >=
-      LastChar = getc(pFile);
-      columnNo += 2;
-      return returnTok(">=", GE);
-    } else {
-      LastChar = NextChar;
-      columnNo++;
-      return returnTok(">", GT);
-    }
+  // Numeric literals: [0-9]+ is an integer, [0-9]+.[0-9]* and .[0-9]* are floats
+  if (isDigit(*P) || *P == '.') {
+    while (isDigit(*P))
+      P++;
+    if (*P != '.')
+      return returnTok(TokStart, P, INT_LIT);
+    P++; // eat '.'
+    while (isDigit(*P))
+      P++;
+    return returnTok(TokStart, P, FLOAT_LIT);
   }
 
-  // Handle '/' for division or '//' for comments
-  if (LastChar == '/') { // could be division or could be the start of a comment
-    LastChar = getc(pFile);
-    columnNo++;
-    if (LastChar == '/') { // must be a comment
-      do {
-        LastChar = getc(pFile);
-        columnNo++;
-      } while (LastChar != EOF && LastChar != '\n' && LastChar != '\r');
-
-      if (LastChar != EOF)
-        return gettok();
-    } else
-      return returnTok("/", DIV);
+  switch (*P) {
+    // Operators that may be followed by a second character
+    case '=': // '=' or '=='
+      if (P[1] == '=')
+        return returnTok(TokStart, P + 2, EQ);
+      return returnTok(TokStart, P + 1, ASSIGN);
+    case '&': // '&' or '&&'
+      if (P[1] == '&')
+        return returnTok(TokStart, P + 2, AND);
+      return returnTok(TokStart, P + 1, int('&'));
+    case '|': // '|' or '||'
+      if (P[1] == '|')
+        return returnTok(TokStart, P + 2, OR);
+      return returnTok(TokStart, P + 1, int('|'));
+    case '!': // '!' or '!='
+      if (P[1] == '=')
+        return returnTok(TokStart, P + 2, NE);
+      return returnTok(TokStart, P + 1, NOT);
+    case '<': // '<' or '<='
+      if (P[1] == '=')
+        return returnTok(TokStart, P + 2, LE);
+      return returnTok(TokStart, P + 1, LT);
+    case '>': // '>' or '>='
+      if (P[1] == '=')
+        return returnTok(TokStart, P + 2, GE);
+      return returnTok(TokStart, P + 1, GT);
+    case '/': // '//' comments were skipped above
+      return returnTok(TokStart, P + 1, DIV);
+    case '#': // "#pragma"; the hint's words are lexed as ordinary tokens
+      if (std::string_view(P, std::min<size_t>(7, CI->BufferEnd - P)) == "#pragma" &&
+          !isIdentChar(P[7]))
+        return returnTok(TokStart, P + 7, PRAGMA);
+      break;
+    case '\0': // Check for end of file. Don't eat the EOF.
+      if (P == CI->BufferEnd)
+        return returnTok(TokStart, P, EOF_TOK);
+      break;
   }
 
-  // Check for end of file. Don't eat the EOF.
-  if (LastChar == EOF) {
-    columnNo++;
-    return returnTok("0", EOF_TOK);
+  // Otherwise, return the character as its ascii value. Single-character
+  // delimiters ({ } ( ) [ ] ; ,) and operators (+ - * %) all take this path.
+  return returnTok(TokStart, P + 1, int((unsigned char)*P));
+}
+
+// Feed the spelling of every token in Source, a slice of the input, to Hash.
+// Whitespace and comments are skipped, so editing them changes nothing.
+static void hashTokens(std::string_view Source, MD5& Hash) {
+  // Lex the slice with the instance's cursor, then put the cursor back
+  const char* SavedPtr = CI->CurPtr;
+  const char* SavedLineStart = CI->LineStart;
+  int SavedLineNo = CI->LineNo;
+
+  const char* End = Source.data() + Source.size();
+  CI->CurPtr = Source.data();
+  for (TOKEN Tok = gettok(); Tok.type != EOF_TOK && Tok.lexeme.data() < End; Tok = gettok()) {
+    Hash.update(StringRef(Tok.lexeme.data(), Tok.lexeme.size()));
+    Hash.update(StringRef("", 1)); // separator, so "a b" and "ab" differ
   }
 
-  // Otherwise, return the character as its ascii value.
-  int ThisChar = LastChar;
-  std::string s(1, ThisChar);
-  LastChar = getc(pFile);
-  columnNo++;
-  return returnTok(s, int(ThisChar));
+  CI->CurPtr = SavedPtr;
+  CI->LineStart = SavedLineStart;
+  CI->LineNo = SavedLineNo;
 }
 
 //===----------------------------------------------------------------------===//
@@ -413,64 +989,110 @@ static TOKEN gettok() {
 /// CurTok/getNextToken - Provide a simple token buffer.  CurTok is the current
 /// token the parser is looking at.  getNextToken reads another token from the
 /// lexer and updates CurTok with its results.
-static TOKEN CurTok;
-static std::deque<TOKEN> tok_buffer;
-
 static TOKEN getNextToken() {
 
-  if (tok_buffer.size() == 0)
-    tok_buffer.push_back(gettok());
+  if (CI->tok_buffer.size() == 0) {
+    if (CI->TimeReport) {
+      PhaseTimer Lex(PHASE_LEX, /*Trace=*/false);
+      CI->tok_buffer.push_back(gettok());
+    } else {
+      CI->tok_buffer.push_back(gettok());
+    }
+  }
 
-  TOKEN temp = tok_buffer.front();
-  tok_buffer.pop_front();
+  TOKEN temp = CI->tok_buffer.front();
+  CI->tok_buffer.pop_front();
 
-  return CurTok = temp;
+  return CI->CurTok = temp;
 }
 
 // Helper to get the connector for the current node
-static std::string getConnector(bool isLast) {
+static const char* getConnector(bool isLast) {
   return isLast ? "`--" : "|--";
 }
 
+// Start a node's line in the tree: indentation followed by its connector
+static raw_ostream& printConnector(raw_ostream& OS, const std::string& prefix, bool isLast) {
+  return OS << prefix << getConnector(isLast);
+}
+
 // Helper to extend prefix for children
 static std::string extendPrefix(const std::string& prefix, bool isLast) {
   return prefix + (isLast ? "   " : "|  ");
 }
 
 //===----------------------------------------------------------------------===//
-// Code Generation
+// Semantic Analysis
 //===----------------------------------------------------------------------===//
 
-static LLVMContext TheContext;
-static IRBuilder<> Builder(TheContext);
-static std::unique_ptr<Module> TheModule;
+// Type spelling for the AST dump and error messages
+static const char* getTypeName(TypeKind Ty) {
+  switch (Ty) {
+    case TY_VOID: return "void";
+    case TY_BOOL: return "bool";
+    case TY_INT: return "int";
+    case TY_FLOAT: return "float";
+    default: return "unknown";
+  }
+}
 
-static std::map<std::string, AllocaInst*> NamedValues;        // Local variables
-static std::map<std::string, GlobalVariable*> GlobalNamedValues; // Global variables
-static Function* CurrentFunction = nullptr;                    // Track current function being compiled
+// Check if conversion from src to targets is narrowing
+static bool isNarrowingConversion(TypeKind srcType, TypeKind targetType) {
+  if (srcType == targetType) return false;
 
-// PART 3 ADDITION
-// Store array metadata: name -> {element type, dimensions}
-struct ArrayInfo {
-  std::string elementType;
-  std::vector<int> dimensions;
-};
-static std::map<std::string, ArrayInfo> LocalArrayInfo; // Local array metadata
-static std::map<std::string, ArrayInfo> GlobalArrayInfo; // Global array metadata
-static std::map<std::string, ArrayInfo> ParamArrayInfo; // Array parameters
-
-// Get LLVM type from string type name
-static Type* getLLVMType(const std::string& typeName) {
-  if (typeName == "int") return Type::getInt32Ty(TheContext);
-  if (typeName == "float") return Type::getFloatTy(TheContext);
-  if (typeName == "bool") return Type::getInt1Ty(TheContext);
-  if (typeName == "void") return Type::getVoidTy(TheContext);
-  return nullptr;
+  // float to int is narrowing (loses decimal part)
+  if (srcType == TY_FLOAT && targetType == TY_INT) return true;
+
+  // float to bool is narrowing (loses precision)
+  if (srcType == TY_FLOAT && targetType == TY_BOOL) return true;
+
+  // int to bool is narrowing (loses magnitude)
+  if (srcType == TY_INT && targetType == TY_BOOL) return true;
+
+  return false;
+}
+
+// Semantic error reporting for sema (returns TypeKind). Analysis carries on,
+// treating the erroneous expression as TY_UNKNOWN so it reports no more.
+static TypeKind LogErrorT(SourceLoc Loc, const std::string& Str) {
+  CI->Diags.report(DiagnosticsEngine::Semantic, Loc, Str);
+  return TY_UNKNOWN;
+}
+
+
+//===----------------------------------------------------------------------===//
+// Code Generation
+//===----------------------------------------------------------------------===//
+
+// Get LLVM type for a resolved MiniC type
+static Type* getLLVMType(TypeKind Ty) {
+  switch (Ty) {
+    case TY_INT: return Type::getInt32Ty(CI->TheContext);
+    case TY_FLOAT: return Type::getFloatTy(CI->TheContext);
+    case TY_BOOL: return Type::getInt1Ty(CI->TheContext);
+    case TY_VOID: return Type::getVoidTy(CI->TheContext);
+    default: return nullptr;
+  }
+}
+
+// Tag a load or store of a Ty value with the TBAA access tag of Ty. MiniC
+// has no casts or unions, so memory is only ever accessed as the type it was
+// declared with, and accesses of different types never alias.
+static Instruction* addTBAATag(Instruction* I, TypeKind Ty) {
+  MDNode*& Tag = CI->TBAATags[Ty];
+  if (!Tag) {
+    MDBuilder MDB(CI->TheContext);
+    MDNode* Root = MDB.createTBAARoot("MiniC TBAA");
+    MDNode* Node = MDB.createTBAAScalarTypeNode(getTypeName(Ty), Root);
+    Tag = MDB.createTBAAStructTagNode(Node, Node, 0);
+  }
+  I->setMetadata(LLVMContext::MD_tbaa, Tag);
+  return I;
 }
 
 // Create alloca instruction in entry block
 static AllocaInst* CreateEntryBlockAlloca(Function* TheFunction, 
-                                          const std::string& VarName,
+                                          const Twine& VarName,
                                           Type* type) {
   IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
                      TheFunction->getEntryBlock().begin());
@@ -479,7 +1101,7 @@ static AllocaInst* CreateEntryBlockAlloca(Function* TheFunction,
 
 // PART 3 ADDITION
 // Create LLVM array type from element type and dimensions
-static llvm::Type* createArrayType(llvm::Type* elementType, const std::vector<int>& dims) {
+static llvm::Type* createArrayType(llvm::Type* elementType, ArrayRef<int> dims) {
   llvm::Type* result = elementType;
   // Build from innermost to outermost dimension
   for (int i = dims.size() - 1; i>= 0; i--) {
@@ -488,139 +1110,199 @@ static llvm::Type* createArrayType(llvm::Type* elementType, const std::vector<in
   return result;
 }
 
-// Type promotion helper
-static Value* promoteType(Value* V, Type* targetType) {
-    Type* srcType = V->getType();
-    if (srcType == targetType) return V;
-    
-    // int to float (widening)
-    if (srcType->isIntegerTy(32) && targetType->isFloatTy()) {
-      return Builder.CreateSIToFP(V, targetType, "intToFloat");
-    }
-    // bool to int
-    if (srcType->isIntegerTy(1) && targetType->isIntegerTy(32)) {
-      return Builder.CreateZExt(V, targetType, "boolToInt");
-    }
-    // bool to float
-    if (srcType->isIntegerTy(1) && targetType->isFloatTy()) {
-      Value* intVal = Builder.CreateZExt(V, Type::getInt32Ty(TheContext), "boolToInt");
-      return Builder.CreateSIToFP(intVal, targetType, "intToFloat");
-    }
-    // int to bool (for conditions)
-    if (srcType->isIntegerTy(32) && targetType->isIntegerTy(1)) {
-      return Builder.CreateICmpNE(V, ConstantInt::get(srcType, 0), "intToBool");
-    }
-    // float to bool
-    if (srcType->isFloatTy() && targetType->isIntegerTy(1)) {
-      return Builder.CreateFCmpUNE(V, ConstantFP::get(srcType, 0.0), "floatToBool");
-    }
-    return V;
-}
-
-// Semantic error reporting for codegen
+// Semantic error reporting for codegen. Sema has already checked the
+// program, so reaching this is a compiler bug and stops the whole run.
 static Value* LogErrorV(const char* Str) {
-  fprintf(stderr, "Semantic Error: %s\n", Str);
-  exit(2);
-  return nullptr;
+  report_fatal_error(Twine("code generation: ") + Str);
 }
 
-// Helper function to get type name for error messages
-static std::string getTypeName(Type* T) {
-  if (T->isFloatTy()) return "float";
-  if (T->isIntegerTy(32)) return "int";
-  if (T->isIntegerTy(1)) return "bool";
-  return "unknown";
+//===----------------------------------------------------------------------===//
+// AST Arena
+//===----------------------------------------------------------------------===//
+
+static SourceLoc locOf(const TOKEN& Tok) { return {Tok.lineNo, Tok.columnNo}; }
+
+// Every AST node of the translation unit is bump-allocated in the instance's
+// arena and the whole tree is released with it, so nodes are never destroyed
+// one by one and must not own heap memory: child lists are ArrayRefs into the
+// arena and names are Symbols or slices of the source buffer.
+template <typename T, typename... ArgTs>
+static T* newNode(ArgTs&&... Args) {
+  static_assert(std::is_trivially_destructible<T>::value,
+                "AST nodes must be trivially destructible");
+  return new (CI->ASTArena.Allocate<T>()) T(std::forward<ArgTs>(Args)...);
 }
 
-// Check if conversion from src to targets is narrowing
-static bool isNarrowingConversion(Type* srcType, Type* targetType) {
-  if (srcType == targetType) return false;
+// Copy a list built up during parsing into the arena
+template <typename T>
+static MutableArrayRef<T> copyToArena(const std::vector<T>& Vec) {
+  if (Vec.empty())
+    return {};
+  T* Mem = CI->ASTArena.Allocate<T>(Vec.size());
+  std::uninitialized_copy(Vec.begin(), Vec.end(), Mem);
+  return MutableArrayRef<T>(Mem, Vec.size());
+}
 
-  // float to int is narrowing (loses decimal part)
-  if (srcType->isFloatTy() && targetType->isIntegerTy(32)) return true;
+/// LoopSummary - What sema finds in the body and condition of a loop,
+/// outside any loop nested in it, for -fbounds-check to decide which array
+/// indices the loop can prove in range before it starts.
+struct LoopSummary {
+  DenseMap<SymbolEntry*, unsigned> Assignments; // scalars assigned or declared, and how often
+  DenseMap<SymbolEntry*, int> Steps;            // c, for scalars assigned v = v + c
+  std::vector<std::pair<VariableASTnode*, int>> Indices; // variable indices, and their dimension
+  bool HasCalls = false; // which may assign globals
+  bool HasLoops = false;
+
+  void noteAssignment(SymbolEntry* Var, int Step = 0) {
+    Assignments[Var]++;
+    if (Step > 0)
+      Steps[Var] = Step;
+  }
+};
 
-  // float to bool is narrowing (loses precision)
-  if (srcType->isFloatTy() && targetType->isIntegerTy(1)) return true;
+/// ASTnode - Base class for all AST nodes.
+class ASTnode {
+protected:
+  SourceLoc Loc;            // where the node starts, for diagnostics
+  TypeKind Ty = TY_UNKNOWN; // resolved by sema()
 
-  // int to bool is narrowing (loses magnitude)
-  if (srcType->isIntegerTy(32) && targetType->isIntegerTy(1)) return true;
+public:
+  explicit ASTnode(SourceLoc Loc = SourceLoc()) : Loc(Loc) {}
+  SourceLoc getLoc() const { return Loc; }
+  TypeKind getType() const { return Ty; }
+  // Resolve the names below this node and check its types, recording and
+  // returning the type of its value (void for statements)
+  virtual TypeKind sema() { return Ty; }
+  virtual Value *codegen() { return nullptr; };
+  // Address of the storage an assignable node names
+  virtual Value* codegenPtr() { return nullptr; }
+
+  // Assign Val to the variable or element this names. Evaluates the address
+  // after Val, as C does.
+  virtual void codegenStore(Value* Val) { CI->Builder.CreateStore(Val, codegenPtr()); }
+  // True if the node can be evaluated even when the program would not reach
+  // it, within Budget nodes; see ExprAST::codegenLogical
+  virtual bool isCheapAndPure(unsigned& Budget) const { return false; }
+  // Print this node and its children as an indented tree, one line per node
+  virtual void print(raw_ostream& OS, const std::string& prefix, bool isLast) const {}
+};
 
-  return false;
+// Charge one node to a speculation budget, failing once it is spent
+static bool takeBudget(unsigned& Budget) {
+  if (Budget == 0)
+    return false;
+  --Budget;
+  return true;
 }
 
-// Promote type with narrowing check - use in assignments, returns, and function args
-static Value* promoteTypeWithCheck(Value* V, Type* targetType, const char* context) {
-  Type* srcType = V->getType();
+/// ImplicitCastAST - A conversion sema inserts where a value meets a
+/// different type, e.g. int to float in 1 + 2.0 or int to bool in a
+/// condition. It is not in the source, so it prints as its operand.
+class ImplicitCastAST : public ASTnode {
+  ASTnode* Sub;
 
-  if (isNarrowingConversion(srcType, targetType)) {
-    std::string errMsg = std::string("Narrowing conversion from ") + getTypeName(srcType) + " to " + 
-                          getTypeName(targetType) + " in " + context;
-    return LogErrorV(errMsg.c_str());
-  }
+public:
+  ImplicitCastAST(ASTnode* sub, TypeKind to) : ASTnode(sub->getLoc()), Sub(sub) { Ty = to; }
 
-  return promoteType(V, targetType);
-}
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    Sub->print(OS, prefix, isLast);
+  }
 
-/// ASTnode - Base class for all AST nodes.
-class ASTnode {
+  virtual bool isCheapAndPure(unsigned& Budget) const override {
+    return Sub->isCheapAndPure(Budget);
+  }
 
-public:
-  virtual ~ASTnode() {}
-  virtual Value *codegen() { return nullptr; };
-  virtual std::string to_string(const std::string& prefix, bool isLast) const { return ""; };
+  virtual Value* codegen() override {
+    Value* V = Sub->codegen();
+    TypeKind From = Sub->getType();
+
+    // Any nonzero value is true
+    if (Ty == TY_BOOL) {
+      if (From == TY_FLOAT)
+        return CI->Builder.CreateFCmpUNE(V, ConstantFP::get(V->getType(), 0.0), "tobool");
+      return CI->Builder.CreateICmpNE(V, ConstantInt::get(V->getType(), 0), "tobool");
+    }
+    // Widening: bool to int, then int to float
+    if (From == TY_BOOL)
+      V = CI->Builder.CreateZExt(V, Type::getInt32Ty(CI->TheContext), "boolToInt");
+    if (Ty == TY_FLOAT)
+      V = CI->Builder.CreateSIToFP(V, Type::getFloatTy(CI->TheContext), "intToFloat");
+    return V;
+  }
 };
 
+// Convert an analysed expression to type To. Where a narrowing conversion
+// is an error (assignments, returns and arguments) Context names the place
+// for the message.
+static ASTnode* convertTo(ASTnode* N, TypeKind To, const char* Context = nullptr) {
+  TypeKind From = N->getType();
+  // Nothing to do, or an error has already been reported
+  if (From == To || From == TY_UNKNOWN || To == TY_UNKNOWN)
+    return N;
+  if (From == TY_VOID) {
+    LogErrorT(N->getLoc(), "Void value used in expression");
+    return N;
+  }
+  if (Context && isNarrowingConversion(From, To)) {
+    LogErrorT(N->getLoc(), std::string("Narrowing conversion from ") + getTypeName(From) +
+                               " to " + getTypeName(To) + " in " + Context);
+    return N;
+  }
+  return newNode<ImplicitCastAST>(N, To);
+}
+
 /// IntASTnode - Class for integer literals like 1, 2, 10,
 class IntASTnode : public ASTnode {
   int Val;
-  TOKEN Tok;
 
 public:
-  IntASTnode(TOKEN tok, int val) : Val(val), Tok(tok) {}
-  const std::string &getType() const { return Tok.lexeme; }
+  IntASTnode(TOKEN tok, int val) : ASTnode(locOf(tok)), Val(val) { Ty = TY_INT; }
+  int getValue() const { return Val; }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "IntLiteral(" + std::to_string(Val) + ")";
+  virtual bool isCheapAndPure(unsigned& Budget) const override { return takeBudget(Budget); }
+
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "IntLiteral(" << Val << ")\n";
   }
 
   virtual Value* codegen() override {
-    return ConstantInt::get(TheContext, APInt(32, Val, true));
+    return ConstantInt::get(CI->TheContext, APInt(32, Val, true));
   }
 };
 
 /// BoolASTnode - Class for boolean literals true and false,
 class BoolASTnode : public ASTnode {
   bool Bool;
-  TOKEN Tok;
 
 public:
-  BoolASTnode(TOKEN tok, bool B) : Bool(B), Tok(tok) {}
-  const std::string &getType() const { return Tok.lexeme; }
+  BoolASTnode(TOKEN tok, bool B) : ASTnode(locOf(tok)), Bool(B) { Ty = TY_BOOL; }
+
+  virtual bool isCheapAndPure(unsigned& Budget) const override { return takeBudget(Budget); }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "BoolLiteral(" + std::string(Bool ? "true" : "false") + ")";
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "BoolLiteral(" << (Bool ? "true" : "false") << ")\n";
   }
 
   virtual Value* codegen() override {
-    return ConstantInt::get(TheContext, APInt(1, Bool ? 1 : 0));
+    return ConstantInt::get(CI->TheContext, APInt(1, Bool ? 1 : 0));
   }
 };
 
 /// FloatASTnode - Node class for floating point literals like "1.0".
 class FloatASTnode : public ASTnode {
   double Val;
-  TOKEN Tok;
 
 public:
-  FloatASTnode(TOKEN tok, double Val) : Val(Val), Tok(tok) {}
-  const std::string &getType() const { return Tok.lexeme; }
+  FloatASTnode(TOKEN tok, double Val) : ASTnode(locOf(tok)), Val(Val) { Ty = TY_FLOAT; }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "FloatLiteral(" + std::to_string(Val) + ")";
+  virtual bool isCheapAndPure(unsigned& Budget) const override { return takeBudget(Budget); }
+
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "FloatLiteral(" << format("%f", Val) << ")\n";
   }
 
   virtual Value* codegen() override {
-    return ConstantFP::get(TheContext, APFloat((float)Val));
+    return ConstantFP::get(CI->TheContext, APFloat((float)Val));
   }
 };
 
@@ -628,196 +1310,237 @@ public:
 enum IDENT_TYPE { IDENTIFIER = 0 };
 class VariableASTnode : public ASTnode {
 protected:
-  TOKEN Tok;
-  std::string Name;
+  Symbol Name;
   IDENT_TYPE VarType;
+  SymbolEntry* Decl = nullptr; // resolved by sema()
 
 public:
-  VariableASTnode(TOKEN tok, const std::string &Name)
-      : Tok(tok), Name(Name), VarType(IDENT_TYPE::IDENTIFIER) {}
-  const std::string &getName() const { return Name; }
-  const std::string &getType() const { return Tok.lexeme; }
+  VariableASTnode(TOKEN tok, Symbol Name)
+      : ASTnode(locOf(tok)), Name(Name), VarType(IDENT_TYPE::IDENTIFIER) {}
+  Symbol getName() const { return Name; }
   const IDENT_TYPE getVarType() const { return VarType; }
+  SymbolEntry* getDecl() const { return Decl; }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "Variable(" + Name + ")";
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "Variable(" << symbolName(Name) << ")\n";
   }
 
-  virtual Value* codegen() override {
-    // Look up variable in local scope first
-    AllocaInst* A = NamedValues[Name];
-    if (A) {
-      return Builder.CreateLoad(A->getAllocatedType(), A, Name.c_str());
-    }
+  virtual TypeKind sema() override {
+    // Innermost binding wins: locals shadow globals
+    Decl = CI->Symbols.lookup(Name);
+    if (!Decl)
+      return LogErrorT(Loc, ("Unknown variable name: " + symbolName(Name)).str());
+    if (Decl->isArray())
+      return LogErrorT(Loc, ("Array used without an index: " + symbolName(Name)).str());
+    return Ty = Decl->Ty;
+  }
 
-    // Check global scope
-    GlobalVariable* G = GlobalNamedValues[Name];
-    if (G) {
-      return Builder.CreateLoad(G->getValueType(), G, Name.c_str());
+  // A whole array passed as a call argument: resolve the name without
+  // requiring an index. Returns null if it is not an array.
+  SymbolEntry* semaArray() {
+    Decl = CI->Symbols.lookup(Name);
+    if (!Decl) {
+      LogErrorT(Loc, ("Unknown variable name: " + symbolName(Name)).str());
+      return nullptr;
     }
+    if (!Decl->isArray())
+      return nullptr;
+    Ty = Decl->Ty;
+    return Decl;
+  }
+
+  virtual bool isCheapAndPure(unsigned& Budget) const override { return takeBudget(Budget); }
+
+  // Arrays decay to a pointer to their first element, which under opaque
+  // pointers is the storage itself
+  virtual Value* codegenPtr() override { return Decl->Storage; }
 
-    return LogErrorV(("Unknown variable name: " + Name).c_str());
+  // Scalar locals and parameters live in SSA registers, globals in memory
+  virtual void codegenStore(Value* Val) override {
+    if (!CI->InBounds.empty())
+      CI->InBounds.erase(Decl);
+    if (Decl->Storage)
+      addTBAATag(CI->Builder.CreateStore(Val, Decl->Storage), Decl->Ty);
+    else
+      CI->SSA.writeVariable(Decl, CI->Builder.GetInsertBlock(), Val);
+  }
+
+  virtual Value* codegen() override {
+    if (!Decl->Storage)
+      return CI->SSA.readVariable(Decl, CI->Builder.GetInsertBlock());
+    return addTBAATag(CI->Builder.CreateLoad(Decl->StoredType, Decl->Storage, symbolName(Name)),
+                      Decl->Ty);
   }
 };
 
+// The current function's bounds-check failure block, which traps
+static BasicBlock* getBoundsTrapBlock() {
+  if (!CI->BoundsTrapBB) {
+    Function* F = CI->Builder.GetInsertBlock()->getParent();
+    CI->BoundsTrapBB = BasicBlock::Create(CI->TheContext, "boundsfail", F);
+    IRBuilder<> TmpB(CI->BoundsTrapBB);
+    TmpB.CreateIntrinsic(Intrinsic::trap, {}, {});
+    TmpB.CreateUnreachable();
+  }
+  return CI->BoundsTrapBB;
+}
+
+// -fbounds-check: trap unless 0 <= Idx < Dim. IndexVar is the variable the
+// index names, or null if it is any other expression. Constant indices and
+// variables an enclosing loop has proved in range need no check.
+static void emitBoundsCheck(SymbolEntry* IndexVar, Value* Idx, int Dim) {
+  auto It = IndexVar ? CI->InBounds.find(IndexVar) : CI->InBounds.end();
+  auto* C = dyn_cast<ConstantInt>(Idx);
+  bool Redundant = (C && C->getValue().ult(Dim)) || (It != CI->InBounds.end() && It->second <= Dim);
+  if (CI->CountBoundsChecks) {
+    CI->BoundsChecks++;
+    CI->BoundsChecksEliminated += Redundant;
+  }
+  if (Redundant)
+    return;
+
+  // Negative indices compare as large unsigned ones
+  Value* InRange = CI->Builder.CreateICmpULT(Idx, ConstantInt::get(Idx->getType(), Dim), "inbounds");
+  Function* F = CI->Builder.GetInsertBlock()->getParent();
+  BasicBlock* OkBB = BasicBlock::Create(CI->TheContext, "inbounds.ok", F);
+  MDBuilder MDB(CI->TheContext);
+  CI->Builder.CreateCondBr(InRange, OkBB, getBoundsTrapBlock(), MDB.createBranchWeights(1 << 20, 1));
+  CI->SSA.sealBlock(OkBB);
+  CI->Builder.SetInsertPoint(OkBB);
+}
+
 // PART 3 ADDITION
 // ArrayAccessAST - Class for accessing array elements like arr[i] or arr[i][j]
 class ArrayAccessAST : public ASTnode {
-  std::string Name;
-  std::vector<std::unique_ptr<ASTnode>> Indices; // 1, 2 or 3 index expressions
+  Symbol Name;
+  MutableArrayRef<ASTnode*> Indices; // 1, 2 or 3 index expressions
+  SymbolEntry* Decl = nullptr;       // resolved by sema()
+  SymbolEntry* IndexVars[3] = {};    // the variable each index names, if it is
+                                     // just one; resolved by sema()
 
 public:
-  ArrayAccessAST(const std::string& name, std::vector<std::unique_ptr<ASTnode>> indices)
-      : Name(name), Indices(std::move(indices)) {}
+  ArrayAccessAST(SourceLoc loc, Symbol name, MutableArrayRef<ASTnode*> indices)
+      : ASTnode(loc), Name(name), Indices(indices) {}
 
-  const std::string& getName() const { return Name; }
+  Symbol getName() const { return Name; }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // Display array access with array name
-    std::string result = prefix + getConnector(isLast) + "ArrayAccess(" + Name + ")";
+    printConnector(OS, prefix, isLast) << "ArrayAccess(" << symbolName(Name) << ")\n";
     std::string newPrefix = extendPrefix(prefix, isLast);
     // Add indices section header (always last child of ArrayAccess)
-    result += "\n" + newPrefix+ getConnector(true) + "Indices:";
+    printConnector(OS, newPrefix, true) << "Indices:\n";
     std::string indicesPrefix = extendPrefix(newPrefix, true);
     // Print each index expression as a child
     for (size_t i = 0; i < Indices.size(); i++) {
       bool lastIdx = (i == Indices.size() - 1);
-      result += "\n" + Indices[i]->to_string(indicesPrefix, lastIdx);
+      Indices[i]->print(OS, indicesPrefix, lastIdx);
     }
-    return result;
   }
 
-  // Returns the pointer to the element (for use in assignment LHS)
-  Value* codegenPtr() {
-    // Check if this is an array parameter (passed as pointer)
-    if (ParamArrayInfo.count(Name)) {
-      AllocaInst* PtrAlloca = NamedValues[Name];
-      if (!PtrAlloca) return LogErrorV(("Unknown array parameter: " + Name).c_str());
-
-      ArrayInfo& info = ParamArrayInfo[Name];
-
-      // Load the pointer value
-      Value* Ptr = Builder.CreateLoad(PtrAlloca->getAllocatedType(), PtrAlloca, Name + "_ptr");
+  // The name must be an array in scope, indexed once per dimension by ints
+  virtual TypeKind sema() override {
+    Decl = CI->Symbols.lookup(Name);
+    if (!Decl || !Decl->isArray())
+      LogErrorT(Loc, ("Unknown array: " + symbolName(Name)).str());
+    else if (Indices.size() != Decl->Dims.size())
+      LogErrorT(Loc, ("Wrong number of indices for array: " + symbolName(Name)).str());
+    else
+      Ty = Decl->Ty;
 
-      // Generate index values
-      std::vector<Value*> idxList;
-      for (auto& idx: Indices) {
-        Value* idxVal = idx->codegen();
-        if (!idxVal) return nullptr;
-        if (!idxVal->getType()->isIntegerTy(32)) {
-          idxVal = Builder.CreateIntCast(idxVal, Type::getInt32Ty(TheContext), true, "idx_cast");
-        }
-        idxList.push_back(idxVal);
-      }
+    for (size_t i = 0; i < Indices.size(); i++) {
+      Indices[i]->sema();
+      Indices[i] = convertTo(Indices[i], TY_INT, "array index");
+      // A variable index may be one a loop proves in range, which lets
+      // -fbounds-check drop its check
+      if (auto* Var = dynamic_cast<VariableASTnode*>(Indices[i]))
+        IndexVars[i] = Var->getDecl();
+    }
 
-      // For 1D array parameter: use the single index
-      // For multi-dimensional: calcualte offset
-      if (idxList.size() == 1) {
-        return Builder.CreateGEP(getLLVMType(info.elementType), Ptr, idxList[0], "arrayidx");
-      } else {
-        // Multi-dimensional array parameter - calculate linear offset
-        // For int a[M][N], accessing a[i][j] = a + i*N + j
-        Value* offset = idxList[0];
-        for (size_t i = 1; i < idxList.size(); i++) {
-          Value* dimSize = ConstantInt::get(Type::getInt32Ty(TheContext), info.dimensions[i]);
-          offset = Builder.CreateMul(offset, dimSize, "offset_mul");
-          offset = Builder.CreateAdd(offset, idxList[i], "offset_add");
-        }
-        return Builder.CreateGEP(getLLVMType(info.elementType), Ptr, offset, "arrayidx");
+    // Indices the enclosing loop may be able to prove in range up front
+    if (Ty != TY_UNKNOWN && !CI->Loops.empty()) {
+      for (size_t i = 0; i < Indices.size(); i++) {
+        if (IndexVars[i])
+          CI->Loops.back()->Indices.push_back({static_cast<VariableASTnode*>(Indices[i]),
+                                               Decl->Dims[i]});
       }
     }
-    // Look up in local arrays first
-    AllocaInst* LocalArr = NamedValues[Name];
-    if (LocalArr && LocalArrayInfo.count(Name)) {
-      ArrayInfo& info = LocalArrayInfo[Name];
-      
-      // Build index list
-      std::vector<Value*> idxList;
-      idxList.push_back(ConstantInt::get(TheContext, APInt(32, 0)));
-      
-      for (auto& idx : Indices) {
-        Value* idxVal = idx->codegen();
-        if (!idxVal) return nullptr;
-        if (!idxVal->getType()->isIntegerTy(32)) {
-          idxVal = Builder.CreateIntCast(idxVal, Type::getInt32Ty(TheContext), true, "idx_cast");
-        }
-        idxList.push_back(idxVal);
+    return Ty;
+  }
+
+  // Evaluate index I, checking it against its dimension under -fbounds-check,
+  // and sign-extend it to the pointer width. Index arithmetic cannot
+  // overflow (see ExprAST::codegen), so in loops the extension folds into
+  // the induction variable rather than being redone every iteration.
+  Value* codegenIndex(size_t I) {
+    Value* Idx = Indices[I]->codegen();
+    if (CI->BoundsCheck)
+      emitBoundsCheck(IndexVars[I], Idx, Decl->Dims[I]);
+    const DataLayout& DL = CI->TheModule->getDataLayout();
+    return CI->Builder.CreateSExt(Idx, DL.getIndexType(PointerType::getUnqual(CI->TheContext)),
+                                  "idxprom");
+  }
+
+  // Returns the pointer to the element (for use in assignment LHS). Indices
+  // are in range in a valid program, so every GEP is inbounds.
+  virtual Value* codegenPtr() override {
+    std::vector<Value*> idxList;
+
+    // Array parameters are passed as a pointer to the first element. For
+    // int a[M][N], a[i][j] steps i rows of [N x i32] and then j elements.
+    if (Decl->Kind == SymbolEntry::ArrayParam) {
+      for (size_t i = 0; i < Indices.size(); i++) {
+        idxList.push_back(codegenIndex(i));
       }
-      
-      llvm::Type* arrayType = createArrayType(getLLVMType(info.elementType), info.dimensions);
-      return Builder.CreateGEP(arrayType, LocalArr, idxList, "arrayidx");
+      llvm::Type* RowType = createArrayType(getLLVMType(Ty), Decl->Dims.drop_front());
+      return CI->Builder.CreateInBoundsGEP(RowType, Decl->Storage, idxList, "arrayidx");
     }
 
-    // Same approach as local arrays - use of multi-index GEP
-    GlobalVariable* GlobalArr = GlobalNamedValues[Name];
-    if (GlobalArr && GlobalArrayInfo.count(Name)) {
-      ArrayInfo& info = GlobalArrayInfo[Name];
-      
-      std::vector<Value*> idxList;
-      idxList.push_back(ConstantInt::get(TheContext, APInt(32, 0)));
-      
-      for (auto& idx : Indices) {
-        Value* idxVal = idx->codegen();
-        if (!idxVal) return nullptr;
-        if (!idxVal->getType()->isIntegerTy(32)) {
-          idxVal = Builder.CreateIntCast(idxVal, Type::getInt32Ty(TheContext), true, "idx_cast");
-        }
-        idxList.push_back(idxVal);
-      }
-      
-      llvm::Type* arrayType = createArrayType(getLLVMType(info.elementType), info.dimensions);
-      return Builder.CreateGEP(arrayType, GlobalArr, idxList, "arrayidx");
+    // Local and global arrays: multi-index GEP into the whole array
+    idxList.push_back(ConstantInt::get(CI->TheContext, APInt(64, 0)));
+    for (size_t i = 0; i < Indices.size(); i++) {
+      idxList.push_back(codegenIndex(i));
     }
-    // Array not found
-    return LogErrorV(("Unknown array: " + Name).c_str());
+
+    return CI->Builder.CreateInBoundsGEP(Decl->StoredType, Decl->Storage, idxList, "arrayidx");
   }
 
   virtual Value* codegen() override {
     Value* elemPtr = codegenPtr();
-    if (!elemPtr) return nullptr;
-
-    // Determine element type
-    std::string elemType = "int"; // default
+    return addTBAATag(CI->Builder.CreateLoad(getLLVMType(Ty), elemPtr, symbolName(Name) + "_elem"), Ty);
+  }
 
-    if (ParamArrayInfo.count(Name)) {
-      elemType = ParamArrayInfo[Name].elementType;
-    } else if (LocalArrayInfo.count(Name)) {
-      elemType = LocalArrayInfo[Name].elementType;
-    } else if (GlobalArrayInfo.count(Name)) {
-      elemType = GlobalArrayInfo[Name].elementType;
-    }
-    return Builder.CreateLoad(getLLVMType(elemType), elemPtr, Name + "_elem");
+  virtual void codegenStore(Value* Val) override {
+    addTBAATag(CI->Builder.CreateStore(Val, codegenPtr()), Ty);
   }
 };
 
 /// ParamAST - Class for a parameter declaration
 class ParamAST {
-  std::string Name;
-  std::string Type;
-  std::vector<int> ArrayDims; // Empty for non-array, filled for array params
-  bool IsArray;
+  Symbol Name;
+  SymbolEntry Entry; // what uses of the parameter in the body resolve to
 
 public:
-  ParamAST(const std::string &name, const std::string &type)
-      : Name(name), Type(type), IsArray(false) {}
-
-  ParamAST(const std::string &name, const std::string &type, std::vector<int> dims)
-      : Name(name), Type(type), ArrayDims(std::move(dims)), IsArray(true) {}
-
-  const std::string &getName() const { return Name; }
-  const std::string &getType() const { return Type; }
-  bool isArray() const { return IsArray; }
-  const std::vector<int>& getDims() const {return ArrayDims;}
-
-  std::string to_string(const std::string& prefix = "", bool isLast = true) const {
-    std::string result = prefix + getConnector(isLast) + "Param(" + Type + " " + Name;
-    if (IsArray) {
-      for (int dim : ArrayDims) {
-        result += "[" + std::to_string(dim) + "]";
+  ParamAST(Symbol name, TypeKind type)
+      : Name(name), Entry{SymbolEntry::Scalar, type} {}
+
+  ParamAST(Symbol name, TypeKind type, ArrayRef<int> dims)
+      : Name(name), Entry{SymbolEntry::ArrayParam, type, dims} {}
+
+  Symbol getName() const { return Name; }
+  TypeKind getType() const { return Entry.Ty; }
+  bool isArray() const { return Entry.isArray(); }
+  ArrayRef<int> getDims() const { return Entry.Dims; }
+  SymbolEntry* getEntry() { return &Entry; }
+
+  void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const {
+    printConnector(OS, prefix, isLast) << "Param(" << getTypeName(Entry.Ty) << " " << symbolName(Name);
+    if (isArray()) {
+      for (int dim : Entry.Dims) {
+        OS << "[" << dim << "]";
       }
     }
-    result += ")";
-    return result;
+    OS << ")\n";
   }
 };
 
@@ -825,44 +1548,39 @@ public:
 class DeclAST : public ASTnode {
 
 public:
-  virtual ~DeclAST() {}
-  virtual const std::string& getName() const = 0;
+  using ASTnode::ASTnode;
+  virtual Symbol getName() const = 0;
 };
 
 /// VarDeclAST - Class for a variable declaration
 class VarDeclAST : public DeclAST {
-  std::unique_ptr<VariableASTnode> Var;
-  std::string Type;
+  VariableASTnode* Var;
+  SymbolEntry Entry;
 
 public:
-  VarDeclAST(std::unique_ptr<VariableASTnode> var, const std::string &type)
-      : Var(std::move(var)), Type(type) {}
-  const std::string &getType() const { return Type; }
-  const std::string &getName() const override { return Var->getName(); }
+  VarDeclAST(VariableASTnode* var, TypeKind type)
+      : Var(var), Entry{SymbolEntry::Scalar, type} {}
+  Symbol getName() const override { return Var->getName(); }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "LocalVarDecl(" + Type + " " + Var->getName() + ")";
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "LocalVarDecl(" << getTypeName(Entry.Ty) << " " << symbolName(Var->getName()) << ")\n";
   }
 
-  // Generate code for local variable declaration with zero initialisation
-  virtual Value* codegen() override {
-    Function* TheFunction = Builder.GetInsertBlock()->getParent();
-    llvm::Type* VarType = getLLVMType(Type);
+  virtual TypeKind sema() override {
+    CI->Symbols.declare(getName(), &Entry);
+    // Declared in a loop, it is reset every iteration
+    if (!CI->Loops.empty())
+      CI->Loops.back()->noteAssignment(&Entry);
+    return Ty = TY_VOID;
+  }
 
-    AllocaInst* Alloca = CreateEntryBlockAlloca(TheFunction, getName(), VarType);
-    
-    // Initialize to 0
-    Value* InitVal;
-    if (VarType->isFloatTy())
-      InitVal = ConstantFP::get(TheContext, APFloat(0.0f));
-    else if (VarType->isIntegerTy(1))
-      InitVal = ConstantInt::get(TheContext, APInt(1, 0));
-    else
-      InitVal = ConstantInt::get(TheContext, APInt(32, 0));
-    
-    Builder.CreateStore(InitVal, Alloca);
-    NamedValues[getName()] = Alloca;
-    
+  // Generate code for local variable declaration with zero initialisation.
+  // The variable is an SSA value, so this emits nothing.
+  virtual Value* codegen() override {
+    llvm::Type* VarType = getLLVMType(Entry.Ty);
+    Value* InitVal = Constant::getNullValue(VarType);
+    Entry.StoredType = VarType;
+    CI->SSA.declareVariable(&Entry, symbolName(getName()), CI->Builder.GetInsertBlock(), InitVal);
     return InitVal;
   }
 };
@@ -870,46 +1588,48 @@ public:
 // PART 3 ADDITION
 /// LocalArrayDeclAST - Class for local array declarations like int arr[5][10];
 class LocalArrayDeclAST : public DeclAST {
-  std::string Name;
-  std::string Type;
-  std::vector<int> Dimensions;
+  Symbol Name;
+  SymbolEntry Entry;
 
 public:
-  LocalArrayDeclAST(const std::string& name, const std::string& type, std::vector<int> dims)
-      : Name(name), Type(type), Dimensions(std::move(dims)) {}
+  LocalArrayDeclAST(Symbol name, TypeKind type, ArrayRef<int> dims)
+      : Name(name), Entry{SymbolEntry::Array, type, dims} {}
     
-  const std::string& getName() const override { return Name; }
-  const std::string& getType() const { return Type; }
-  const std::vector<int>& getDimensions() const { return Dimensions; }
+  Symbol getName() const override { return Name; }
+  ArrayRef<int> getDimensions() const { return Entry.Dims; }
     
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    std::string dimStr = "";
-      for (int d : Dimensions) {
-        dimStr += "[" + std::to_string(d) + "]";
-      }
-      return prefix + getConnector(isLast) + "LocalArrayDecl(" + Type + " " + Name + dimStr + ")";
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "LocalArrayDecl(" << getTypeName(Entry.Ty) << " " << symbolName(Name);
+    for (int d : Entry.Dims) {
+      OS << "[" << d << "]";
+    }
+    OS << ")\n";
+  }
+
+  virtual TypeKind sema() override {
+    CI->Symbols.declare(Name, &Entry);
+    return Ty = TY_VOID;
   }
     
     // Generate code for local array with zero initialisation via memset
   virtual Value* codegen() override {
-    Function* TheFunction = Builder.GetInsertBlock()->getParent();
-    llvm::Type* elemType = getLLVMType(Type);
-    llvm::Type* arrayType = createArrayType(elemType, Dimensions);
+    Function* TheFunction = CI->Builder.GetInsertBlock()->getParent();
+    llvm::Type* elemType = getLLVMType(Entry.Ty);
+    llvm::Type* arrayType = createArrayType(elemType, Entry.Dims);
         
     // Create alloca for the array
-    AllocaInst* Alloca = CreateEntryBlockAlloca(TheFunction, Name, arrayType);
+    AllocaInst* Alloca = CreateEntryBlockAlloca(TheFunction, symbolName(Name), arrayType);
         
     // Initialize array to zero
-    Builder.CreateMemSet(
+    CI->Builder.CreateMemSet(
         Alloca,
-        ConstantInt::get(Type::getInt8Ty(TheContext), 0),
-        TheModule->getDataLayout().getTypeAllocSize(arrayType),
+        ConstantInt::get(Type::getInt8Ty(CI->TheContext), 0),
+        CI->TheModule->getDataLayout().getTypeAllocSize(arrayType),
         Alloca->getAlign()
     );
         
-    // Store in symbol tables
-    NamedValues[Name] = Alloca;
-    LocalArrayInfo[Name] = {Type, Dimensions};
+    Entry.Storage = Alloca;
+    Entry.StoredType = arrayType;
         
     return Alloca;
   }
@@ -917,36 +1637,39 @@ public:
 
 /// GlobVarDeclAST - Class for a Global variable declaration
 class GlobVarDeclAST : public DeclAST {
-  std::unique_ptr<VariableASTnode> Var;
-  std::string Type;
+  VariableASTnode* Var;
+  SymbolEntry Entry;
 
 public:
-  GlobVarDeclAST(std::unique_ptr<VariableASTnode> var, const std::string &type)
-      : Var(std::move(var)), Type(type) {}
-  const std::string &getType() const { return Type; }
-  const std::string &getName() const override { return Var->getName(); }
+  GlobVarDeclAST(VariableASTnode* var, TypeKind type)
+      : Var(var), Entry{SymbolEntry::Scalar, type} {}
+  Symbol getName() const override { return Var->getName(); }
+
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "GlobalVarDecl(" << getTypeName(Entry.Ty) << " " << symbolName(Var->getName()) << ")\n";
+  }
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    return prefix + getConnector(isLast) + "GlobalVarDecl(" + Type + " " + Var->getName() + ")";
+  // Redefinition check
+  virtual TypeKind sema() override {
+    if (CI->Symbols.lookup(getName()))
+      return LogErrorT(Var->getLoc(), ("Global variable already defined: " + symbolName(getName())).str());
+    CI->Symbols.declare(getName(), &Entry);
+    return Ty = TY_VOID;
   }
 
-  // Generate global variable with zero initialisation and redefinition check
+  // Generate global variable with zero initialisation
   virtual Value* codegen() override {
-    llvm::Type* VarType = getLLVMType(Type);
-    
-    // Check for redeclaration
-    if (GlobalNamedValues.count(getName())) {
-        return LogErrorV(("Global variable already defined: " + getName()).c_str());
-    }
+    llvm::Type* VarType = getLLVMType(Entry.Ty);
     
     GlobalVariable* GVar = new GlobalVariable(
-        *TheModule, VarType, false,
+        *CI->TheModule, VarType, false,
         GlobalValue::CommonLinkage,
         Constant::getNullValue(VarType),
-        getName()
+        symbolName(getName())
     );
     
-    GlobalNamedValues[getName()] = GVar;
+    Entry.Storage = GVar;
+    Entry.StoredType = VarType;
     return GVar;
   }
 };
@@ -954,48 +1677,48 @@ public:
 // PART 3 ADDITION
 /// GlobalArrayDeclAST - Class for global array declarations
 class GlobalArrayDeclAST : public DeclAST {
-  std::string Name;
-  std::string Type;
-  std::vector<int> Dimensions;
+  Symbol Name;
+  SymbolEntry Entry;
 
 public:
-  GlobalArrayDeclAST(const std::string& name, const std::string& type, std::vector<int> dims)
-        : Name(name), Type(type), Dimensions(std::move(dims)) {}
+  GlobalArrayDeclAST(SourceLoc loc, Symbol name, TypeKind type, ArrayRef<int> dims)
+        : DeclAST(loc), Name(name), Entry{SymbolEntry::Array, type, dims} {}
     
-  const std::string& getName() const override { return Name; }
-  const std::string& getType() const { return Type; }
+  Symbol getName() const override { return Name; }
     
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
-    std::string dimStr = "";
-    for (int d : Dimensions) {
-      dimStr += "[" + std::to_string(d) + "]";
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "GlobalArrayDecl(" << getTypeName(Entry.Ty) << " " << symbolName(Name);
+    for (int d : Entry.Dims) {
+      OS << "[" << d << "]";
     }
-    return prefix + getConnector(isLast) + "GlobalArrayDecl(" + Type + " " + Name + dimStr + ")";
+    OS << ")\n";
+  }
+
+  // Redefinition check
+  virtual TypeKind sema() override {
+    if (CI->Symbols.lookup(Name))
+      return LogErrorT(Loc, ("Global array already defined: " + symbolName(Name)).str());
+    CI->Symbols.declare(Name, &Entry);
+    return Ty = TY_VOID;
   }
     
   // Generate global array with zero initialisation
   virtual Value* codegen() override {
-    llvm::Type* elemType = getLLVMType(Type);
-    llvm::Type* arrayType = createArrayType(elemType, Dimensions);
-        
-    // Check for redeclaration
-    if (GlobalNamedValues.count(Name)) {
-      return LogErrorV(("Global array already defined: " + Name).c_str());
-    }
+    llvm::Type* elemType = getLLVMType(Entry.Ty);
+    llvm::Type* arrayType = createArrayType(elemType, Entry.Dims);
         
     // Create global variable with zero initializer
     GlobalVariable* GVar = new GlobalVariable(
-        *TheModule,
+        *CI->TheModule,
         arrayType,
         false,  // not constant
         GlobalValue::CommonLinkage,
         Constant::getNullValue(arrayType),
-        Name
+        symbolName(Name)
     );
         
-    // Store in symbol tables
-    GlobalNamedValues[Name] = GVar;
-    GlobalArrayInfo[Name] = {Type, Dimensions};
+    Entry.Storage = GVar;
+    Entry.StoredType = arrayType;
         
     return GVar;
   }
@@ -1003,42 +1726,62 @@ public:
 
 /// FunctionPrototypeAST - Class for a function declaration's signature
 class FunctionPrototypeAST {
-  std::string Name;
-  std::string Type;
-  std::vector<std::unique_ptr<ParamAST>> Params; // vector of parameters
+  SourceLoc Loc; // position of the name
+  Symbol Name;
+  TypeKind Type;
+  ArrayRef<ParamAST*> Params; // parameters, in order
+  bool HasBody = false;       // set by sema() on the first declaration of a defined function
+  Function* F = nullptr;      // set by codegen()
 
 public:
-  FunctionPrototypeAST(const std::string &name, const std::string &type,
-                       std::vector<std::unique_ptr<ParamAST>> params)
-      : Name(name), Type(type), Params(std::move(params)) {}
+  FunctionPrototypeAST(SourceLoc loc, Symbol name, TypeKind type, ArrayRef<ParamAST*> params)
+      : Loc(loc), Name(name), Type(type), Params(params) {}
 
-  const std::string &getName() const { return Name; }
-  const std::string &getType() const { return Type; }
+  SourceLoc getLoc() const { return Loc; }
+  Symbol getName() const { return Name; }
+  TypeKind getType() const { return Type; }
   int getSize() const { return Params.size(); }
-  std::vector<std::unique_ptr<ParamAST>> &getParams() { return Params; }
+  ArrayRef<ParamAST*> getParams() const { return Params; }
+  Function* getFunction() const { return F; }
+  bool hasBody() const { return HasBody; }
+  void setHasBody() { HasBody = true; }
+
+  // True if Other declares the same signature
+  bool matches(const FunctionPrototypeAST& Other) const {
+    if (Type != Other.Type || Params.size() != Other.Params.size())
+      return false;
+    for (size_t i = 0; i < Params.size(); i++) {
+      if (Params[i]->getType() != Other.Params[i]->getType() ||
+          Params[i]->getDims() != Other.Params[i]->getDims())
+        return false;
+    }
+    return true;
+  }
 
-  std::string to_string(const std::string& prefix = "", bool isLast = true) const {
+  void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const {
     // Display function prototype: return type and name
-    std::string result = prefix + getConnector(isLast) + "FunctionProto(" + Type + " " + Name + ")";
+    printConnector(OS, prefix, isLast) << "FunctionProto(" << getTypeName(Type) << " " << symbolName(Name) << ")\n";
     // Calculate prefix for parameter children
     std::string newPrefix = extendPrefix(prefix, isLast);
     // Print each parameter as a child node
     for (size_t i = 0; i < Params.size(); i++) {
       bool lastParam = (i == Params.size() - 1);
-      result += "\n" + Params[i]->to_string(newPrefix, lastParam);
-    } 
-    return result;
+      Params[i]->print(OS, newPrefix, lastParam);
+    }
   }
 
+  // Calls resolve by symbol; the first declaration of a name wins, as
+  // Module::getFunction would give
+  void sema() { CI->Prototypes.try_emplace(Name, this); }
+
   // Generate function signature: return type, parameter types, and argument names
   Function* codegen() {
     std::vector<llvm::Type*> ParamTypes;
-    for (auto& P : Params) {
+    for (ParamAST* P : Params) {
       if (P->isArray()) {
         // Array parameters decay to pointers in C
         // For int a[10], will use ptr (pointer to element type)
-        llvm::Type* elemType = getLLVMType(P->getType());
-        ParamTypes.push_back(PointerType::getUnqual(TheContext));
+        ParamTypes.push_back(PointerType::getUnqual(CI->TheContext));
       } else {
         ParamTypes.push_back(getLLVMType(P->getType()));
       }
@@ -1047,44 +1790,149 @@ public:
     llvm::Type* RetType = getLLVMType(Type);
     FunctionType* FT = FunctionType::get(RetType, ParamTypes, false);
     
-    Function* F = Function::Create(FT, Function::ExternalLinkage, 
-                                   Name, TheModule.get());
+    F = Function::Create(FT, Function::ExternalLinkage, 
+                         symbolName(Name), CI->TheModule.get());
     
-    // Set names for arguments
+    // Set names for arguments. Under -fno-alias-array-params every array
+    // parameter is restrict-qualified, as if declared "float a[restrict]".
     unsigned Idx = 0;
     for (auto& Arg : F->args()) {
-        Arg.setName(Params[Idx++]->getName());
+        if (CI->NoAliasArrayParams && Params[Idx]->isArray())
+          Arg.addAttr(Attribute::NoAlias);
+        Arg.setName(symbolName(Params[Idx++]->getName()));
     }
     
     return F;
   }
 };
 
-
 class ExprAST : public ASTnode {
-  TOKEN OpTok; // operator: +. -, *, /, ==, &&, etc.
-  std::unique_ptr<ASTnode> LHS;
-  std::unique_ptr<ASTnode> RHS; // may be null for unary
+  int Op;        // operator token type: +. -, *, /, ==, &&, etc.
+  ASTnode* LHS;
+  ASTnode* RHS;  // may be null for unary
 
 public:
   // binary operator constructor: lhs <op> rhs
-  ExprAST(TOKEN opTok,
-          std::unique_ptr<ASTnode> lhs,
-          std::unique_ptr<ASTnode> rhs)
-      : OpTok(opTok), LHS(std::move(lhs)), RHS(std::move(rhs)) {}
+  ExprAST(TOKEN opTok, ASTnode* lhs, ASTnode* rhs)
+      : ASTnode(locOf(opTok)), Op(opTok.type), LHS(lhs), RHS(rhs) {}
   
   // unary operator constructor: <op> rhs
-  ExprAST(TOKEN opTok,
-          std::unique_ptr<ASTnode> rhs)
-      : OpTok(opTok), LHS(nullptr), RHS(std::move(rhs)) {}
+  ExprAST(TOKEN opTok, ASTnode* rhs)
+      : ASTnode(locOf(opTok)), Op(opTok.type), LHS(nullptr), RHS(rhs) {}
 
   // optional helpers to inspect operator later in codegen
-  TOKEN getOpToken() const { return OpTok; }
+  int getOp() const { return Op; }
+  ASTnode* getLHS() const { return LHS; }
+  ASTnode* getRHS() const { return RHS; }
+
+  // Largest RHS (in nodes) that && and || evaluate unconditionally
+  static constexpr unsigned SelectBudget = 5;
+
+  // Literals, variables and non-trapping operators over them are cheap and
+  // pure. Calls, assignments, array reads and division may have side effects
+  // or trap, so they always stay behind a branch.
+  virtual bool isCheapAndPure(unsigned& Budget) const override {
+    if (!takeBudget(Budget) || Op == DIV || Op == MOD)
+      return false;
+    return (!LHS || LHS->isCheapAndPure(Budget)) && RHS->isCheapAndPure(Budget);
+  }
+
+  virtual TypeKind sema() override {
+    // Handle unary operators (LHS is nullptr)
+    if (!LHS) {
+      TypeKind R = RHS->sema();
+      if (R == TY_VOID)
+        return LogErrorT(Loc, "Void value used in expression");
+      if (Op == NOT) {
+        RHS = convertTo(RHS, TY_BOOL);
+        return Ty = TY_BOOL;
+      }
+      return Ty = R;
+    }
+
+    TypeKind L = LHS->sema();
+    TypeKind R = RHS->sema();
+    if (L == TY_VOID || R == TY_VOID)
+      return LogErrorT(Loc, "Void value used in expression");
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+    // Logical operators work on truth values
+    if (Op == AND || Op == OR) {
+      LHS = convertTo(LHS, TY_BOOL);
+      RHS = convertTo(RHS, TY_BOOL);
+      return Ty = TY_BOOL;
+    }
+
+    // Type coercion - promote to common type
+    // If either is float, promote both to float
+    // Else if either is int, promote both to int (from bool)
+    if (L == TY_UNKNOWN || R == TY_UNKNOWN)
+      return Ty = TY_UNKNOWN;
+    TypeKind Common = L;
+    if (L == TY_FLOAT || R == TY_FLOAT)
+      Common = TY_FLOAT;
+    else if (L == TY_INT || R == TY_INT)
+      Common = TY_INT;
+
+    if (Op == MOD && Common == TY_FLOAT)
+      return LogErrorT(Loc, "Operands of '%' must be integers");
+
+    LHS = convertTo(LHS, Common);
+    RHS = convertTo(RHS, Common);
+
+    // Comparisons yield bool, arithmetic the operand type
+    switch (Op) {
+      case LT: case LE: case GT: case GE: case EQ: case NE:
+        return Ty = TY_BOOL;
+      default:
+        return Ty = Common;
+    }
+  }
+
+  // && and || only evaluate the RHS when the LHS does not already decide the
+  // result. The RHS goes in its own block, joined by a PHI, unless it is
+  // cheap and pure, in which case it is evaluated anyway and combined with a
+  // select to keep the CFG flat.
+  Value* codegenLogical() {
+    bool IsAnd = (Op == AND);
+    Value* L = LHS->codegen();
+
+    unsigned Budget = SelectBudget;
+    if (RHS->isCheapAndPure(Budget)) {
+      Value* R = RHS->codegen();
+      return IsAnd ? CI->Builder.CreateSelect(L, R, CI->Builder.getFalse(), "andtmp")
+                   : CI->Builder.CreateSelect(L, CI->Builder.getTrue(), R, "ortmp");
+    }
+
+    Function* TheFunction = CI->Builder.GetInsertBlock()->getParent();
+    BasicBlock* LHSBB = CI->Builder.GetInsertBlock();
+    BasicBlock* RHSBB = BasicBlock::Create(CI->TheContext, IsAnd ? "and.rhs" : "or.rhs", TheFunction);
+    BasicBlock* MergeBB = BasicBlock::Create(CI->TheContext, IsAnd ? "and.end" : "or.end");
+
+    // && skips the RHS when the LHS is false, || when it is true
+    if (IsAnd)
+      CI->Builder.CreateCondBr(L, RHSBB, MergeBB);
+    else
+      CI->Builder.CreateCondBr(L, MergeBB, RHSBB);
+
+    CI->SSA.sealBlock(RHSBB);
+    CI->Builder.SetInsertPoint(RHSBB);
+    Value* R = RHS->codegen();
+    RHSBB = CI->Builder.GetInsertBlock(); // the RHS may have ended in another block
+    CI->Builder.CreateBr(MergeBB);
+
+    TheFunction->insert(TheFunction->end(), MergeBB);
+    CI->SSA.sealBlock(MergeBB);
+    CI->Builder.SetInsertPoint(MergeBB);
+    PHINode* PN = CI->Builder.CreatePHI(Type::getInt1Ty(CI->TheContext), 2, IsAnd ? "andtmp" : "ortmp");
+    PN->addIncoming(IsAnd ? CI->Builder.getFalse() : CI->Builder.getTrue(), LHSBB);
+    PN->addIncoming(R, RHSBB);
+    return PN;
+  }
+
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // Convert operator token to printable string
-    std::string opStr;
-    switch(OpTok.type) {
+    const char* opStr;
+    switch(Op) {
       case PLUS: opStr = "+"; break;
       case MINUS: opStr = "-"; break;
       case ASTERIX: opStr = "*"; break;
@@ -1108,16 +1956,14 @@ public:
     if (LHS) {
       //binary operator
       // two children: LHS (not last) and RHS (last)
-      std::string result = prefix + getConnector(isLast) + "BinaryExpr(" + opStr + ")";
-      result += "\n" + LHS->to_string(newPrefix, false);
-      result += "\n" + RHS->to_string(newPrefix, true);
-      return result;
+      printConnector(OS, prefix, isLast) << "BinaryExpr(" << opStr << ")\n";
+      LHS->print(OS, newPrefix, false);
+      RHS->print(OS, newPrefix, true);
     } else {
       // unary operator
       // one child: RHS (the operand)
-      std::string result = prefix + getConnector(isLast) + "UnaryExpr(" + opStr + ")";
-      result += "\n" + RHS->to_string(newPrefix, true);
-      return result;
+      printConnector(OS, prefix, isLast) << "UnaryExpr(" << opStr << ")\n";
+      RHS->print(OS, newPrefix, true);
     }
   }
 
@@ -1125,94 +1971,76 @@ public:
     // Handle unary operators (LHS is nullptr)
     if (!LHS) {
       Value* R = RHS->codegen();
-      if (!R) return nullptr;
       
-      switch(OpTok.type) {
+      switch(Op) {
         case NOT: {
-          // Convert to bool first if needed, then negate
-          if (!R->getType()->isIntegerTy(1)) {
-            R = Builder.CreateICmpNE(R, ConstantInt::get(R->getType(), 0), "tobool");
-          }
-          return Builder.CreateNot(R, "nottmp");
+          // Sema has already converted the operand to bool
+          return CI->Builder.CreateNot(R, "nottmp");
         }
         case MINUS: {
-          if (R->getType()->isFloatTy())
-            return Builder.CreateFNeg(R, "negtmp");
+          if (Ty == TY_FLOAT)
+            return CI->Builder.CreateFNeg(R, "negtmp");
+          else if (Ty == TY_INT)
+            return CI->Builder.CreateNSWNeg(R, "negtmp");
           else
-            return Builder.CreateNeg(R, "negtmp");
+            return CI->Builder.CreateNeg(R, "negtmp");
         }
         default:
           return LogErrorV("Invalid unary operator");
       }
     }
 
+    // Logical operators must not evaluate the RHS up front
+    if (Op == AND || Op == OR)
+      return codegenLogical();
+
     // Handle binary operators
+    // Sema has already promoted both operands to a common type
     Value* L = LHS->codegen();
     Value* R = RHS->codegen();
-    if (!L || !R) return nullptr;
-  
-    // Type coercion - promote to common type
-    // If either is float, promote both to float
-    // Else if either is int, promote both to int (from bool)
-    if (L->getType() != R->getType()) {
-      if (L->getType()->isFloatTy() || R->getType()->isFloatTy()) {
-        L = promoteType(L, Type::getFloatTy(TheContext));
-        R = promoteType(R, Type::getFloatTy(TheContext));
-      } else if (L->getType()->isIntegerTy(32) || R->getType()->isIntegerTy(32)) {
-        L = promoteType(L, Type::getInt32Ty(TheContext));
-        R = promoteType(R, Type::getInt32Ty(TheContext));
-      }
-    }
 
     // Determine floating-point or integer instructions
-    bool isFloat = L->getType()->isFloatTy();
+    bool isFloat = LHS->getType() == TY_FLOAT;
     
-    // Operator code generation
-    switch(OpTok.type) {
+    // Operator code generation. Signed overflow is undefined, as in C, so
+    // int arithmetic is nsw and loop analyses can reason about it. Bool
+    // arithmetic stays in i1 and wraps: true + true overflows i1 as a signed
+    // value, so nsw would make it poison.
+    bool NoSignedWrap = LHS->getType() == TY_INT;
+    switch(Op) {
       // Aritmetic operations
       case PLUS:
-        return isFloat ? Builder.CreateFAdd(L, R, "addtmp")
-                      : Builder.CreateAdd(L, R, "addtmp");
+        return isFloat ? CI->Builder.CreateFAdd(L, R, "addtmp")
+                       : CI->Builder.CreateAdd(L, R, "addtmp", false, NoSignedWrap);
       case MINUS:
-        return isFloat ? Builder.CreateFSub(L, R, "subtmp")
-                      : Builder.CreateSub(L, R, "subtmp");
+        return isFloat ? CI->Builder.CreateFSub(L, R, "subtmp")
+                       : CI->Builder.CreateSub(L, R, "subtmp", false, NoSignedWrap);
       case ASTERIX:
-        return isFloat ? Builder.CreateFMul(L, R, "multmp")
-                      : Builder.CreateMul(L, R, "multmp");
+        return isFloat ? CI->Builder.CreateFMul(L, R, "multmp")
+                       : CI->Builder.CreateMul(L, R, "multmp", false, NoSignedWrap);
       case DIV:
-        return isFloat ? Builder.CreateFDiv(L, R, "divtmp")
-                      : Builder.CreateSDiv(L, R, "divtmp");
+        return isFloat ? CI->Builder.CreateFDiv(L, R, "divtmp")
+                      : CI->Builder.CreateSDiv(L, R, "divtmp");
       case MOD:
-        return Builder.CreateSRem(L, R, "modtmp");
+        return CI->Builder.CreateSRem(L, R, "modtmp");
       case LT:
-        return isFloat ? Builder.CreateFCmpULT(L, R, "cmptmp")
-                      : Builder.CreateICmpSLT(L, R, "cmptmp");
+        return isFloat ? CI->Builder.CreateFCmpULT(L, R, "cmptmp")
+                      : CI->Builder.CreateICmpSLT(L, R, "cmptmp");
       case LE:
-        return isFloat ? Builder.CreateFCmpULE(L, R, "cmptmp")
-                       : Builder.CreateICmpSLE(L, R, "cmptmp");
+        return isFloat ? CI->Builder.CreateFCmpULE(L, R, "cmptmp")
+                       : CI->Builder.CreateICmpSLE(L, R, "cmptmp");
       case GT:
-        return isFloat ? Builder.CreateFCmpUGT(L, R, "cmptmp")
-                      : Builder.CreateICmpSGT(L, R, "cmptmp");
+        return isFloat ? CI->Builder.CreateFCmpUGT(L, R, "cmptmp")
+                      : CI->Builder.CreateICmpSGT(L, R, "cmptmp");
       case GE:
-        return isFloat ? Builder.CreateFCmpUGE(L, R, "cmptmp")
-                      : Builder.CreateICmpSGE(L, R, "cmptmp");
+        return isFloat ? CI->Builder.CreateFCmpUGE(L, R, "cmptmp")
+                      : CI->Builder.CreateICmpSGE(L, R, "cmptmp");
       case EQ:
-        return isFloat ? Builder.CreateFCmpUEQ(L, R, "cmptmp")
-                      : Builder.CreateICmpEQ(L, R, "cmptmp");
+        return isFloat ? CI->Builder.CreateFCmpUEQ(L, R, "cmptmp")
+                      : CI->Builder.CreateICmpEQ(L, R, "cmptmp");
       case NE:
-        return isFloat ? Builder.CreateFCmpUNE(L, R, "cmptmp")
-                      : Builder.CreateICmpNE(L, R, "cmptmp");
-      // Convert both to bool first, then apply (full evaluation)
-      case AND: {
-        Value* LBool = Builder.CreateICmpNE(L, ConstantInt::get(L->getType(), 0), "tobool");
-        Value* RBool = Builder.CreateICmpNE(R, ConstantInt::get(R->getType(), 0), "tobool");
-        return Builder.CreateAnd(LBool, RBool, "andtmp");
-      }
-      case OR: {
-        Value* LBool = Builder.CreateICmpNE(L, ConstantInt::get(L->getType(), 0), "tobool");
-        Value* RBool = Builder.CreateICmpNE(R, ConstantInt::get(R->getType(), 0), "tobool");
-        return Builder.CreateOr(LBool, RBool, "ortmp");
-      }
+        return isFloat ? CI->Builder.CreateFCmpUNE(L, R, "cmptmp")
+                      : CI->Builder.CreateICmpNE(L, R, "cmptmp");
       default:
         return LogErrorV("Invalid binary operator");
     }
@@ -1220,100 +2048,64 @@ public:
 };
 
 class AssignExprAST : public ASTnode {
-  std::unique_ptr<ASTnode> LHS;  // Can be Variable OR ArrayAccess
-  std::unique_ptr<ASTnode> RHS;
+  ASTnode* LHS;  // Can be Variable OR ArrayAccess
+  ASTnode* RHS;
 
 public:
-  AssignExprAST(std::unique_ptr<ASTnode> lhs, std::unique_ptr<ASTnode> rhs)
-      :LHS(std::move(lhs)), RHS(std::move(rhs)) {}
+  AssignExprAST(ASTnode* lhs, ASTnode* rhs)
+      :LHS(lhs), RHS(rhs) {}
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // Output Assignment node
-    std::string result = prefix + getConnector(isLast) + "Assignment";
+    printConnector(OS, prefix, isLast) << "Assignment\n";
     // Calculate prefix for children
     std::string newPrefix = extendPrefix(prefix, isLast);
     // LHS (target) is not last, RHS (value) is last
-    result += "\n" + LHS->to_string(newPrefix, false);    // Assignment target
-    result += "\n" + RHS->to_string(newPrefix, true);     // Value being assigned
-    return result;
+    LHS->print(OS, newPrefix, false);    // Assignment target
+    RHS->print(OS, newPrefix, true);     // Value being assigned
   }
 
-  virtual Value* codegen() override {
-    // Generate RHS value
-    Value* Val = RHS->codegen();
-    if (!Val) return nullptr;
-    
-    // Check if LHS is an array access
-    ArrayAccessAST* arrayAccess = dynamic_cast<ArrayAccessAST*>(LHS.get());
-    if (arrayAccess) {
-      Value* elemPtr = arrayAccess->codegenPtr();
-      if (!elemPtr) return nullptr;
-
-      // Get element type for proper type promotion
-      // (need to get array info for type)
-      ArrayInfo* info = nullptr;
-      std::string arrName = arrayAccess->getName();
-      if (LocalArrayInfo.count(arrName)) {
-        info = &LocalArrayInfo[arrName];
-      } else if (GlobalArrayInfo.count(arrName)) {
-        info = &GlobalArrayInfo[arrName];
-      }
-
-      // Promote RHS to match array element type if needed
-      if (info) {
-        Val = promoteType(Val, getLLVMType(info->elementType));
-      }
-
-      // Store value to the array element
-      Builder.CreateStore(Val, elemPtr);
-      return Val;
-    }
+  // The value takes the type of the variable or array element it is stored
+  // to; narrowing is an error
+  virtual TypeKind sema() override {
+    RHS->sema();
+    Ty = LHS->sema();
+    RHS = convertTo(RHS, Ty, "variable assignment");
+    if (auto* Var = dynamic_cast<VariableASTnode*>(LHS); Var && Var->getDecl() && !CI->Loops.empty())
+      CI->Loops.back()->noteAssignment(Var->getDecl(), getStep(Var));
+    return Ty;
+  }
 
-    // Otherwise, its a regular variable assignment
-    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(LHS.get());
-    if (!varNode) {
-      return LogErrorV("Invalid left-hand side in assignment");
-    }
+  // c if this is Var = Var + c for an int literal c, otherwise 0
+  int getStep(VariableASTnode* Var) const {
+    auto* Add = dynamic_cast<ExprAST*>(RHS);
+    if (!Add || Add->getOp() != PLUS)
+      return 0;
+    auto* Same = dynamic_cast<VariableASTnode*>(Add->getLHS());
+    auto* Step = dynamic_cast<IntASTnode*>(Add->getRHS());
+    return Same && Step && Same->getDecl() == Var->getDecl() ? Step->getValue() : 0;
+  }
 
-    std::string varName = varNode->getName();
-    
-    // Look up variable in local scope first
-    AllocaInst* Variable = NamedValues[varName];
-    if (Variable) {
-      // Type check and store locally
-      Val = promoteTypeWithCheck(Val, Variable->getAllocatedType(), "variable assignment");
-      if (!Val) return nullptr;
-      Builder.CreateStore(Val, Variable);
-      return Val;
-    }
-    
-    // Check global scope
-    GlobalVariable* GVar = GlobalNamedValues[varName];
-    if (GVar) {
-      // Type check and store
-      Val = promoteTypeWithCheck(Val, GVar->getValueType(), "variable assignment");
-      if (!Val) return nullptr;
-      Builder.CreateStore(Val, GVar);
-      return Val;
-    }
-    // Variable not found
-    return LogErrorV(("Unknown variable in assignment: " + varName).c_str());
+  virtual Value* codegen() override {
+    // Generate RHS value, then store it to the variable or array element
+    Value* Val = RHS->codegen();
+    LHS->codegenStore(Val);
+    return Val;
   }
 };
 
 /// BlockAST - Class for a block with declarations followed by statements
 class BlockAST : public ASTnode {
-  std::vector<std::unique_ptr<DeclAST>> LocalDecls;    // vector of local decls
-  std::vector<std::unique_ptr<ASTnode>> Stmts;         // vector of statements
+  ArrayRef<DeclAST*> LocalDecls;    // local decls
+  ArrayRef<ASTnode*> Stmts;         // statements
 
 public:
-  BlockAST(std::vector<std::unique_ptr<DeclAST>> localDecls,
-           std::vector<std::unique_ptr<ASTnode>> stmts)
-      : LocalDecls(std::move(localDecls)), Stmts(std::move(stmts)) {}
+  BlockAST(ArrayRef<DeclAST*> localDecls, ArrayRef<ASTnode*> stmts)
+      : LocalDecls(localDecls), Stmts(stmts) {}
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // Block node label
-    std::string result = prefix + getConnector(isLast) + "Block:";
+    printConnector(OS, prefix, isLast) << "Block:\n";
     // Calculate the prefix for child nodes
     std::string newPrefix = extendPrefix(prefix, isLast);
 
@@ -1325,65 +2117,60 @@ public:
       // LocalDecls is the last child only if there are no statements
       bool localDeclsLast = !hasStmts;
       // Add "LocalDecls:" header with appropriate connector
-      result += "\n" + newPrefix + getConnector(localDeclsLast) + "LocalDecls:";
+      printConnector(OS, newPrefix, localDeclsLast) << "LocalDecls:\n";
       // Extend prefix for declaration children
       std::string declPrefix = extendPrefix(newPrefix, localDeclsLast);
       // Print each local declaration
       for (size_t i = 0; i < LocalDecls.size(); i++) {
         bool lastDecl = (i == LocalDecls.size() - 1);
-        result += "\n" + LocalDecls[i]->to_string(declPrefix, lastDecl);
+        LocalDecls[i]->print(OS, declPrefix, lastDecl);
       }
     }
     if (hasStmts) {
       // Statements is always the last section in a block
-      result += "\n" + newPrefix + getConnector(true) + "Statements:";
+      printConnector(OS, newPrefix, true) << "Statements:\n";
       // Extend prefix for statement children
       std::string stmtPrefix = extendPrefix(newPrefix, true);
       // Print each statement
       for (size_t i = 0; i < Stmts.size(); i++) {
         if (Stmts[i]) {
           bool lastStmt = (i == Stmts.size() - 1);
-          result += "\n" + Stmts[i]->to_string(stmtPrefix, lastStmt);
+          Stmts[i]->print(OS, stmtPrefix, lastStmt);
         }
       }
     }
-    return result;
+  }
+
+  virtual TypeKind sema() override {
+    // Local declarations shadow outer bindings until the block ends
+    CI->Symbols.pushScope();
+    for (DeclAST* Decl : LocalDecls) {
+      Decl->sema();
+    }
+    for (ASTnode* Stmt : Stmts) {
+      if (Stmt)
+        Stmt->sema();
+    }
+    CI->Symbols.popScope();
+    return Ty = TY_VOID;
   }
 
   virtual Value* codegen() override {
-    // Save current scope (for nested blocks)
-    std::map<std::string, AllocaInst*> OldBindings;
-    
     // Generate code for local declarations
-    for (auto& Decl : LocalDecls) {
-      // Save old binding if variable shadows outer scope
-      if (NamedValues.count(Decl->getName())) {
-        OldBindings[Decl->getName()] = NamedValues[Decl->getName()];
-      }
+    for (DeclAST* Decl : LocalDecls) {
       Decl->codegen();
     }
     
     // Generate code for statements
     Value* LastVal = nullptr;
-    for (auto& Stmt : Stmts) {
+    for (ASTnode* Stmt : Stmts) {
       if (Stmt) {
         LastVal = Stmt->codegen();
         // Stop if we hit a terminator (return statement)
-        if (Builder.GetInsertBlock()->getTerminator())
+        if (CI->Builder.GetInsertBlock()->getTerminator())
           break;
         }
     }
-
-    // Restore outer scope bindings
-    for (auto& Binding : OldBindings) {
-      NamedValues[Binding.first] = Binding.second;
-    }
-    // Remove local variables that weren't shadowing outer scope
-    for (auto& Decl : LocalDecls) {
-      if (!OldBindings.count(Decl->getName())) {
-        NamedValues.erase(Decl->getName());
-      }
-    }
     
     return LastVal;
   }
@@ -1391,89 +2178,96 @@ public:
 
 /// FunctionDeclAST - This class represents a function definition itself.
 class FunctionDeclAST : public DeclAST {
-  std::unique_ptr<FunctionPrototypeAST> Proto;
-  std::unique_ptr<ASTnode> Block;
+  FunctionPrototypeAST* Proto;
+  ASTnode* Block;
+  FunctionPrototypeAST* FirstDecl = nullptr; // an earlier extern, or Proto itself
+  std::string_view Source;                   // the whole definition, for the function cache
 
 public:
-  FunctionDeclAST(std::unique_ptr<FunctionPrototypeAST> Proto,
-                  std::unique_ptr<ASTnode> Block)
-      : Proto(std::move(Proto)), Block(std::move(Block)) {}
+  FunctionDeclAST(FunctionPrototypeAST* Proto, ASTnode* Block, std::string_view Source)
+      : Proto(Proto), Block(Block), Source(Source) {}
 
-  const std::string& getName() const override { return Proto->getName();}
+  Symbol getName() const override { return Proto->getName();}
+  std::string_view getSource() const { return Source; }
   
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // FunctionDecl node label
-    std::string result = prefix + getConnector(isLast) + "FunctionDecl";
+    printConnector(OS, prefix, isLast) << "FunctionDecl\n";
     // Calculate prefix for child nodes
     std::string newPrefix = extendPrefix(prefix, isLast);
     // Print prototype (not last child)
-    result += "\n" + Proto->to_string(newPrefix, false);
+    Proto->print(OS, newPrefix, false);
     // Print function body block (last child)
-    result += "\n" + Block->to_string(newPrefix, true);
-    return result;
+    Block->print(OS, newPrefix, true);
   }
 
-  virtual Value* codegen() override {
+  virtual TypeKind sema() override {
+    TimeTraceScope Trace("Sema Function", [&] { return symbolName(Proto->getName()).str(); });
+
     // Check for existing function from extern declaration
-    Function* TheFunction = TheModule->getFunction(Proto->getName());
-    
-    if (!TheFunction) {
-      TheFunction = Proto->codegen();
+    Proto->sema();
+    FirstDecl = CI->Prototypes.lookup(Proto->getName());
+
+    // If function already has a body, it's being redefined - error. Either
+    // way the body is still checked.
+    if (FirstDecl->hasBody())
+      LogErrorT(Proto->getLoc(), "Function cannot be redefined");
+    else if (!FirstDecl->matches(*Proto))
+      LogErrorT(Proto->getLoc(), ("Function definition does not match its declaration: " +
+                                  symbolName(Proto->getName())).str());
+    FirstDecl->setHasBody();
+
+    // Parameters get their own scope
+    CI->Symbols.pushScope();
+    CI->CurrentReturnType = Proto->getType();
+    for (ParamAST* Param : Proto->getParams()) {
+      CI->Symbols.declare(Param->getName(), Param->getEntry());
     }
-    
-    if (!TheFunction) return nullptr;
+    Block->sema();
+    CI->Symbols.popScope();
+    return Ty = TY_VOID;
+  }
 
-    // If function already has a body, it's being redefined - error
-    if (!TheFunction->empty()) {
-      return LogErrorV("Function cannot be redefined");
-    }
+  virtual Value* codegen() override {
+    TimeTraceScope Trace("CodeGen Function", [&] { return symbolName(Proto->getName()).str(); });
+
+    // A definition after an extern shares its Function
+    Function* TheFunction = FirstDecl == Proto ? Proto->codegen() : FirstDecl->getFunction();
     
     // Create entry basic block and set it as the insertion point for subsequent IR instructions
-    BasicBlock* BB = BasicBlock::Create(TheContext, "entry", TheFunction);
-    Builder.SetInsertPoint(BB);
-    
-    // Clear local variables and set current function
-    NamedValues.clear();
-    LocalArrayInfo.clear();
-    ParamArrayInfo.clear();
-    CurrentFunction = TheFunction;
-
-    // Create stack allocas for each parameter and store function arguments
-    auto& Params = Proto->getParams();
+    BasicBlock* BB = BasicBlock::Create(CI->TheContext, "entry", TheFunction);
+    CI->Builder.SetInsertPoint(BB);
+    CI->SSA.startFunction();
+    CI->BoundsTrapBB = nullptr;
+    CI->FunctionHintedLoops = 0;
+    CI->SSA.sealBlock(BB);
+
+    // Scalar parameters start out as the incoming arguments. Array
+    // parameters cannot be reassigned, so their accesses index the argument.
+    ArrayRef<ParamAST*> Params = Proto->getParams();
     unsigned Idx = 0;
     for (auto& Arg : TheFunction->args()) {
-      // Create alloca in entry block for this parameter
-      AllocaInst* Alloca = CreateEntryBlockAlloca(TheFunction, std::string(Arg.getName()),
-                                                   Arg.getType());
-      // Store incoming argument value into the alloca                                            
-      Builder.CreateStore(&Arg, Alloca);
-      // Register in symbol table for lookup during body codegen
-      NamedValues[std::string(Arg.getName())] = Alloca;
-      // Track array parameters
-      if (Params[Idx]->isArray()) {
-        ArrayInfo info;
-        info.elementType = Params[Idx]->getType();
-        info.dimensions = Params[Idx]->getDims();
-        ParamArrayInfo[std::string(Arg.getName())] = info;
+      SymbolEntry* Entry = Params[Idx]->getEntry();
+      StringRef Name = symbolName(Params[Idx]->getName());
+      Entry->StoredType = Arg.getType();
+      if (Entry->isArray()) {
+        Entry->Storage = &Arg;
+      } else {
+        CI->SSA.declareVariable(Entry, Name, BB, &Arg);
       }
       Idx++;
     }
     
     // Generate function body
-    Value* BodyVal = Block->codegen();
-    if (!BodyVal) {
-      // Error in function body - remove the function
-      TheFunction->eraseFromParent();
-      return nullptr; // Propagate error
-    }
+    Block->codegen();
     
     // Add implicit return if function body doesn't end with return
-    if (!Builder.GetInsertBlock()->getTerminator()) {
+    if (!CI->Builder.GetInsertBlock()->getTerminator()) {
       if (TheFunction->getReturnType()->isVoidTy()) {
-        Builder.CreateRetVoid();
+        CI->Builder.CreateRetVoid();
       } else {
         // Return default value (0 or 0.0)
-        Builder.CreateRet(Constant::getNullValue(TheFunction->getReturnType()));
+        CI->Builder.CreateRet(Constant::getNullValue(TheFunction->getReturnType()));
       }
     }
 
@@ -1486,16 +2280,15 @@ public:
 
 /// IfExprAST - Expression class for if/then/else.
 class IfExprAST : public ASTnode {
-  std::unique_ptr<ASTnode> Cond, Then, Else;
+  ASTnode *Cond, *Then, *Else;
 
 public:
-  IfExprAST(std::unique_ptr<ASTnode> Cond, std::unique_ptr<ASTnode> Then,
-            std::unique_ptr<ASTnode> Else)
-      : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
+  IfExprAST(ASTnode* Cond, ASTnode* Then, ASTnode* Else)
+      : Cond(Cond), Then(Then), Else(Else) {}
   
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // If node label
-    std::string result = prefix + getConnector(isLast) + "If:";
+    printConnector(OS, prefix, isLast) << "If:\n";
     // Calculate prefic for child nodes
     std::string newPrefix = extendPrefix(prefix, isLast);
 
@@ -1503,359 +2296,771 @@ public:
     bool hasElse = (Else != nullptr);
     
     // Condition is never last child (always followed by Then)
-    result += "\n" + newPrefix + getConnector(false) + "Condition:";
-    std::string condPrefix = extendPrefix(newPrefix, false);
-    result += "\n" + Cond->to_string(condPrefix, true);
+    printConnector(OS, newPrefix, false) << "Condition:\n";
+    Cond->print(OS, extendPrefix(newPrefix, false), true);
 
     // Then is last child only if there is no Else
-    result += "\n" + newPrefix + getConnector(!hasElse) + "Then:";
-    std::string thenPrefix = extendPrefix(newPrefix, !hasElse);
-    result += "\n" + Then->to_string(thenPrefix, true);
+    printConnector(OS, newPrefix, !hasElse) << "Then:\n";
+    Then->print(OS, extendPrefix(newPrefix, !hasElse), true);
 
     if (hasElse) {
       // Else is always last child when present
-      result += "\n" + newPrefix + getConnector(true) + "Else:";
-      std::string elsePrefix = extendPrefix(newPrefix, true);
-      result += "\n" + Else->to_string(elsePrefix, true);
+      printConnector(OS, newPrefix, true) << "Else:\n";
+      Else->print(OS, extendPrefix(newPrefix, true), true);
     }
-    return result;
+  }
+
+  virtual TypeKind sema() override {
+    Cond->sema();
+    Cond = convertTo(Cond, TY_BOOL);
+    Then->sema();
+    if (Else)
+      Else->sema();
+    return Ty = TY_VOID;
   }
 
   virtual Value* codegen() override {
+    // Sema has already converted the condition to bool
     Value* CondV = Cond->codegen();
-    if (!CondV) return nullptr;
-    
-    // Convert condition to bool if needed
-    if (!CondV->getType()->isIntegerTy(1)) {
-      CondV = Builder.CreateICmpNE(CondV, 
-          ConstantInt::get(CondV->getType(), 0), "ifcond");
-    }
     
     // Create basic blocks for then, else, and merge paths
-    Function* TheFunction = Builder.GetInsertBlock()->getParent();
+    Function* TheFunction = CI->Builder.GetInsertBlock()->getParent();
     
-    BasicBlock* ThenBB = BasicBlock::Create(TheContext, "then", TheFunction);
-    BasicBlock* ElseBB = BasicBlock::Create(TheContext, "else");
-    BasicBlock* MergeBB = BasicBlock::Create(TheContext, "ifcont");
+    BasicBlock* ThenBB = BasicBlock::Create(CI->TheContext, "then", TheFunction);
+    BasicBlock* ElseBB = BasicBlock::Create(CI->TheContext, "else");
+    BasicBlock* MergeBB = BasicBlock::Create(CI->TheContext, "ifcont");
     
     // Branch to 'then' if condition is true, else to 'else' block (or merge if no else)
     if (Else) {
-      Builder.CreateCondBr(CondV, ThenBB, ElseBB);
+      CI->Builder.CreateCondBr(CondV, ThenBB, ElseBB);
     } else {
-      Builder.CreateCondBr(CondV, ThenBB, MergeBB);
+      CI->Builder.CreateCondBr(CondV, ThenBB, MergeBB);
     }
 
+    // Then and else are only reached from here
+    CI->SSA.sealBlock(ThenBB);
+    if (Else)
+      CI->SSA.sealBlock(ElseBB);
+
     // Emit code for then block
-    Builder.SetInsertPoint(ThenBB);
+    CI->Builder.SetInsertPoint(ThenBB);
     Then->codegen();
-    if (!Builder.GetInsertBlock()->getTerminator())
-        Builder.CreateBr(MergeBB);
+    if (!CI->Builder.GetInsertBlock()->getTerminator())
+        CI->Builder.CreateBr(MergeBB);
     
     // Emit code for else block if it exists
     if (Else) {
       TheFunction->insert(TheFunction->end(), ElseBB);
-      Builder.SetInsertPoint(ElseBB);
+      CI->Builder.SetInsertPoint(ElseBB);
       Else->codegen();
-      if (!Builder.GetInsertBlock()->getTerminator())
-        Builder.CreateBr(MergeBB);
+      if (!CI->Builder.GetInsertBlock()->getTerminator())
+        CI->Builder.CreateBr(MergeBB);
     }
     
     // Both branches converge
     TheFunction->insert(TheFunction->end(), MergeBB);
-    Builder.SetInsertPoint(MergeBB);
+    CI->SSA.sealBlock(MergeBB);
+    CI->Builder.SetInsertPoint(MergeBB);
     
     // Return dummy value (if statements don't produce values in MiniC)
-    return Constant::getNullValue(Type::getInt32Ty(TheContext));
+    return Constant::getNullValue(Type::getInt32Ty(CI->TheContext));
   }
 };
 
 /// WhileExprAST - Expression class for while.
 class WhileExprAST : public ASTnode {
-  std::unique_ptr<ASTnode> Cond, Body;
+protected:
+  ASTnode *Cond, *Body;
+
+  // -fbounds-check, found by sema in loops with no nested loop: the
+  // variables that index arrays in the loop and are either not assigned in
+  // it or are its induction variable, each with the smallest dimension it
+  // indexes
+  MutableArrayRef<std::pair<VariableASTnode*, int>> Hoistable;
+  VariableASTnode* IndVar = nullptr; // i in while (i < Limit), assigned only by i = i + Step
+  ASTnode* Limit = nullptr;          // a literal or a variable not assigned in the loop
+  SymbolEntry* LimitDecl = nullptr;  // the variable Limit names, null for a literal
+  bool Inclusive = false;            // i <= Limit
+  int Step = 0;
+  bool HasCalls = false;
+
+  LoopHints Hints;
+  int HintIndex = -1; // -Rloop-hints: this loop's number among its function's hinted loops
 
 public:
-  WhileExprAST(std::unique_ptr<ASTnode> cond, std::unique_ptr<ASTnode> body)
-      : Cond(std::move(cond)), Body(std::move(body)) {}
+  WhileExprAST(ASTnode* cond, ASTnode* body, LoopHints hints = LoopHints())
+      : Cond(cond), Body(body), Hints(hints) {}
   
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // WhileStmt node label
-    std::string result = prefix + getConnector(isLast) + "WhileStmt";
+    printConnector(OS, prefix, isLast) << "WhileStmt\n";
     std::string newPrefix = extendPrefix(prefix, isLast);
+    printHints(OS, newPrefix);
 
     // Condition is not the last child (Body should follow)
-    result += "\n" + newPrefix + getConnector(false) + "Condition:";
-    std::string condPrefix = extendPrefix(newPrefix, false);
-    result += "\n" + Cond->to_string(condPrefix, true);
+    printConnector(OS, newPrefix, false) << "Condition:\n";
+    Cond->print(OS, extendPrefix(newPrefix, false), true);
 
     // Body is the last child
-    result += "\n" + newPrefix + getConnector(true) + "Body:";
-    std::string bodyPrefix = extendPrefix(newPrefix, true);
-    result += "\n" + Body->to_string(bodyPrefix, true);
+    printConnector(OS, newPrefix, true) << "Body:\n";
+    Body->print(OS, extendPrefix(newPrefix, true), true);
+  }
 
-    return result;
+  void printHints(raw_ostream& OS, const std::string& prefix) const {
+    if (Hints.Unroll != LoopHints::NONE)
+      printConnector(OS, prefix, false) << "Pragma: " << getLoopHintSpelling(Hints, true) << "\n";
+    if (Hints.Vectorize != LoopHints::NONE)
+      printConnector(OS, prefix, false) << "Pragma: " << getLoopHintSpelling(Hints, false) << "\n";
   }
 
-  virtual Value* codegen() override {
-    Function* TheFunction = Builder.GetInsertBlock()->getParent();
+  virtual TypeKind sema() override {
+    LoopSummary Summary;
+    if (CI->BoundsCheck) {
+      if (!CI->Loops.empty())
+        CI->Loops.back()->HasLoops = true;
+      CI->Loops.push_back(&Summary);
+    }
+    Cond->sema();
+    Cond = convertTo(Cond, TY_BOOL);
+    semaBody();
+    if (CI->BoundsCheck) {
+      CI->Loops.pop_back();
+      if (!Summary.HasLoops)
+        findHoistableIndices(Summary);
+    }
+    return Ty = TY_VOID;
+  }
+
+  // What runs on every iteration after the condition
+  virtual void semaBody() { Body->sema(); }
+
+  void findHoistableIndices(const LoopSummary& S) {
+    // The induction variable counts up from its value on entry, staying
+    // below the limit while the body runs
+    if (auto* Cmp = dynamic_cast<ExprAST*>(Cond)) {
+      int Op = Cmp->getOp();
+      ASTnode *L = Cmp->getLHS(), *R = Cmp->getRHS();
+      if (Op == GT || Op == GE)
+        std::swap(L, R);
+      auto* Var = dynamic_cast<VariableASTnode*>(L);
+      auto* LimitVar = dynamic_cast<VariableASTnode*>(R);
+      bool LimitInvariant = dynamic_cast<IntASTnode*>(R) ||
+                            (LimitVar && !S.Assignments.count(LimitVar->getDecl()));
+      bool IsBound = Op == LT || Op == LE || Op == GT || Op == GE;
+      if (IsBound && Var && Var->getType() == TY_INT && LimitInvariant &&
+          S.Assignments.lookup(Var->getDecl()) == 1 && S.Steps.count(Var->getDecl())) {
+        IndVar = Var;
+        Limit = R;
+        LimitDecl = LimitVar ? LimitVar->getDecl() : nullptr;
+        Inclusive = Op == LE || Op == GE;
+        Step = S.Steps.lookup(Var->getDecl());
+      }
+    }
+
+    std::vector<std::pair<VariableASTnode*, int>> Found;
+    for (auto [Var, Dim] : S.Indices) {
+      SymbolEntry* Decl = Var->getDecl();
+      bool IsIndVar = IndVar && Decl == IndVar->getDecl();
+      if (!IsIndVar && S.Assignments.count(Decl))
+        continue;
+      // i + Step must not wrap while i is below Dim
+      if (IsIndVar && int64_t(Dim) + Step > INT32_MAX)
+        continue;
+      auto It = find_if(Found, [&](auto& F) { return F.first->getDecl() == Decl; });
+      if (It == Found.end())
+        Found.push_back({Var, Dim});
+      else
+        It->second = std::min(It->second, Dim);
+    }
+    Hoistable = copyToArena(Found);
+    HasCalls = S.HasCalls;
+  }
+
+  // Emit, before the loop, the condition under which every hoistable index
+  // stays in range throughout it, adding the variables it covers to Facts.
+  // Returns null if it covers none.
+  Value* codegenRangeCondition(SmallVectorImpl<std::pair<SymbolEntry*, int>>& Facts) {
+    IRBuilder<>& B = CI->Builder;
+    Value* InRange = B.getTrue();
+    for (auto [Var, Bound] : Hoistable) {
+      SymbolEntry* Decl = Var->getDecl();
+      bool Global = Decl->Storage != nullptr;
+      Value* Max = ConstantInt::get(Type::getInt32Ty(CI->TheContext), Bound);
+      Value* Cond;
+      if (IndVar && Decl == IndVar->getDecl()) {
+        // Calls may assign globals
+        if (Global || (HasCalls && LimitDecl && LimitDecl->Storage))
+          continue;
+        Value* Start = B.CreateICmpSGE(Var->codegen(), ConstantInt::get(Max->getType(), 0));
+        Value* End = Limit->codegen();
+        Cond = createAnd(Start, Inclusive ? B.CreateICmpSLT(End, Max) : B.CreateICmpSLE(End, Max));
+      } else {
+        // Not assigned in the loop, so what holds before it holds throughout
+        if (Global && HasCalls)
+          continue;
+        Cond = B.CreateICmpULT(Var->codegen(), Max);
+      }
+
+      auto* C = dyn_cast<ConstantInt>(Cond);
+      if (C && C->isZero())
+        continue;
+      Facts.push_back({Decl, Bound});
+      InRange = createAnd(InRange, Cond);
+    }
+    if (Facts.empty())
+      return nullptr;
+    if (!isa<Constant>(InRange))
+      InRange->setName("inrange");
+    return InRange;
+  }
+
+  // A && B, folding conditions known at compile time
+  static Value* createAnd(Value* A, Value* B) {
+    if (auto* C = dyn_cast<ConstantInt>(A))
+      return C->isZero() ? A : B;
+    if (auto* C = dyn_cast<ConstantInt>(B))
+      return C->isZero() ? B : A;
+    return CI->Builder.CreateAnd(A, B);
+  }
+
+  // Emit the loop, ending at AfterLoopBB, with the indices in Facts known to
+  // be in range
+  virtual void codegenLoop(BasicBlock* AfterLoopBB,
+                           ArrayRef<std::pair<SymbolEntry*, int>> Facts) {
+    Function* TheFunction = CI->Builder.GetInsertBlock()->getParent();
     
-    // Create three basic blocks
+    // Create two basic blocks
     // loopcond: evaluates loop condition
     // loopbody: executes the loop body
-    // afterloop: continues after loop exits
-    BasicBlock* LoopCondBB = BasicBlock::Create(TheContext, "loopcond", TheFunction);
-    BasicBlock* LoopBodyBB = BasicBlock::Create(TheContext, "loopbody");
-    BasicBlock* AfterLoopBB = BasicBlock::Create(TheContext, "afterloop");
+    BasicBlock* LoopCondBB = BasicBlock::Create(CI->TheContext, "loopcond", TheFunction);
+    BasicBlock* LoopBodyBB = BasicBlock::Create(CI->TheContext, "loopbody");
     
     // Branch to loop condition
-    Builder.CreateBr(LoopCondBB);
+    CI->Builder.CreateBr(LoopCondBB);
+
+    // Variables not assigned in the loop are in range in the condition too,
+    // the induction variable only once it has been checked
+    SymbolEntry* Induction = IndVar ? IndVar->getDecl() : nullptr;
+    for (auto [Var, Bound] : Facts)
+      if (Var != Induction)
+        CI->InBounds[Var] = Bound;
     
     // Emit code to evaluate the loop condition
-    Builder.SetInsertPoint(LoopCondBB);
+    CI->Builder.SetInsertPoint(LoopCondBB);
     Value* CondV = Cond->codegen();
-    if (!CondV) return nullptr;
-    
-    // Convert to bool if needed
-    if (!CondV->getType()->isIntegerTy(1)) {
-      CondV = Builder.CreateICmpNE(CondV, 
-        ConstantInt::get(CondV->getType(), 0), "loopcond");
-    }
 
     // Branch: if condition true -> loop body, else -> after loop
-    Builder.CreateCondBr(CondV, LoopBodyBB, AfterLoopBB);
+    CI->Builder.CreateCondBr(CondV, LoopBodyBB, AfterLoopBB);
+    CI->SSA.sealBlock(LoopBodyBB);
+    for (auto [Var, Bound] : Facts)
+      if (Var == Induction)
+        CI->InBounds[Var] = Bound;
     
-    // Emit code for loop body
+    // Emit code for loop body. The condition block stays unsealed until the
+    // back edge exists, so variables read there get PHIs on demand.
     TheFunction->insert(TheFunction->end(), LoopBodyBB);
-    Builder.SetInsertPoint(LoopBodyBB);
+    CI->Builder.SetInsertPoint(LoopBodyBB);
     Body->codegen();
-    Builder.CreateBr(LoopCondBB);
+    if (!CI->Builder.GetInsertBlock()->getTerminator()) {
+      BranchInst* Latch = CI->Builder.CreateBr(LoopCondBB);
+      if (!Hints.empty())
+        Latch->setMetadata(LLVMContext::MD_loop, createLoopID());
+    }
+    CI->SSA.sealBlock(LoopCondBB);
+    // Only loops without nested loops have facts
+    CI->InBounds.clear();
+  }
+
+  // The llvm.loop metadata for one copy of the loop. Loop IDs are distinct
+  // and refer to themselves, so every copy gets its own.
+  MDNode* createLoopID() {
+    LLVMContext& Ctx = CI->TheContext;
+    IRBuilder<>& B = CI->Builder;
+    auto attr = [&](StringRef Name, Constant* Val = nullptr) {
+      SmallVector<Metadata*, 2> Ops = {MDString::get(Ctx, Name)};
+      if (Val)
+        Ops.push_back(ConstantAsMetadata::get(Val));
+      return MDNode::get(Ctx, Ops);
+    };
+
+    SmallVector<Metadata*, 4> Ops = {nullptr}; // the self reference, set below
+    if (Hints.Unroll == LoopHints::DISABLE)
+      Ops.push_back(attr("llvm.loop.unroll.disable"));
+    else if (Hints.Unroll == LoopHints::ENABLE && Hints.UnrollCount)
+      Ops.push_back(attr("llvm.loop.unroll.count", B.getInt32(Hints.UnrollCount)));
+    else if (Hints.Unroll == LoopHints::ENABLE)
+      Ops.push_back(attr("llvm.loop.unroll.enable"));
+    if (Hints.Vectorize != LoopHints::NONE)
+      Ops.push_back(attr("llvm.loop.vectorize.enable",
+                         B.getInt1(Hints.Vectorize == LoopHints::ENABLE)));
+    if (Hints.VectorizeWidth)
+      Ops.push_back(attr("llvm.loop.vectorize.width", B.getInt32(Hints.VectorizeWidth)));
+    // Unknown attributes survive the loop passes, so the copies of this loop
+    // can be told apart from the others after optimisation
+    if (HintIndex >= 0)
+      Ops.push_back(attr("minic.loop.hint", B.getInt32(HintIndex)));
+
+    MDNode* ID = MDNode::getDistinct(Ctx, Ops);
+    ID->replaceOperandWith(0, ID);
+    return ID;
+  }
+
+  virtual Value* codegen() override {
+    Function* TheFunction = CI->Builder.GetInsertBlock()->getParent();
+    // afterloop: continues after loop exits
+    BasicBlock* AfterLoopBB = BasicBlock::Create(CI->TheContext, "afterloop");
+
+    if (!Hints.empty() && CI->RemarkLoopHints) {
+      HintIndex = CI->FunctionHintedLoops++;
+      CI->HintedLoops.push_back({TheFunction->getName().str(), unsigned(HintIndex), Hints});
+    }
+
+    // -fbounds-check: where the indices can be proved in range up front,
+    // the loop is emitted twice, without their checks for when the proof
+    // holds and with them for when it does not
+    SmallVector<std::pair<SymbolEntry*, int>, 4> Facts;
+    Value* InRange = CI->BoundsCheck ? codegenRangeCondition(Facts) : nullptr;
+    if (!InRange) {
+      codegenLoop(AfterLoopBB, {});
+    } else if (isa<ConstantInt>(InRange)) {
+      codegenLoop(AfterLoopBB, Facts);
+    } else {
+      BasicBlock* FastBB = BasicBlock::Create(CI->TheContext, "inrange", TheFunction);
+      BasicBlock* CheckedBB = BasicBlock::Create(CI->TheContext, "checked");
+      CI->Builder.CreateCondBr(InRange, FastBB, CheckedBB);
+      CI->SSA.sealBlock(FastBB);
+      CI->SSA.sealBlock(CheckedBB);
+      CI->LoopsVersioned += CI->CountBoundsChecks;
+
+      CI->Builder.SetInsertPoint(FastBB);
+      codegenLoop(AfterLoopBB, Facts);
+
+      // Checks in the copy for out-of-range indices are not counted again
+      TheFunction->insert(TheFunction->end(), CheckedBB);
+      CI->Builder.SetInsertPoint(CheckedBB);
+      bool Count = CI->CountBoundsChecks;
+      CI->CountBoundsChecks = false;
+      codegenLoop(AfterLoopBB, {});
+      CI->CountBoundsChecks = Count;
+    }
     
     // Continue execution after loop exits
     TheFunction->insert(TheFunction->end(), AfterLoopBB);
-    Builder.SetInsertPoint(AfterLoopBB);
+    CI->SSA.sealBlock(AfterLoopBB);
+    CI->Builder.SetInsertPoint(AfterLoopBB);
     
-    return Constant::getNullValue(Type::getInt32Ty(TheContext));
+    return Constant::getNullValue(Type::getInt32Ty(CI->TheContext));
+  }
+};
+
+/// ForExprAST - Expression class for for. It is a while loop with an
+/// initialiser and an increment, sharing the while loop's analyses, hints
+/// and -fbounds-check versioning, but it is emitted already rotated: a guard
+/// tests the condition once before a preheader, and the body ends in the
+/// loop's single latch, which increments and tests again. The optimiser
+/// finds the loop in the canonical form it would otherwise have to make,
+/// ready for SCEV to work out the trip count.
+class ForExprAST : public WhileExprAST {
+  ASTnode *Init, *Inc; // null when left out; a left out condition is true
+
+public:
+  ForExprAST(ASTnode* init, ASTnode* cond, ASTnode* inc, ASTnode* body, LoopHints hints)
+      : WhileExprAST(cond, body, hints), Init(init), Inc(inc) {}
+
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
+    printConnector(OS, prefix, isLast) << "ForStmt\n";
+    std::string newPrefix = extendPrefix(prefix, isLast);
+    printHints(OS, newPrefix);
+
+    if (Init) {
+      printConnector(OS, newPrefix, false) << "Init:\n";
+      Init->print(OS, extendPrefix(newPrefix, false), true);
+    }
+    printConnector(OS, newPrefix, false) << "Condition:\n";
+    Cond->print(OS, extendPrefix(newPrefix, false), true);
+    if (Inc) {
+      printConnector(OS, newPrefix, false) << "Increment:\n";
+      Inc->print(OS, extendPrefix(newPrefix, false), true);
+    }
+    printConnector(OS, newPrefix, true) << "Body:\n";
+    Body->print(OS, extendPrefix(newPrefix, true), true);
+  }
+
+  // The initialiser runs once, before the loop
+  virtual TypeKind sema() override {
+    if (Init)
+      Init->sema();
+    return WhileExprAST::sema();
+  }
+
+  virtual void semaBody() override {
+    Body->sema();
+    if (Inc)
+      Inc->sema();
+  }
+
+  virtual void codegenLoop(BasicBlock* AfterLoopBB,
+                           ArrayRef<std::pair<SymbolEntry*, int>> Facts) override {
+    IRBuilder<>& B = CI->Builder;
+    Function* TheFunction = B.GetInsertBlock()->getParent();
+
+    // forpreheader: entered once the guard has found the loop runs at all
+    // forbody: the body, whose last block is the latch
+    BasicBlock* PreheaderBB = BasicBlock::Create(CI->TheContext, "forpreheader", TheFunction);
+    BasicBlock* BodyBB = BasicBlock::Create(CI->TheContext, "forbody");
+
+    SymbolEntry* Induction = IndVar ? IndVar->getDecl() : nullptr;
+    for (auto [Var, Bound] : Facts)
+      if (Var != Induction)
+        CI->InBounds[Var] = Bound;
+
+    // The guard: skip the loop if the condition fails on entry
+    B.CreateCondBr(Cond->codegen(), PreheaderBB, AfterLoopBB);
+    CI->SSA.sealBlock(PreheaderBB);
+    B.SetInsertPoint(PreheaderBB);
+    B.CreateBr(BodyBB);
+    // Each way into the body has just tested the condition
+    for (auto [Var, Bound] : Facts)
+      if (Var == Induction)
+        CI->InBounds[Var] = Bound;
+
+    // The body stays unsealed until the latch exists, so variables read in
+    // it get PHIs on demand. The increment assigns the induction variable,
+    // which drops its fact before the latch tests the condition again.
+    TheFunction->insert(TheFunction->end(), BodyBB);
+    B.SetInsertPoint(BodyBB);
+    Body->codegen();
+    if (!B.GetInsertBlock()->getTerminator()) {
+      if (Inc)
+        Inc->codegen();
+      // forexit: the dedicated exit, reached only from the latch
+      BasicBlock* ExitBB = BasicBlock::Create(CI->TheContext, "forexit");
+      BranchInst* Latch = B.CreateCondBr(Cond->codegen(), BodyBB, ExitBB);
+      if (!Hints.empty())
+        Latch->setMetadata(LLVMContext::MD_loop, createLoopID());
+      TheFunction->insert(TheFunction->end(), ExitBB);
+      CI->SSA.sealBlock(ExitBB);
+      B.SetInsertPoint(ExitBB);
+      B.CreateBr(AfterLoopBB);
+    }
+    CI->SSA.sealBlock(BodyBB);
+    CI->InBounds.clear();
+  }
+
+  virtual Value* codegen() override {
+    if (Init)
+      Init->codegen();
+    return WhileExprAST::codegen();
   }
 };
 
 /// ReturnAST - Class for a return value
 class ReturnAST : public ASTnode {
-  std::unique_ptr<ASTnode> Val;
+  ASTnode* Val;
 
 public:
-  ReturnAST(std::unique_ptr<ASTnode> value) : Val(std::move(value)) {}
+  ReturnAST(TOKEN returnTok, ASTnode* value) : ASTnode(locOf(returnTok)), Val(value) {}
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     if (Val) {
       // Output return statement with its return value as child
-      std::string result = prefix + getConnector(isLast) + "ReturnStmt:";
-      std::string newPrefix = extendPrefix(prefix, isLast);
-      result += "\n" + Val->to_string(newPrefix, true);     // Return value expression
-      return result;
+      printConnector(OS, prefix, isLast) << "ReturnStmt:\n";
+      Val->print(OS, extendPrefix(prefix, isLast), true);     // Return value expression
     } else {
       // No return value - output as leaf node
-      return prefix + getConnector(isLast) + "ReturnStmt(void)";
+      printConnector(OS, prefix, isLast) << "ReturnStmt(void)\n";
     }
   }
 
+  // Type check return value against function return type
+  virtual TypeKind sema() override {
+    if (Val) {
+      Val->sema();
+      if (CI->CurrentReturnType == TY_VOID)
+        return LogErrorT(Loc, "Void function cannot return a value");
+      Val = convertTo(Val, CI->CurrentReturnType, "return statement");
+    } else if (CI->CurrentReturnType != TY_VOID) {
+      return LogErrorT(Loc, "Non-void function must return a value");
+    }
+    return Ty = TY_VOID;
+  }
+
   virtual Value* codegen() override {
     if (Val) {
-      Value* RetVal = Val->codegen();
-      if (!RetVal) return nullptr;
-      
-      // Type check return value against function return type
-      Type* FuncRetType = CurrentFunction->getReturnType();
-      RetVal = promoteTypeWithCheck(RetVal, FuncRetType, "return statement");
-      if (!RetVal) return nullptr;
-      
-      return Builder.CreateRet(RetVal);
+      return CI->Builder.CreateRet(Val->codegen());
     } else {
-      return Builder.CreateRetVoid();
+      return CI->Builder.CreateRetVoid();
     }
   }
 };
 
 /// ArgsAST - Class for a function argumetn in a function call
 class ArgsAST : public ASTnode {
-  std::string Callee;
-  std::vector<std::unique_ptr<ASTnode>> ArgsList;
+  Symbol Callee;
+  MutableArrayRef<ASTnode*> ArgsList;
+  FunctionPrototypeAST* Proto = nullptr; // resolved by sema()
 
 public:
-  ArgsAST(const std::string &Callee, std::vector<std::unique_ptr<ASTnode>> list)
-      : Callee(Callee), ArgsList(std::move(list)) {}
+  ArgsAST(SourceLoc Loc, Symbol Callee, MutableArrayRef<ASTnode*> list)
+      : ASTnode(Loc), Callee(Callee), ArgsList(list) {}
 
-  virtual std::string to_string(const std::string& prefix = "", bool isLast = true) const override {
+  virtual void print(raw_ostream& OS, const std::string& prefix = "", bool isLast = true) const override {
     // Display function call with callee name
-    std::string result = prefix + getConnector(isLast) + "FunctionCall(" + Callee + ")";
+    printConnector(OS, prefix, isLast) << "FunctionCall(" << symbolName(Callee) << ")\n";
     // Calculate prefix for argument children
     std::string newPrefix = extendPrefix(prefix, isLast);
     // Print each argument as a child node
     for (size_t i = 0; i < ArgsList.size(); i++) {
       bool lastArg = (i == ArgsList.size() - 1);
-      result += "\n" + ArgsList[i]->to_string(newPrefix, lastArg);
+      ArgsList[i]->print(OS, newPrefix, lastArg);
+    }
+  }
+
+  virtual TypeKind sema() override {
+    if (!CI->Loops.empty())
+      CI->Loops.back()->HasCalls = true;
+    // Look up function and check argument count
+    Proto = CI->Prototypes.lookup(Callee);
+    if (!Proto)
+      LogErrorT(Loc, ("Unknown function referenced: " + symbolName(Callee)).str());
+    else if (Proto->getParams().size() != ArgsList.size())
+      LogErrorT(Loc, "Incorrect number of arguments");
+    else
+      Ty = Proto->getType();
+
+    // Type coercion for arguments (widening only - flag narrowing as error)
+    for (unsigned i = 0; i < ArgsList.size(); ++i) {
+      ParamAST* Param = Ty == TY_UNKNOWN ? nullptr : Proto->getParams()[i];
+      if (Param && Param->isArray()) {
+        semaArrayArg(ArgsList[i], Param);
+        continue;
+      }
+      ArgsList[i]->sema();
+      if (Param)
+        ArgsList[i] = convertTo(ArgsList[i], Param->getType(), "function argument");
+    }
+    return Ty;
+  }
+
+  // An array parameter takes a whole array named by a bare identifier, with
+  // the parameter's element type and the same dimensions after the first
+  // (the first decays away, as in C)
+  static void semaArrayArg(ASTnode* Arg, ParamAST* Param) {
+    auto* Var = dynamic_cast<VariableASTnode*>(Arg);
+    SymbolEntry* Arr = Var ? Var->semaArray() : nullptr;
+    if (Var && !Var->getDecl())
+      return; // unknown name, already reported
+    if (!Arr) {
+      Arg->sema();
+      LogErrorT(Arg->getLoc(), ("Cannot pass a value to array parameter: " +
+                                symbolName(Param->getName())).str());
+    } else if (Arr->Ty != Param->getType() || Arr->Dims.size() != Param->getDims().size() ||
+               Arr->Dims.drop_front() != Param->getDims().drop_front()) {
+      LogErrorT(Arg->getLoc(), ("Array argument does not match array parameter: " +
+                                symbolName(Param->getName())).str());
     }
-    return result;
   }
 
   virtual Value* codegen() override {
-    // Look up function
-    Function* CalleeF = TheModule->getFunction(Callee);
-    if (!CalleeF) 
-      return LogErrorV(("Unknown function referenced: " + Callee).c_str());
-    
-    // Check argument count
-    if (CalleeF->arg_size() != ArgsList.size())
-      return LogErrorV("Incorrect number of arguments");
-    
-    // Evaluate each argument and apply type coercion to match parameter types    
+    Function* CalleeF = Proto->getFunction();
+
+    // Evaluate each argument, already converted to its parameter type;
+    // arrays are passed by address
     std::vector<Value*> ArgsV;
-    auto ArgIt = CalleeF->arg_begin();
-    for (unsigned i = 0; i < ArgsList.size(); ++i, ++ArgIt) {
-      Value* ArgVal = ArgsList[i]->codegen();
-      if (!ArgVal) return nullptr;
-      
-      // Type coercion for arguments (widening only - flag narrowing as error)
-      ArgVal = promoteTypeWithCheck(ArgVal, ArgIt->getType(), "function argument");
-      if(!ArgVal) return nullptr;
-      ArgsV.push_back(ArgVal);
+    for (unsigned i = 0; i < ArgsList.size(); ++i) {
+      if (Proto->getParams()[i]->isArray())
+        ArgsV.push_back(ArgsList[i]->codegenPtr());
+      else
+        ArgsV.push_back(ArgsList[i]->codegen());
     }
     
     // Create call instruction
     if (CalleeF->getReturnType()->isVoidTy()) {
-      return Builder.CreateCall(CalleeF, ArgsV);
+      return CI->Builder.CreateCall(CalleeF, ArgsV);
     }
-    return Builder.CreateCall(CalleeF, ArgsV, "calltmp");
+    return CI->Builder.CreateCall(CalleeF, ArgsV, "calltmp");
   }
 };
 
-// Global storage for AST nodes
-static std::vector<std::unique_ptr<ASTnode>> ProgramAST;
-static std::vector<std::unique_ptr<FunctionPrototypeAST>> ExternAST;
+// Resolve every name and type in the program, in source order, so that
+// codegen only has to read the annotations
+static void analyseProgram() {
+  for (FunctionPrototypeAST* Proto : CI->ExternAST)
+    Proto->sema();
+  for (ASTnode* Decl : CI->ProgramAST)
+    Decl->sema();
+}
 
 /// LogError* - Helper function for syntax error handling during parsing (returns ASTnode)
-std::unique_ptr<ASTnode> LogError(TOKEN tok, const char *Str) {
-  std::string found = (tok.type == EOF_TOK) ? "EOF" : tok.lexeme;
-  fprintf(stderr, "%d:%d Syntax Error: %s (found '%s')\n", tok.lineNo, tok.columnNo, Str, found.c_str());
-  exit(2);
+ASTnode* LogError(TOKEN tok, const char *Str) {
+  if (!CI->Panicking) {
+    std::string found = (tok.type == EOF_TOK) ? "EOF" : std::string(tok.lexeme);
+    CI->Diags.report(DiagnosticsEngine::Syntax, locOf(tok),
+                     std::string(Str) + " (found '" + found + "')");
+  }
+  CI->Panicking = true;
   return nullptr;
 }
 
 // Syntax errors during extern parsing (returns FunctionPrototypeAST)
-std::unique_ptr<FunctionPrototypeAST> LogErrorP(TOKEN tok, const char *Str) {
+FunctionPrototypeAST* LogErrorP(TOKEN tok, const char *Str) {
   LogError(tok, Str);
-  exit(2);
   return nullptr;
 }
 
+// Panic-mode recovery after a syntax error: skip to the end of the statement
+// or declaration, i.e. past the next ';' or past the '}' of a block that
+// started while skipping. A '}' closing the enclosing block is left for
+// ParseBlock, except at top level where there is no enclosing block.
+static void synchronize(bool AtTopLevel) {
+  int Depth = 0;
+  while (CI->CurTok.type != EOF_TOK) {
+    if (CI->CurTok.type == SC && Depth == 0) {
+      getNextToken(); // eat ';'
+      break;
+    }
+    if (CI->CurTok.type == LBRA) {
+      Depth++;
+    } else if (CI->CurTok.type == RBRA) {
+      if (Depth == 0 && !AtTopLevel)
+        break;
+      if (Depth <= 1) {
+        getNextToken(); // eat '}'
+        break;
+      }
+      Depth--;
+    }
+    getNextToken();
+  }
+  CI->Panicking = false;
+}
+
+// Eat the ';' that ends a statement or declaration. A missing ';' is
+// reported, then parsing carries on as if it had been there, so the
+// construct is kept and the code after it is not skipped.
+static void expectSemicolon(const char* Str) {
+  if (CI->CurTok.type == SC) {
+    getNextToken(); // eat ';'
+    return;
+  }
+  bool WasPanicking = CI->Panicking;
+  LogError(CI->CurTok, Str);
+  CI->Panicking = WasPanicking;
+}
+
 //===----------------------------------------------------------------------===//
 // Recursive Descent - Function call for each production
 //===----------------------------------------------------------------------===//
 
-static std::unique_ptr<ASTnode> ParseDecl();
-static std::unique_ptr<ASTnode> ParseStmt();
-static std::unique_ptr<ASTnode> ParseBlock();
-static std::unique_ptr<ASTnode> ParseExper();
-static std::unique_ptr<ParamAST> ParseParam();
-static std::unique_ptr<DeclAST> ParseLocalDecl();
-static std::vector<std::unique_ptr<ASTnode>> ParseStmtListPrime();
+// Type named by a type keyword token
+static TypeKind getTypeKind(const TOKEN& Tok) {
+  switch (Tok.type) {
+    case INT_TOK: return TY_INT;
+    case FLOAT_TOK: return TY_FLOAT;
+    case BOOL_TOK: return TY_BOOL;
+    case VOID_TOK: return TY_VOID;
+    default: return TY_UNKNOWN;
+  }
+}
+
+static ASTnode* ParseDecl();
+static ASTnode* ParseStmt();
+static ASTnode* ParseBlock();
+static ASTnode* ParseExper();
+static ParamAST* ParseParam();
+static DeclAST* ParseLocalDecl();
+static void ParseStmtListPrime(std::vector<ASTnode*>& stmt_list);
 
 // element ::= FLOAT_LIT
-static std::unique_ptr<ASTnode> ParseFloatNumberExpr() {
-  auto Result = std::make_unique<FloatASTnode>(CurTok, CurTok.getFloatVal());
+static ASTnode* ParseFloatNumberExpr() {
+  auto Result = newNode<FloatASTnode>(CI->CurTok, CI->CurTok.getFloatVal());
   getNextToken(); // consume the number
-  return std::move(Result);
+  return Result;
 }
 
 // element ::= INT_LIT
-static std::unique_ptr<ASTnode> ParseIntNumberExpr() {
-  auto Result = std::make_unique<IntASTnode>(CurTok, CurTok.getIntVal());
+static ASTnode* ParseIntNumberExpr() {
+  auto Result = newNode<IntASTnode>(CI->CurTok, CI->CurTok.getIntVal());
   getNextToken(); // consume the number
-  return std::move(Result);
+  return Result;
 }
 
 // element ::= BOOL_LIT
-static std::unique_ptr<ASTnode> ParseBoolExpr() {
-  auto Result = std::make_unique<BoolASTnode>(CurTok, CurTok.getBoolVal());
+static ASTnode* ParseBoolExpr() {
+  auto Result = newNode<BoolASTnode>(CI->CurTok, CI->CurTok.getBoolVal());
   getNextToken(); // consume the number
-  return std::move(Result);
+  return Result;
 }
 
 // param_list_prime ::= "," param param_list_prime
 //                   |  ε
-static std::vector<std::unique_ptr<ParamAST>> ParseParamListPrime() {
-  std::vector<std::unique_ptr<ParamAST>> param_list;
-
-  if (CurTok.type == COMMA) { // more parameters in list
-    getNextToken();           // eat ","
+// The tail recursion is unrolled into a loop that appends to param_list.
+static void ParseParamListPrime(std::vector<ParamAST*>& param_list) {
+  while (CI->CurTok.type == COMMA) { // more parameters in list
+    getNextToken();              // eat ","
 
     auto param = ParseParam();
-    if (param) {
-      printf("found param in param_list_prime: %s\n", param->getName().c_str());
-      param_list.push_back(std::move(param));
-      auto param_list_prime = ParseParamListPrime();
-      for (unsigned i = 0; i < param_list_prime.size(); i++) {
-        param_list.push_back(std::move(param_list_prime.at(i)));
-      }
-    }
-  } else if (CurTok.type == RPAR) { // FOLLOW(param_list_prime)
+    if (!param)
+      return;
+    logProgress(VERBOSE, "found param in param_list_prime: %s\n", symbolName(param->getName()).str().c_str());
+    param_list.push_back(param);
+  }
+
+  if (CI->CurTok.type == RPAR) { // FOLLOW(param_list_prime)
     // expand by param_list_prime ::= ε
     // do nothing
   } else {
-    LogError(CurTok, "Expected ',' or ')' in list of parameter declarations");
+    LogError(CI->CurTok, "Expected ',' or ')' in list of parameter declarations");
   }
-
-  return param_list;
 }
 
 // param ::= var_type IDENT | var_type IDENT array_dims
-static std::unique_ptr<ParamAST> ParseParam() {
-  std::string Type = CurTok.lexeme; // keep track of the type of the param
+static ParamAST* ParseParam() {
+  TypeKind Type = getTypeKind(CI->CurTok); // keep track of the type of the param
   getNextToken();                   // eat the type token
 
-  if (CurTok.type == IDENT) { // parameter declaration
-    std::string Name = CurTok.getIdentifierStr();
+  if (CI->CurTok.type == IDENT) { // parameter declaration
+    Symbol Name = CI->CurTok.getIdentifier();
     getNextToken(); // eat "IDENT"
 
     // Check for array parameter
-    if (CurTok.type == LBOX) {
+    if (CI->CurTok.type == LBOX) {
       std::vector<int> dims;
 
-      while (CurTok.type == LBOX) {
+      while (CI->CurTok.type == LBOX) {
         getNextToken(); // eat '['
 
-        if (CurTok.type != INT_LIT) {
-          LogError(CurTok, "Expected integer literal for array dimension in parameter");
+        if (CI->CurTok.type != INT_LIT) {
+          LogError(CI->CurTok, "Expected integer literal for array dimension in parameter");
           return nullptr;
         }
-        dims.push_back(CurTok.getIntVal());
+        dims.push_back(CI->CurTok.getIntVal());
         getNextToken(); // eat INT_LIT
 
-        if (CurTok.type != RBOX) {
-          LogError(CurTok, "Expected ']' after array dimension in parameter");
+        if (CI->CurTok.type != RBOX) {
+          LogError(CI->CurTok, "Expected ']' after array dimension in parameter");
           return nullptr;
         }
         getNextToken(); // eat ']'
       }
       
-      return std::make_unique<ParamAST>(Name, Type, std::move(dims));
+      return newNode<ParamAST>(Name, Type, copyToArena(dims));
     }
 
-    return std::make_unique<ParamAST>(Name, Type);  
+    return newNode<ParamAST>(Name, Type);  
   }
 
   return nullptr;
 }
 
 // param_list ::= param param_list_prime
-static std::vector<std::unique_ptr<ParamAST>> ParseParamList() {
-  std::vector<std::unique_ptr<ParamAST>> param_list;
+static std::vector<ParamAST*> ParseParamList() {
+  std::vector<ParamAST*> param_list;
 
   auto param = ParseParam();
   if (param) {
-    param_list.push_back(std::move(param));
-    auto param_list_prime = ParseParamListPrime();
-    for (unsigned i = 0; i < param_list_prime.size(); i++) {
-      param_list.push_back(std::move(param_list_prime.at(i)));
-    }
+    param_list.push_back(param);
+    ParseParamListPrime(param_list);
   }
 
   return param_list;
@@ -1863,32 +3068,26 @@ static std::vector<std::unique_ptr<ParamAST>> ParseParamList() {
 
 // params ::= param_list
 //         |  ε
-static std::vector<std::unique_ptr<ParamAST>> ParseParams() {
-  std::vector<std::unique_ptr<ParamAST>> param_list;
+static std::vector<ParamAST*> ParseParams() {
+  std::vector<ParamAST*> param_list;
 
-  std::string Type;
-  std::string Name = "";
+  if (CI->CurTok.type == INT_TOK || CI->CurTok.type == FLOAT_TOK ||
+      CI->CurTok.type == BOOL_TOK) { // FIRST(param_list)
 
-  if (CurTok.type == INT_TOK || CurTok.type == FLOAT_TOK ||
-      CurTok.type == BOOL_TOK) { // FIRST(param_list)
-
-    auto list = ParseParamList();
-    for (unsigned i = 0; i < list.size(); i++) {
-      param_list.push_back(std::move(list.at(i)));
-    }
+    param_list = ParseParamList();
 
-  } else if (CurTok.type == VOID_TOK) { // FIRST("void")
+  } else if (CI->CurTok.type == VOID_TOK) { // FIRST("void")
     // void
     // check that the next token is a )
     getNextToken(); // eat 'void'
-    if (CurTok.type != RPAR) {
-      LogError(CurTok, "Expected ')', after 'void' in function parameters");
+    if (CI->CurTok.type != RPAR) {
+      LogError(CI->CurTok, "Expected ')', after 'void' in function parameters");
     }
-  } else if (CurTok.type == RPAR) { // FOLLOW(params)
+  } else if (CI->CurTok.type == RPAR) { // FOLLOW(params)
     // expand by params ::= ε
     // do nothing
   } else {
-    LogError(CurTok, "Expected parameter type or ')' in function parameters");
+    LogError(CI->CurTok, "Expected parameter type or ')' in function parameters");
   }
 
   return param_list;
@@ -1904,36 +3103,38 @@ static std::vector<std::unique_ptr<ParamAST>> ParseParams() {
 */
 
 // Forward declarations for all expression parsing functions
-static std::unique_ptr<ASTnode> ParseAssignExpr();
-static std::unique_ptr<ASTnode> ParseOrExpr();                   // '||'
-static std::unique_ptr<ASTnode> ParseAndExpr();                  // '&&'
-static std::unique_ptr<ASTnode> ParseEqExpr();                   // '==' '!='
-static std::unique_ptr<ASTnode> ParseRelExpr();                  // '<' '<=' '>' '>='
-static std::unique_ptr<ASTnode> ParseAddExpr();                  // '+' '-'
-static std::unique_ptr<ASTnode> ParseMulExpr();                  //'*' '/' '%'
-static std::unique_ptr<ASTnode> ParseUnaryExpr();                // prefix '!' '-'
-static std::unique_ptr<ASTnode> ParsePostfixExpr();              // calls vs plain ident
-static std::unique_ptr<ASTnode> ParsePrimaryExpr();
+static ASTnode* ParseAssignExpr();
+static ASTnode* ParseOrExpr();                   // '||'
+static ASTnode* ParseAndExpr();                  // '&&'
+static ASTnode* ParseEqExpr();                   // '==' '!='
+static ASTnode* ParseRelExpr();                  // '<' '<=' '>' '>='
+static ASTnode* ParseAddExpr();                  // '+' '-'
+static ASTnode* ParseMulExpr();                  //'*' '/' '%'
+static ASTnode* ParseUnaryExpr();                // prefix '!' '-'
+static ASTnode* ParsePostfixExpr();              // calls vs plain ident
+static ASTnode* ParsePrimaryExpr();
 
 // '=' (lowest precedence)
 // Parse assignment: check for '=' after parsing LHS
-static std::unique_ptr<ASTnode> ParseAssignExpr() {
+static ASTnode* ParseAssignExpr() {
   auto lhs = ParseOrExpr(); // next level down in precedence    
+  if (!lhs) return nullptr;
 
   // Validate LHS is assignable (variable or array element)
-  if (CurTok.type == ASSIGN) { // '=' token
+  if (CI->CurTok.type == ASSIGN) { // '=' token
     // LHS must be a variable OR array access
-    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(lhs.get());
-    ArrayAccessAST* arrayNode = dynamic_cast<ArrayAccessAST*>(lhs.get());
+    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(lhs);
+    ArrayAccessAST* arrayNode = dynamic_cast<ArrayAccessAST*>(lhs);
 
     if (!varNode && !arrayNode) {
-      return LogError(CurTok, "Left side of assignment must be a variable or array element");
+      return LogError(CI->CurTok, "Left side of assignment must be a variable or array element");
     }
 
     getNextToken(); // eat '='
     auto rhs = ParseAssignExpr(); // right-associative
+    if (!rhs) return nullptr;
     // wrap in AssignExprAST node
-    return std::make_unique<AssignExprAST>(std::move(lhs), std::move(rhs));
+    return newNode<AssignExprAST>(lhs, rhs);
   }
 
   return lhs;
@@ -1941,105 +3142,105 @@ static std::unique_ptr<ASTnode> ParseAssignExpr() {
 }
 
 // Parse '||' - logical OR (left-assosciative)
-static std::unique_ptr<ASTnode> ParseOrExpr(){
+static ASTnode* ParseOrExpr(){
   auto lhs = ParseAndExpr(); // parse higher precedence first
   if (!lhs) return nullptr;
 
-  while (CurTok.type == OR) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == OR) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat '||'
     auto rhs = ParseAndExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '&&' - logical AND (left-assosciative)
-static std::unique_ptr<ASTnode> ParseAndExpr() {
+static ASTnode* ParseAndExpr() {
   auto lhs = ParseEqExpr();
   if (!lhs) return nullptr;
 
-  while (CurTok.type == AND) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == AND) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat '&&'
     auto rhs = ParseEqExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '==' '!=' - equality operators (left-assosciative)
-static std::unique_ptr<ASTnode> ParseEqExpr() {
+static ASTnode* ParseEqExpr() {
   auto lhs = ParseRelExpr();
   if (!lhs) return nullptr;
 
-  while (CurTok.type == EQ || CurTok.type == NE) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == EQ || CI->CurTok.type == NE) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat '==' or '!='
     auto rhs = ParseRelExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '<' '<=' '>' '>=' - relational operators (left-assosciative)
-static std::unique_ptr<ASTnode> ParseRelExpr() {
+static ASTnode* ParseRelExpr() {
   auto lhs = ParseAddExpr();
   if (!lhs) return nullptr;
 
-  while (CurTok.type == LT || CurTok.type == LE || 
-         CurTok.type == GT || CurTok.type == GE) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == LT || CI->CurTok.type == LE || 
+         CI->CurTok.type == GT || CI->CurTok.type == GE) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat relatoinal operator
     auto rhs = ParseAddExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '+' '-' - additive operators (left-assosciative)
-static std::unique_ptr<ASTnode> ParseAddExpr() {
+static ASTnode* ParseAddExpr() {
   auto lhs = ParseMulExpr();
   if(!lhs) return nullptr;
 
-  while (CurTok.type == PLUS || CurTok.type == MINUS) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == PLUS || CI->CurTok.type == MINUS) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat + or - 
     auto rhs = ParseMulExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '*' '/' '%' - multiplicative operators (left-assosciative)
-static std::unique_ptr<ASTnode> ParseMulExpr() {
+static ASTnode* ParseMulExpr() {
   auto lhs = ParseUnaryExpr();
   if (!lhs) return nullptr;
   
-  while (CurTok.type == ASTERIX || CurTok.type == DIV || CurTok.type == MOD) {
-    TOKEN Op = CurTok;
+  while (CI->CurTok.type == ASTERIX || CI->CurTok.type == DIV || CI->CurTok.type == MOD) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat
     auto rhs = ParseUnaryExpr();
     if (!rhs) return nullptr;
-    lhs = std::make_unique<ExprAST>(Op, std::move(lhs), std::move(rhs));
+    lhs = newNode<ExprAST>(Op, lhs, rhs);
   }
   return lhs;
 }
 
 // Parse '!' '-' - unary operators (prefix)
-static std::unique_ptr<ASTnode> ParseUnaryExpr() {
+static ASTnode* ParseUnaryExpr() {
   // Check for unary operators
-  if (CurTok.type == NOT || CurTok.type == MINUS) {
-    TOKEN Op = CurTok;
+  if (CI->CurTok.type == NOT || CI->CurTok.type == MINUS) {
+    TOKEN Op = CI->CurTok;
     getNextToken(); // eat unary operator
     auto operand = ParseUnaryExpr(); // right-assosciative (can stack: --x, !!x)
     if (!operand) return nullptr;
-    return std::make_unique<ExprAST>(Op, std::move(operand));
+    return newNode<ExprAST>(Op, operand);
   }
   // No unary operator, parse postfix expression
   return ParsePostfixExpr();
@@ -2048,80 +3249,80 @@ static std::unique_ptr<ASTnode> ParseUnaryExpr() {
 // postfix_expr  ::= primary_expr postfix_expr'
 // postfix_expr' ::= "(" args ")" | "[" expr "]" postfix_expr' | ε
 // Function calls: IDENT '(' args ')' or just IDENT
-static std::unique_ptr<ASTnode> ParsePostfixExpr() {      // calls vs plain ident
+static ASTnode* ParsePostfixExpr() {      // calls vs plain ident
   auto expr = ParsePrimaryExpr();
   if (!expr) return nullptr;
 
   // Check if this is a function call
-  if (CurTok.type == LPAR) {
+  if (CI->CurTok.type == LPAR) {
     getNextToken(); // eat '('
     // Parse arguments
-    std::vector<std::unique_ptr<ASTnode>> args;
+    std::vector<ASTnode*> args;
 
     // args ::= arg_list | eps
-    if (CurTok.type != RPAR) {      // not empty args
+    if (CI->CurTok.type != RPAR) {      // not empty args
       // arg_list ::= expr ("," expr)*
       while (true) {
         auto arg = ParseAssignExpr(); // parse each argument as an expression
         if (!arg) return nullptr;
-        args.push_back(std::move(arg));
+        args.push_back(arg);
 
-        if (CurTok.type != COMMA) break; // no more arguments
+        if (CI->CurTok.type != COMMA) break; // no more arguments
         getNextToken(); // eat ','
       }
     }
     
-    if (CurTok.type != RPAR) {
-      return LogError(CurTok, "Expected ')' in function call");
+    if (CI->CurTok.type != RPAR) {
+      return LogError(CI->CurTok, "Expected ')' in function call");
     }
     getNextToken(); // eat')'
     
     // Get function name from the primary expression (should be an identifier)
-    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(expr.get());
+    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(expr);
     if (!varNode) {
-      return LogError(CurTok, "Function name expected before '('");
+      return LogError(CI->CurTok, "Function name expected before '('");
     }
-    std::string callee = varNode->getName();
+    Symbol callee = varNode->getName();
 
-    return std::make_unique<ArgsAST>(callee, std::move(args));
+    return newNode<ArgsAST>(varNode->getLoc(), callee, copyToArena(args));
   }
 
   // Check if this is array access
-  if (CurTok.type == LBOX) {
+  if (CI->CurTok.type == LBOX) {
     // Must be an indentifier for array access
-    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(expr.get());
+    VariableASTnode* varNode = dynamic_cast<VariableASTnode*>(expr);
     if (!varNode) {
-      return LogError(CurTok, "Expected identifier before '['");
+      return LogError(CI->CurTok, "Expected identifier before '['");
     }
-    std::string arrayName = varNode->getName();
+    Symbol arrayName = varNode->getName();
 
-    std::vector<std::unique_ptr<ASTnode>> indices;
+    std::vector<ASTnode*> indices;
 
-    while (CurTok.type == LBOX) {
+    while (CI->CurTok.type == LBOX) {
       getNextToken(); // eat '['
 
       auto index = ParseAssignExpr(); // Parse index expression
       if (!index) return nullptr;
-      indices.push_back(std::move(index));
+      indices.push_back(index);
 
-      if (CurTok.type != RBOX) {
-        return LogError(CurTok, "Expected ']' after array index");
+      if (CI->CurTok.type != RBOX) {
+        return LogError(CI->CurTok, "Expected ']' after array index");
       }
       getNextToken(); // eat ']'
     }
 
-    return std::make_unique<ArrayAccessAST>(arrayName, std::move(indices));
+    return newNode<ArrayAccessAST>(varNode->getLoc(), arrayName, copyToArena(indices));
   }
   
   return expr;
 }
 
 // Primary expressions: literals, identifiers, parenthesized expressions
-static std::unique_ptr<ASTnode> ParsePrimaryExpr() {
-  switch (CurTok.type) {
+static ASTnode* ParsePrimaryExpr() {
+  switch (CI->CurTok.type) {
     case IDENT: {
       // Variable reference
-      auto result = std::make_unique<VariableASTnode>(CurTok, CurTok.getIdentifierStr());
+      auto result = newNode<VariableASTnode>(CI->CurTok, CI->CurTok.getIdentifier());
       getNextToken(); // eat identifier
       return result;
     }
@@ -2140,20 +3341,20 @@ static std::unique_ptr<ASTnode> ParsePrimaryExpr() {
       auto expr = ParseAssignExpr(); // parse full expression (lowest precedence)
       if (!expr) return nullptr;
       
-      if (CurTok.type != RPAR) {
-        return LogError(CurTok, "Expected ')' after expression");
+      if (CI->CurTok.type != RPAR) {
+        return LogError(CI->CurTok, "Expected ')' after expression");
       }
       getNextToken(); // eat ')'
       return expr;
     }
     
     default:
-      return LogError(CurTok, "Unexpected token in expression");
+      return LogError(CI->CurTok, "Unexpected token in expression");
   }
 }
 
 // ParseExper - Entry point for expression parsing
-static std::unique_ptr<ASTnode> ParseExper() {
+static ASTnode* ParseExper() {
   return ParseAssignExpr();
 }
 
@@ -2161,75 +3362,69 @@ static std::unique_ptr<ASTnode> ParseExper() {
 // expr_stmt ::= expr ";"
 //            |  ";"
 // Parse expression statement or empty statement
-static std::unique_ptr<ASTnode> ParseExperStmt() {
+static ASTnode* ParseExperStmt() {
 
-  if (CurTok.type == SC) { // empty statement
+  if (CI->CurTok.type == SC) { // empty statement
     getNextToken();        // eat ;
     return nullptr;
   } else {
     auto expr = ParseExper();
-    if (expr) {
-      if (CurTok.type == SC) {
-        getNextToken(); // eat ;
-        return expr;
-      } else {
-        LogError(CurTok, "Expected ';' to end expression statement");
-      }
-    } else
-      return nullptr;
+    if (expr)
+      expectSemicolon("Expected ';' to end expression statement");
+    return expr;
   }
-  return nullptr;
 }
 
 // else_stmt  ::= "else" block
 //             |  ε
 // Parse optional else block
-static std::unique_ptr<ASTnode> ParseElseStmt() {
+static ASTnode* ParseElseStmt() {
 
-  if (CurTok.type == ELSE) { // FIRST(else_stmt)
+  if (CI->CurTok.type == ELSE) { // FIRST(else_stmt)
     // expand by else_stmt  ::= "else" "{" stmt "}"
     getNextToken(); // eat "else"
 
-    if (!(CurTok.type == LBRA)) {
-      return LogError(CurTok, "Expected '{' to start else block");
+    if (!(CI->CurTok.type == LBRA)) {
+      return LogError(CI->CurTok, "Expected '{' to start else block");
     }
     auto Else = ParseBlock();
     if (!Else)
       return nullptr;
     return Else;
-  } else if (CurTok.type == NOT || CurTok.type == MINUS ||
-             CurTok.type == PLUS || CurTok.type == LPAR ||
-             CurTok.type == IDENT || CurTok.type == INT_LIT ||
-             CurTok.type == BOOL_LIT || CurTok.type == FLOAT_LIT ||
-             CurTok.type == SC || CurTok.type == LBRA || CurTok.type == WHILE ||
-             CurTok.type == IF || CurTok.type == ELSE ||
-             CurTok.type == RETURN ||
-             CurTok.type == RBRA) { // FOLLOW(else_stmt)
+  } else if (CI->CurTok.type == NOT || CI->CurTok.type == MINUS ||
+             CI->CurTok.type == PLUS || CI->CurTok.type == LPAR ||
+             CI->CurTok.type == IDENT || CI->CurTok.type == INT_LIT ||
+             CI->CurTok.type == BOOL_LIT || CI->CurTok.type == FLOAT_LIT ||
+             CI->CurTok.type == SC || CI->CurTok.type == LBRA || CI->CurTok.type == WHILE ||
+             CI->CurTok.type == FOR || CI->CurTok.type == PRAGMA || CI->CurTok.type == IF ||
+             CI->CurTok.type == ELSE ||
+             CI->CurTok.type == RETURN ||
+             CI->CurTok.type == RBRA) { // FOLLOW(else_stmt)
     // expand by else_stmt  ::= ε
     // return an empty statement
     return nullptr;
   } else
-    LogError(CurTok, "Expected 'else', statement, or '}' after if block");
+    LogError(CI->CurTok, "Expected 'else', statement, or '}' after if block");
 
   return nullptr;
 }
 
 // if_stmt ::= "if" "(" expr ")" block else_stmt
 // Parse if statement with condition, then block, and optional else
-static std::unique_ptr<ASTnode> ParseIfStmt() {
+static ASTnode* ParseIfStmt() {
   getNextToken(); // eat the if.
-  if (CurTok.type == LPAR) {
+  if (CI->CurTok.type == LPAR) {
     getNextToken(); // eat (
     // condition.
     auto Cond = ParseExper();
     if (!Cond)
       return nullptr;
-    if (CurTok.type != RPAR)
-      return LogError(CurTok, "Expected ')' after if condition");
+    if (CI->CurTok.type != RPAR)
+      return LogError(CI->CurTok, "Expected ')' after if condition");
     getNextToken(); // eat )
 
-    if (!(CurTok.type == LBRA)) {
-      return LogError(CurTok, "Expected '{' to start if block");
+    if (!(CI->CurTok.type == LBRA)) {
+      return LogError(CI->CurTok, "Expected '{' to start if block");
     }
 
     auto Then = ParseBlock();
@@ -2237,11 +3432,11 @@ static std::unique_ptr<ASTnode> ParseIfStmt() {
       return nullptr;
     auto Else = ParseElseStmt();
 
-    return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then),
-                                       std::move(Else));
+    return newNode<IfExprAST>(Cond, Then,
+                                       Else);
 
   } else
-    return LogError(CurTok, "Expected '(' after 'if'");
+    return LogError(CI->CurTok, "Expected '(' after 'if'");
 
   return nullptr;
 }
@@ -2249,239 +3444,353 @@ static std::unique_ptr<ASTnode> ParseIfStmt() {
 // return_stmt ::= "return" ";"
 //             |  "return" expr ";"
 // Parse return statement with optional expression
-static std::unique_ptr<ASTnode> ParseReturnStmt() {
+static ASTnode* ParseReturnStmt() {
+  TOKEN ReturnTok = CI->CurTok;
   getNextToken(); // eat the return
-  if (CurTok.type == SC) {
+  if (CI->CurTok.type == SC) {
     getNextToken(); // eat the ;
     // return a null value
-    return std::make_unique<ReturnAST>(std::move(nullptr));
-  } else if (CurTok.type == NOT || CurTok.type == MINUS ||
-             CurTok.type == PLUS || CurTok.type == LPAR ||
-             CurTok.type == IDENT || CurTok.type == BOOL_LIT ||
-             CurTok.type == INT_LIT ||
-             CurTok.type == FLOAT_LIT) { // FIRST(expr)
+    return newNode<ReturnAST>(ReturnTok, nullptr);
+  } else if (CI->CurTok.type == NOT || CI->CurTok.type == MINUS ||
+             CI->CurTok.type == PLUS || CI->CurTok.type == LPAR ||
+             CI->CurTok.type == IDENT || CI->CurTok.type == BOOL_LIT ||
+             CI->CurTok.type == INT_LIT ||
+             CI->CurTok.type == FLOAT_LIT) { // FIRST(expr)
     auto val = ParseExper();
     if (!val)
       return nullptr;
 
-    if (CurTok.type == SC) {
-      getNextToken(); // eat the ;
-      return std::make_unique<ReturnAST>(std::move(val));
-    } else
-      return LogError(CurTok, "Expected ';'");
+    expectSemicolon("Expected ';'");
+    return newNode<ReturnAST>(ReturnTok, val);
   } else
-    return LogError(CurTok, "Expected ';' or an expression");
+    return LogError(CI->CurTok, "Expected ';' or an expression");
 
   return nullptr;
 }
 
+// loop_hint ::= "#pragma" hint_name
+//             |  "#pragma" hint_name INT_LIT
+//             |  "#pragma" hint_name "(" INT_LIT ")"
+// Parse one loop hint into Hints. A hint takes up the rest of its line, and
+// only "unroll" and "vectorize" take a factor.
+static bool ParseLoopHint(LoopHints& Hints) {
+  TOKEN PragmaTok = CI->CurTok;
+  getNextToken(); // eat #pragma
+  auto onPragmaLine = [&] {
+    return CI->CurTok.type != EOF_TOK && CI->CurTok.lineNo == PragmaTok.lineNo;
+  };
+
+  std::string_view Name = CI->CurTok.lexeme;
+  bool Unroll = Name == "unroll" || Name == "nounroll";
+  if (CI->CurTok.type != IDENT || !onPragmaLine() ||
+      !(Unroll || Name == "vectorize" || Name == "novectorize")) {
+    LogError(CI->CurTok, "Expected 'unroll', 'nounroll', 'vectorize' or 'novectorize' after '#pragma'");
+    return false;
+  }
+  LoopHints::Hint& Hint = Unroll ? Hints.Unroll : Hints.Vectorize;
+  if (Hint != LoopHints::NONE) {
+    LogError(CI->CurTok, Unroll ? "Loop already has an unroll hint" : "Loop already has a vectorize hint");
+    return false;
+  }
+  Hint = Name[0] == 'n' ? LoopHints::DISABLE : LoopHints::ENABLE;
+  (Unroll ? Hints.UnrollLoc : Hints.VectorizeLoc) = locOf(PragmaTok);
+  getNextToken(); // eat the hint name
+
+  if (Hint == LoopHints::ENABLE && onPragmaLine() &&
+      (CI->CurTok.type == INT_LIT || CI->CurTok.type == LPAR)) {
+    bool Paren = CI->CurTok.type == LPAR;
+    if (Paren)
+      getNextToken(); // eat (
+    int Factor = CI->CurTok.type == INT_LIT ? CI->CurTok.getIntVal() : 0;
+    if (CI->CurTok.type != INT_LIT) {
+      LogError(CI->CurTok, "Expected integer literal in loop hint");
+      return false;
+    }
+    // The vectoriser ignores widths that are not a power of two
+    if (Factor <= 0 || (!Unroll && !isPowerOf2_32(Factor))) {
+      LogError(CI->CurTok, Unroll ? "Unroll count must be positive"
+                                  : "Vectorize width must be a power of two");
+      return false;
+    }
+    (Unroll ? Hints.UnrollCount : Hints.VectorizeWidth) = Factor;
+    getNextToken(); // eat the factor
+    if (Paren) {
+      if (CI->CurTok.type != RPAR) {
+        LogError(CI->CurTok, "Expected ')' after loop hint factor");
+        return false;
+      }
+      getNextToken(); // eat )
+    }
+  }
+
+  if (onPragmaLine()) {
+    LogError(CI->CurTok, "Expected end of line after loop hint");
+    return false;
+  }
+  return true;
+}
+
 // while_stmt ::= "while" "(" expr ")" stmt
 // Parse while loop with condition and body
-static std::unique_ptr<ASTnode> ParseWhileStmt() {
+static ASTnode* ParseWhileStmt(const LoopHints& Hints) {
+
+  getNextToken(); // eat the while.
+  if (CI->CurTok.type == LPAR) {
+    getNextToken(); // eat (
+    // condition.
+    auto Cond = ParseExper();
+    if (!Cond)
+      return nullptr;
+    if (CI->CurTok.type != RPAR)
+      return LogError(CI->CurTok, "Expected ')' after while condition");
+    getNextToken(); // eat )
+
+    auto Body = ParseStmt();
+    if (!Body)
+      return nullptr;
+
+    return newNode<WhileExprAST>(Cond, Body, Hints);
+  } else
+    return LogError(CI->CurTok, "Expected '(' after 'while'");
+}
+
+// for_stmt ::= "for" "(" for_expr ";" for_expr ";" for_expr ")" stmt
+// for_expr ::= expr
+//           |  ε
+// Parse for loop with optional initialiser, condition and increment
+static ASTnode* ParseForStmt(const LoopHints& Hints) {
+
+  getNextToken(); // eat the for.
+  if (CI->CurTok.type != LPAR)
+    return LogError(CI->CurTok, "Expected '(' after 'for'");
+  getNextToken(); // eat (
+
+  ASTnode* Init = nullptr;
+  if (CI->CurTok.type != SC && !(Init = ParseExper()))
+    return nullptr;
+  if (CI->CurTok.type != SC)
+    return LogError(CI->CurTok, "Expected ';' after for loop initialiser");
+  getNextToken(); // eat ;
+
+  // A missing condition is always true
+  ASTnode* Cond;
+  if (CI->CurTok.type == SC)
+    Cond = newNode<BoolASTnode>(CI->CurTok, true);
+  else if (!(Cond = ParseExper()))
+    return nullptr;
+  if (CI->CurTok.type != SC)
+    return LogError(CI->CurTok, "Expected ';' after for loop condition");
+  getNextToken(); // eat ;
+
+  ASTnode* Inc = nullptr;
+  if (CI->CurTok.type != RPAR && !(Inc = ParseExper()))
+    return nullptr;
+  if (CI->CurTok.type != RPAR)
+    return LogError(CI->CurTok, "Expected ')' after for loop increment");
+  getNextToken(); // eat )
+
+  // for (...); is a loop with an empty body
+  bool EmptyBody = CI->CurTok.type == SC;
+  auto Body = ParseStmt();
+  if (EmptyBody)
+    Body = newNode<BlockAST>(ArrayRef<DeclAST*>(), ArrayRef<ASTnode*>());
+  if (!Body)
+    return nullptr;
+
+  return newNode<ForExprAST>(Init, Cond, Inc, Body, Hints);
+}
 
-  getNextToken(); // eat the while.
-  if (CurTok.type == LPAR) {
-    getNextToken(); // eat (
-    // condition.
-    auto Cond = ParseExper();
-    if (!Cond)
-      return nullptr;
-    if (CurTok.type != RPAR)
-      return LogError(CurTok, "Expected ')' after while condition");
-    getNextToken(); // eat )
+// loop_stmt ::= loop_hints while_stmt
+//            |  loop_hints for_stmt
+// loop_hints ::= loop_hints loop_hint
+//             |  ε
+// Parse a while or for loop with its hints
+static ASTnode* ParseLoopStmt() {
 
-    auto Body = ParseStmt();
-    if (!Body)
+  LoopHints Hints;
+  while (CI->CurTok.type == PRAGMA) { // FIRST(loop_hint)
+    if (!ParseLoopHint(Hints))
       return nullptr;
-
-    return std::make_unique<WhileExprAST>(std::move(Cond), std::move(Body));
-  } else
-    return LogError(CurTok, "Expected '(' after 'while'");
+  }
+  if (CI->CurTok.type == WHILE) { // FIRST(while_stmt)
+    auto while_stmt = ParseWhileStmt(Hints);
+    if (while_stmt)
+      logProgress(VERBOSE, "Parsed a while statment\n");
+    return while_stmt;
+  } else if (CI->CurTok.type == FOR) { // FIRST(for_stmt)
+    auto for_stmt = ParseForStmt(Hints);
+    if (for_stmt)
+      logProgress(VERBOSE, "Parsed a for statment\n");
+    return for_stmt;
+  }
+  return LogError(CI->CurTok, "Expected 'while' or 'for' after loop hint");
 }
 
 // stmt ::= expr_stmt
 //      |  block
 //      |  if_stmt
-//      |  while_stmt
+//      |  loop_stmt
 //      |  return_stmt
 // Dispatch to appropriate statement parser based on current token
-static std::unique_ptr<ASTnode> ParseStmt() {
+static ASTnode* ParseStmt() {
 
-  if (CurTok.type == NOT || CurTok.type == MINUS || CurTok.type == PLUS ||
-      CurTok.type == LPAR || CurTok.type == IDENT || CurTok.type == BOOL_LIT ||
-      CurTok.type == INT_LIT || CurTok.type == FLOAT_LIT ||
-      CurTok.type == SC) { // FIRST(expr_stmt)
+  if (CI->CurTok.type == NOT || CI->CurTok.type == MINUS || CI->CurTok.type == PLUS ||
+      CI->CurTok.type == LPAR || CI->CurTok.type == IDENT || CI->CurTok.type == BOOL_LIT ||
+      CI->CurTok.type == INT_LIT || CI->CurTok.type == FLOAT_LIT ||
+      CI->CurTok.type == SC) { // FIRST(expr_stmt)
     // expand by stmt ::= expr_stmt
     auto expr_stmt = ParseExperStmt();
-    fprintf(stderr, "Parsed an expression statement\n");
+    logProgress(VERBOSE, "Parsed an expression statement\n");
     return expr_stmt;
-  } else if (CurTok.type == LBRA) { // FIRST(block)
+  } else if (CI->CurTok.type == LBRA) { // FIRST(block)
     auto block_stmt = ParseBlock();
     if (block_stmt) {
-      fprintf(stderr, "Parsed a block\n");
+      logProgress(VERBOSE, "Parsed a block\n");
       return block_stmt;
     }
-  } else if (CurTok.type == IF) { // FIRST(if_stmt)
+  } else if (CI->CurTok.type == IF) { // FIRST(if_stmt)
     auto if_stmt = ParseIfStmt();
     if (if_stmt) {
-      fprintf(stderr, "Parsed an if statment\n");
+      logProgress(VERBOSE, "Parsed an if statment\n");
       return if_stmt;
     }
-  } else if (CurTok.type == WHILE) { // FIRST(while_stmt)
-    auto while_stmt = ParseWhileStmt();
-    if (while_stmt) {
-      fprintf(stderr, "Parsed a while statment\n");
-      return while_stmt;
-    }
-  } else if (CurTok.type == RETURN) { // FIRST(return_stmt)
+  } else if (CI->CurTok.type == WHILE || CI->CurTok.type == FOR ||
+             CI->CurTok.type == PRAGMA) { // FIRST(loop_stmt)
+    return ParseLoopStmt();
+  } else if (CI->CurTok.type == RETURN) { // FIRST(return_stmt)
     auto return_stmt = ParseReturnStmt();
     if (return_stmt) {
-      fprintf(stderr, "Parsed a return statment\n");
+      logProgress(VERBOSE, "Parsed a return statment\n");
       return return_stmt;
     }
   }
   else { // syntax error
-    return LogError(CurTok, "Unexpected token in statement");
+    return LogError(CI->CurTok, "Unexpected token in statement");
   }
   return nullptr;
 }
 
 // stmt_list ::= stmt stmt_list_prime
 // Parse sequence of statements
-static std::vector<std::unique_ptr<ASTnode>> ParseStmtList() {
-  std::vector<std::unique_ptr<ASTnode>> stmt_list; // vector of statements
+static std::vector<ASTnode*> ParseStmtList() {
+  std::vector<ASTnode*> stmt_list; // vector of statements
   auto stmt = ParseStmt();
   if (stmt) {
-    stmt_list.push_back(std::move(stmt));
-  }
-  auto stmt_list_prime = ParseStmtListPrime();
-  for (unsigned i = 0; i < stmt_list_prime.size(); i++) {
-    stmt_list.push_back(std::move(stmt_list_prime.at(i)));
+    stmt_list.push_back(stmt);
   }
+  if (CI->Panicking)
+    synchronize(false);
+  ParseStmtListPrime(stmt_list);
   return stmt_list;
 }
 
 // stmt_list_prime ::= stmt stmt_list_prime
 //                  |  ε
-// Continue parsing statements until end of block
-static std::vector<std::unique_ptr<ASTnode>> ParseStmtListPrime() {
-  std::vector<std::unique_ptr<ASTnode>> stmt_list; // vector of statements
-  if (CurTok.type == NOT || CurTok.type == MINUS || CurTok.type == PLUS ||
-      CurTok.type == LPAR || CurTok.type == IDENT || CurTok.type == BOOL_LIT ||
-      CurTok.type == INT_LIT || CurTok.type == FLOAT_LIT || CurTok.type == SC ||
-      CurTok.type == LBRA || CurTok.type == WHILE || CurTok.type == IF ||
-      CurTok.type == ELSE || CurTok.type == RETURN) { // FIRST(stmt)
+// Continue parsing statements until end of block, appending to stmt_list.
+// Each expansion of stmt_list_prime is one loop iteration, so long blocks
+// take linear time and constant stack.
+static void ParseStmtListPrime(std::vector<ASTnode*>& stmt_list) {
+  while (CI->CurTok.type == NOT || CI->CurTok.type == MINUS || CI->CurTok.type == PLUS ||
+         CI->CurTok.type == LPAR || CI->CurTok.type == IDENT || CI->CurTok.type == BOOL_LIT ||
+         CI->CurTok.type == INT_LIT || CI->CurTok.type == FLOAT_LIT || CI->CurTok.type == SC ||
+         CI->CurTok.type == LBRA || CI->CurTok.type == WHILE || CI->CurTok.type == FOR ||
+         CI->CurTok.type == PRAGMA || CI->CurTok.type == IF || CI->CurTok.type == ELSE ||
+         CI->CurTok.type == RETURN) { // FIRST(stmt)
     // expand by stmt_list ::= stmt stmt_list_prime
     auto stmt = ParseStmt();
     if (stmt) {
-      stmt_list.push_back(std::move(stmt));
-    }
-    auto stmt_prime = ParseStmtListPrime();
-    for (unsigned i = 0; i < stmt_prime.size(); i++) {
-      stmt_list.push_back(std::move(stmt_prime.at(i)));
+      stmt_list.push_back(stmt);
     }
-
-  } else if (CurTok.type == RBRA) { // FOLLOW(stmt_list_prime)
-    // expand by stmt_list_prime ::= ε
-    // do nothing
+    // a statement that fails to parse is dropped and parsing resumes after it
+    if (CI->Panicking)
+      synchronize(false);
   }
-  return stmt_list; // note stmt_list can be empty as we can have empty blocks,
-                    // etc.
+  // otherwise expand by stmt_list_prime ::= ε; FOLLOW(stmt_list_prime) is
+  // '}', which ParseBlock checks for. Note stmt_list can be empty as we can
+  // have empty blocks, etc.
 }
 
 // local_decls_prime ::= local_decl local_decls_prime
 //                    |  ε
-// Parse remaining local declarations in a block
-static std::vector<std::unique_ptr<DeclAST>> ParseLocalDeclsPrime() {
-  std::vector<std::unique_ptr<DeclAST>>
-      local_decls_prime; // vector of local decls
-
-  if (CurTok.type == INT_TOK || CurTok.type == FLOAT_TOK ||
-      CurTok.type == BOOL_TOK) { // FIRST(local_decl)
+// Parse remaining local declarations in a block, appending to local_decls
+static void ParseLocalDeclsPrime(std::vector<DeclAST*>& local_decls) {
+  while (CI->CurTok.type == INT_TOK || CI->CurTok.type == FLOAT_TOK ||
+         CI->CurTok.type == BOOL_TOK) { // FIRST(local_decl)
     auto local_decl = ParseLocalDecl();
     if (local_decl) {
-      local_decls_prime.push_back(std::move(local_decl));
-    }
-    auto prime = ParseLocalDeclsPrime();
-    for (unsigned i = 0; i < prime.size(); i++) {
-      local_decls_prime.push_back(std::move(prime.at(i)));
-    }
-  } else if (CurTok.type == MINUS || CurTok.type == NOT ||
-             CurTok.type == LPAR || CurTok.type == IDENT ||
-             CurTok.type == INT_LIT || CurTok.type == FLOAT_LIT ||
-             CurTok.type == BOOL_LIT || CurTok.type == SC ||
-             CurTok.type == LBRA || CurTok.type == IF || CurTok.type == WHILE ||
-             CurTok.type == RETURN) { // FOLLOW(local_decls_prime)
+      local_decls.push_back(local_decl);
+    }
+    if (CI->Panicking)
+      synchronize(false);
+  }
+
+  if (CI->CurTok.type == MINUS || CI->CurTok.type == NOT ||
+      CI->CurTok.type == LPAR || CI->CurTok.type == IDENT ||
+      CI->CurTok.type == INT_LIT || CI->CurTok.type == FLOAT_LIT ||
+      CI->CurTok.type == BOOL_LIT || CI->CurTok.type == SC ||
+      CI->CurTok.type == LBRA || CI->CurTok.type == IF || CI->CurTok.type == WHILE ||
+      CI->CurTok.type == FOR || CI->CurTok.type == PRAGMA ||
+      CI->CurTok.type == RETURN) { // FOLLOW(local_decls_prime)
     // expand by local_decls_prime ::=  ε
     // do nothing;
   } else {
-    LogError(CurTok, "Expected statement or '}' after local variable declaration");
+    LogError(CI->CurTok, "Expected statement or '}' after local variable declaration");
   }
-
-  return local_decls_prime;
 }
 
 // local_decl ::= var_type IDENT ";"
 //             |  var_type IDENT array_dims ";"
 // Parse local variable or array declaration
-static std::unique_ptr<DeclAST> ParseLocalDecl() {
+static DeclAST* ParseLocalDecl() {
   TOKEN PrevTok;
-  std::string Type;
-  std::string Name = "";
+  TypeKind Type = TY_UNKNOWN;
+  Symbol Name;
 
-  if (CurTok.type == INT_TOK || CurTok.type == FLOAT_TOK ||
-      CurTok.type == BOOL_TOK) { // FIRST(var_type)
-    PrevTok = CurTok;
+  if (CI->CurTok.type == INT_TOK || CI->CurTok.type == FLOAT_TOK ||
+      CI->CurTok.type == BOOL_TOK) { // FIRST(var_type)
+    PrevTok = CI->CurTok;
     getNextToken(); // eat 'int' or 'float or 'bool'
 
-    if (CurTok.type == IDENT) {
-      Type = PrevTok.lexeme;
-      Name = CurTok.getIdentifierStr(); // save the identifier name
+    if (CI->CurTok.type == IDENT) {
+      Type = getTypeKind(PrevTok);
+      Name = CI->CurTok.getIdentifier(); // save the identifier name
       getNextToken(); // eat 'IDENT'
 
       // Check for array declararion: IDENT "[" INT_LIT "]" ...
-      if (CurTok.type == LBOX) {
+      if (CI->CurTok.type == LBOX) {
         std::vector<int> dimensions;
 
         // Parse dimensions: [size1][size2][size3]
-        while (CurTok.type == LBOX) {
+        while (CI->CurTok.type == LBOX) {
           getNextToken(); // eat '['
 
-          if (CurTok.type != INT_LIT) {
-            LogError(CurTok, "Expected integer literal for array dimension");
+          if (CI->CurTok.type != INT_LIT) {
+            LogError(CI->CurTok, "Expected integer literal for array dimension");
             return nullptr;
           }
-          dimensions.push_back(CurTok.getIntVal());
+          dimensions.push_back(CI->CurTok.getIntVal());
           getNextToken(); // eat INT_LIT
 
-          if (CurTok.type != RBOX) {
-            LogError(CurTok, "Expected ']' after array dimension");
+          if (CI->CurTok.type != RBOX) {
+            LogError(CI->CurTok, "Expected ']' after array dimension");
             return nullptr;
           }
           getNextToken(); // eat ']'
         }
 
-        if (CurTok.type != SC) {
-          LogError(CurTok, "Expected ';' after array declaration");
-          return nullptr;
-        }
-        getNextToken(); // eat ';'
+        expectSemicolon("Expected ';' after array declaration");
 
-        fprintf(stderr, "Parsed a local array declaration\n");
-        return std::make_unique<LocalArrayDeclAST>(Name, Type, std::move(dimensions));
+        logProgress(VERBOSE, "Parsed a local array declaration\n");
+        return newNode<LocalArrayDeclAST>(Name, Type, copyToArena(dimensions));
       }
 
       // Regular variable declarations
-      if (CurTok.type != SC) {
-        LogError(CurTok, "Expected ';' to end local variable declaration");
-        return nullptr;
-      }
-      getNextToken(); // eat ';'
-      auto ident = std::make_unique<VariableASTnode>(PrevTok, Name);
-      fprintf(stderr, "Parsed a local variable declaration\n");
-      return std::make_unique<VarDeclAST>(std::move(ident), Type);
+      expectSemicolon("Expected ';' to end local variable declaration");
+      auto ident = newNode<VariableASTnode>(PrevTok, Name);
+      logProgress(VERBOSE, "Parsed a local variable declaration\n");
+      return newNode<VarDeclAST>(ident, Type);
     } else {
-      LogError(CurTok, "Expected identifier in local variable declaration");
+      LogError(CI->CurTok, "Expected identifier in local variable declaration");
       return nullptr;
     }
   }
@@ -2490,30 +3799,30 @@ static std::unique_ptr<DeclAST> ParseLocalDecl() {
 
 // local_decls ::= local_decl local_decls_prime
 // Parse all local declarations at start of block
-static std::vector<std::unique_ptr<DeclAST>> ParseLocalDecls() {
-  std::vector<std::unique_ptr<DeclAST>> local_decls; // vector of local decls
+static std::vector<DeclAST*> ParseLocalDecls() {
+  std::vector<DeclAST*> local_decls; // vector of local decls
 
-  if (CurTok.type == INT_TOK || CurTok.type == FLOAT_TOK ||
-      CurTok.type == BOOL_TOK) { // FIRST(local_decl)
+  if (CI->CurTok.type == INT_TOK || CI->CurTok.type == FLOAT_TOK ||
+      CI->CurTok.type == BOOL_TOK) { // FIRST(local_decl)
 
     auto local_decl = ParseLocalDecl();
     if (local_decl) {
-      local_decls.push_back(std::move(local_decl));
-    }
-    auto local_decls_prime = ParseLocalDeclsPrime();
-    for (unsigned i = 0; i < local_decls_prime.size(); i++) {
-      local_decls.push_back(std::move(local_decls_prime.at(i)));
+      local_decls.push_back(local_decl);
     }
-
-  } else if (CurTok.type == MINUS || CurTok.type == NOT ||
-             CurTok.type == LPAR || CurTok.type == IDENT ||
-             CurTok.type == INT_LIT || CurTok.type == RETURN ||
-             CurTok.type == FLOAT_LIT || CurTok.type == BOOL_LIT ||
-             CurTok.type == COMMA || CurTok.type == LBRA || CurTok.type == IF ||
-             CurTok.type == WHILE) { // FOLLOW(local_decls)
+    if (CI->Panicking)
+      synchronize(false);
+    ParseLocalDeclsPrime(local_decls);
+
+  } else if (CI->CurTok.type == MINUS || CI->CurTok.type == NOT ||
+             CI->CurTok.type == LPAR || CI->CurTok.type == IDENT ||
+             CI->CurTok.type == INT_LIT || CI->CurTok.type == RETURN ||
+             CI->CurTok.type == FLOAT_LIT || CI->CurTok.type == BOOL_LIT ||
+             CI->CurTok.type == COMMA || CI->CurTok.type == LBRA || CI->CurTok.type == IF ||
+             CI->CurTok.type == WHILE || CI->CurTok.type == FOR ||
+             CI->CurTok.type == PRAGMA) { // FOLLOW(local_decls)
                                      // do nothing
   } else {
-    LogError(CurTok, "Expected a statement");
+    LogError(CI->CurTok, "Expected a statement");
   }
 
   return local_decls;
@@ -2521,67 +3830,66 @@ static std::vector<std::unique_ptr<DeclAST>> ParseLocalDecls() {
 
 // block ::= "{" local_decls stmt_list "}"
 // Parse block: local declarations followed by statements
-static std::unique_ptr<ASTnode> ParseBlock() {
-  std::vector<std::unique_ptr<DeclAST>> local_decls; // vector of local decls
-  std::vector<std::unique_ptr<ASTnode>> stmt_list;      // vector of statements
+static ASTnode* ParseBlock() {
+  std::vector<DeclAST*> local_decls; // vector of local decls
+  std::vector<ASTnode*> stmt_list;      // vector of statements
 
   getNextToken(); // eat '{'
 
   local_decls = ParseLocalDecls();
-  fprintf(stderr, "Parsed a set of local variable declaration\n");
+  logProgress(VERBOSE, "Parsed a set of local variable declaration\n");
   stmt_list = ParseStmtList();
-  fprintf(stderr, "Parsed a list of statements\n");
-  if (CurTok.type == RBRA)
+  logProgress(VERBOSE, "Parsed a list of statements\n");
+  if (CI->CurTok.type == RBRA)
     getNextToken(); // eat '}'
   else {            // syntax error
-    LogError(CurTok, "expected '}' to close block");
+    LogError(CI->CurTok, "expected '}' to close block");
     return nullptr;
   }
 
-  return std::make_unique<BlockAST>(std::move(local_decls), std::move(stmt_list));
+  return newNode<BlockAST>(copyToArena(local_decls), copyToArena(stmt_list));
 }
 
 // decl ::= type_spec IDENT ";"
 //       |  type_spec IDENT array_dims ";"
 //       |  type_spec IDENT "(" params ")" block
 // Parse top-level declaration (variable, array or function)
-static std::unique_ptr<ASTnode> ParseDecl() {
-  std::string IdName;
-  std::vector<std::unique_ptr<ParamAST>> param_list;
+static ASTnode* ParseDecl() {
+  Symbol IdName;
+  std::vector<ParamAST*> param_list;
 
-  TOKEN PrevTok = CurTok; // to keep track of the type token
+  TOKEN PrevTok = CI->CurTok; // to keep track of the type token
 
-  if (CurTok.type == VOID_TOK || CurTok.type == INT_TOK ||
-      CurTok.type == FLOAT_TOK || CurTok.type == BOOL_TOK) {
+  if (CI->CurTok.type == VOID_TOK || CI->CurTok.type == INT_TOK ||
+      CI->CurTok.type == FLOAT_TOK || CI->CurTok.type == BOOL_TOK) {
     getNextToken(); // eat the VOID_TOK, INT_TOK, BOOL_TOK or FLOAT_TOK
 
-    IdName = CurTok.getIdentifierStr(); // save the identifier name
-
-    if (CurTok.type == IDENT) {
-      auto ident = std::make_unique<VariableASTnode>(CurTok, IdName);
+    if (CI->CurTok.type == IDENT) {
+      IdName = CI->CurTok.getIdentifier(); // save the identifier name
+      auto ident = newNode<VariableASTnode>(CI->CurTok, IdName);
       getNextToken(); // eat the IDENT
 
       // Check for global array declaration
-      if (CurTok.type == LBOX) {
+      if (CI->CurTok.type == LBOX) {
         std::vector<int> dimensions;
 
-        while (CurTok.type == LBOX) {
+        while (CI->CurTok.type == LBOX) {
           getNextToken(); // eat '['
 
-          if (CurTok.type != INT_LIT) {
-            return LogError(CurTok, "Expected integer literal for array dimension");
+          if (CI->CurTok.type != INT_LIT) {
+            return LogError(CI->CurTok, "Expected integer literal for array dimension");
           }
-          dimensions.push_back(CurTok.getIntVal());
+          dimensions.push_back(CI->CurTok.getIntVal());
           getNextToken(); // eat INT_LIT
 
-          if (CurTok.type != RBOX) {
-            return LogError(CurTok, "Expected ']' after array dimension");
+          if (CI->CurTok.type != RBOX) {
+            return LogError(CI->CurTok, "Expected ']' after array dimension");
           }
           getNextToken(); // eat ']'
         }
 
-        if (CurTok.type != SC) {
-          return LogError(CurTok, "Expected ';' after array declaration");
+        if (CI->CurTok.type != SC) {
+          return LogError(CI->CurTok, "Expected ';' after array declaration");
         }
         getNextToken(); // est ';'
 
@@ -2589,72 +3897,78 @@ static std::unique_ptr<ASTnode> ParseDecl() {
           return LogError(PrevTok, "Cannot have array with type 'void'");
         }
 
-        fprintf(stderr, "Parsed a global array declaration\n");
-        return std::make_unique<GlobalArrayDeclAST>(IdName, PrevTok.lexeme, std::move(dimensions));
+        logProgress(VERBOSE, "Parsed a global array declaration\n");
+        return newNode<GlobalArrayDeclAST>(ident->getLoc(), IdName, getTypeKind(PrevTok),
+                                           copyToArena(dimensions));
       }
 
-      if (CurTok.type == SC) {  // found ';' then this is a global variable declaration.
+      if (CI->CurTok.type == SC) {  // found ';' then this is a global variable declaration.
         getNextToken(); // eat ;
-        fprintf(stderr, "Parsed a variable declaration\n");
+        logProgress(VERBOSE, "Parsed a variable declaration\n");
 
         if (PrevTok.type != VOID_TOK){
-          auto globVar = std::make_unique<GlobVarDeclAST>(std::move(ident), PrevTok.lexeme);
+          auto globVar = newNode<GlobVarDeclAST>(ident, getTypeKind(PrevTok));
           return globVar;
         } else
           return LogError(PrevTok, "Cannot have variable declaration with type 'void'");
-      } else if (CurTok.type == LPAR) { // found '(' then this is a function declaration.
+      } else if (CI->CurTok.type == LPAR) { // found '(' then this is a function declaration.
         getNextToken();  // eat (
 
         auto P = ParseParams(); // parse the parameters, returns a vector of params
-        fprintf(stderr, "Parsed parameter list for function\n");
+        logProgress(VERBOSE, "Parsed parameter list for function\n");
 
-        if (CurTok.type != RPAR) // syntax error
-          return LogError(CurTok, "Expected ')' in function declaration");
+        if (CI->CurTok.type != RPAR) // syntax error
+          return LogError(CI->CurTok, "Expected ')' in function declaration");
 
         getNextToken();          // eat )
-        if (CurTok.type != LBRA) // syntax error
-          return LogError(CurTok, "Expected '{' to start function body");
+        if (CI->CurTok.type != LBRA) // syntax error
+          return LogError(CI->CurTok, "Expected '{' to start function body");
 
         auto B = ParseBlock(); // parse the function body
         if (!B)
           return nullptr;
         else
-          fprintf(stderr, "Parsed block of statements in function\n");
+          logProgress(VERBOSE, "Parsed block of statements in function\n");
 
         // Create a Function prototype
         // Create a Function body, put these to together
-        // and return a std::unique_ptr<FunctionDeclAST>
-        fprintf(stderr, "Parsed a function declaration\n");
-
-        auto Proto = std::make_unique<FunctionPrototypeAST>(IdName, PrevTok.lexeme, std::move(P));
-        auto funcDecl = std::make_unique<FunctionDeclAST>(std::move(Proto), std::move(B));
+        // and return a FunctionDeclAST*
+        logProgress(VERBOSE, "Parsed a function declaration\n");
+
+        auto Proto = newNode<FunctionPrototypeAST>(ident->getLoc(), IdName, getTypeKind(PrevTok),
+                                                   copyToArena(P));
+        // The definition runs from the type token up to the token after its '}'
+        const char* Begin = PrevTok.lexeme.data();
+        auto funcDecl = newNode<FunctionDeclAST>(
+            Proto, B, std::string_view(Begin, CI->CurTok.lexeme.data() - Begin));
         return funcDecl;
       } else
-        return LogError(CurTok, "Expected ';' for variable or '(' for function");
+        return LogError(CI->CurTok, "Expected ';' for variable or '(' for function");
     } else
-      return LogError(CurTok, "Expected an identifier");
+      return LogError(CI->CurTok, "Expected an identifier");
 
   } else
-    LogError(CurTok, "Expected type specifier ('void', 'int', 'float', 'bool')"); // syntax error
+    LogError(CI->CurTok, "Expected type specifier ('void', 'int', 'float', 'bool')"); // syntax error
   return nullptr;
 }
 
 // decl_list_prime ::= decl decl_list_prime
 //                  |  ε
 static void ParseDeclListPrime() {
-  if (CurTok.type == VOID_TOK || CurTok.type == INT_TOK ||
-      CurTok.type == FLOAT_TOK || CurTok.type == BOOL_TOK) { // FIRST(decl)
-
-    if (auto decl = ParseDecl()) {
-      ProgramAST.push_back(std::move(decl));
-      fprintf(stderr, "Parsed a top-level variable or function declaration\n");
+  // expand by decl_list_prime ::= ε at EOF, FOLLOW(decl_list_prime)
+  while (CI->CurTok.type != EOF_TOK) {
+    if (CI->CurTok.type == VOID_TOK || CI->CurTok.type == INT_TOK ||
+        CI->CurTok.type == FLOAT_TOK || CI->CurTok.type == BOOL_TOK) { // FIRST(decl)
+      if (auto decl = ParseDecl()) {
+        CI->ProgramAST.push_back(decl);
+        logProgress(VERBOSE, "Parsed a top-level variable or function declaration\n");
+      }
+    } else { // syntax error
+      LogError(CI->CurTok, "Expected type specifier or end of file (EOF)");
     }
-    ParseDeclListPrime();
-  } else if (CurTok.type == EOF_TOK) { // FOLLOW(decl_list_prime)
-    // expand by decl_list_prime ::= ε
-    // do nothing
-  } else { // syntax error
-    LogError(CurTok, "Expected type specifier or end of file (EOF)");
+    // skip the rest of a declaration that fails to parse
+    if (CI->Panicking)
+      synchronize(true);
   }
 }
 
@@ -2662,59 +3976,61 @@ static void ParseDeclListPrime() {
 static void ParseDeclList() {
   auto decl = ParseDecl();
   if (decl) {
-    ProgramAST.push_back(std::move(decl));
-    fprintf(stderr, "Parsed a top-level variable or function declaration\n");
-    ParseDeclListPrime();
+    CI->ProgramAST.push_back(decl);
+    logProgress(VERBOSE, "Parsed a top-level variable or function declaration\n");
   }
+  if (CI->Panicking)
+    synchronize(true);
+  ParseDeclListPrime();
 }
 
 // extern ::= "extern" type_spec IDENT "(" params ")" ";"
 // Parse extern function declaration
-static std::unique_ptr<FunctionPrototypeAST> ParseExtern() {
-  std::string IdName;
+static FunctionPrototypeAST* ParseExtern() {
+  Symbol IdName;
   TOKEN PrevTok;
 
-  if (CurTok.type == EXTERN) {
+  if (CI->CurTok.type == EXTERN) {
     getNextToken(); // eat the EXTERN
 
-    if (CurTok.type == VOID_TOK || CurTok.type == INT_TOK ||
-        CurTok.type == FLOAT_TOK || CurTok.type == BOOL_TOK) {
+    if (CI->CurTok.type == VOID_TOK || CI->CurTok.type == INT_TOK ||
+        CI->CurTok.type == FLOAT_TOK || CI->CurTok.type == BOOL_TOK) {
 
-      PrevTok = CurTok; // to keep track of the type token
+      PrevTok = CI->CurTok; // to keep track of the type token
       getNextToken();   // eat the VOID_TOK, INT_TOK, BOOL_TOK or FLOAT_TOK
 
-      if (CurTok.type == IDENT) {
-        IdName = CurTok.getIdentifierStr(); // save the identifier name
-        auto ident = std::make_unique<VariableASTnode>(CurTok, IdName);
+      if (CI->CurTok.type == IDENT) {
+        IdName = CI->CurTok.getIdentifier(); // save the identifier name
+        auto ident = newNode<VariableASTnode>(CI->CurTok, IdName);
         getNextToken(); // eat the IDENT
 
-        if (CurTok.type == LPAR) {       // found '(' - this is an extern function declaration.
+        if (CI->CurTok.type == LPAR) {       // found '(' - this is an extern function declaration.
           getNextToken(); // eat (
 
           auto P = ParseParams(); // parse the parameters, returns a vector of params
           if (P.size() == 0)
             return nullptr;
           else
-            fprintf(stderr, "Parsed parameter list for external function\n");
+            logProgress(VERBOSE, "Parsed parameter list for external function\n");
 
-          if (CurTok.type != RPAR) // syntax error
-            return LogErrorP(CurTok, "Expected ')' after extern function parameters");
+          if (CI->CurTok.type != RPAR) // syntax error
+            return LogErrorP(CI->CurTok, "Expected ')' after extern function parameters");
 
           getNextToken(); // eat )
 
-          if (CurTok.type == SC) {
+          if (CI->CurTok.type == SC) {
             getNextToken(); // eat ";"
-            auto Proto = std::make_unique<FunctionPrototypeAST>(
-                IdName, PrevTok.lexeme, std::move(P));
+            auto Proto = newNode<FunctionPrototypeAST>(
+                ident->getLoc(), IdName, getTypeKind(PrevTok), copyToArena(P));
             return Proto;
           } else
-            return LogErrorP(CurTok, "Expected ';' after extern function declaration");
+            return LogErrorP(CI->CurTok, "Expected ';' after extern function declaration");
         } else
-          return LogErrorP(CurTok, "Expected '(' after extern function name");
+          return LogErrorP(CI->CurTok, "Expected '(' after extern function name");
       }
 
     } else
-      LogErrorP(CurTok, "Expected return type in extern function declaration"); // syntax error
+      LogErrorP(CI->CurTok, "Expected return type in extern function declaration"); // syntax error
   }
 
   return nullptr;
@@ -2725,20 +4041,23 @@ static std::unique_ptr<FunctionPrototypeAST> ParseExtern() {
 // Continue parsing extern declarations
 static void ParseExternListPrime() {
 
-  if (CurTok.type == EXTERN) { // FIRST(extern)
+  while (CI->CurTok.type == EXTERN) { // FIRST(extern)
     if (auto Extern = ParseExtern()) {
-      ExternAST.push_back(std::move(Extern));
-      fprintf(stderr,
+      CI->ExternAST.push_back(Extern);
+      logProgress(VERBOSE,
               "Parsed a top-level external function declaration -- 2\n");
     }
-    ParseExternListPrime();
-  } else if (CurTok.type == VOID_TOK || CurTok.type == INT_TOK ||
-             CurTok.type == FLOAT_TOK ||
-             CurTok.type == BOOL_TOK) { // FOLLOW(extern_list_prime)
+    if (CI->Panicking)
+      synchronize(true);
+  }
+
+  if (CI->CurTok.type == VOID_TOK || CI->CurTok.type == INT_TOK ||
+      CI->CurTok.type == FLOAT_TOK ||
+      CI->CurTok.type == BOOL_TOK) { // FOLLOW(extern_list_prime)
     // expand by decl_list_prime ::= ε
     // do nothing
   } else { // syntax error
-    LogError(CurTok, "Expected 'extern' or type specifier");
+    LogError(CI->CurTok, "Expected 'extern' or type specifier");
   }
 }
 
@@ -2747,23 +4066,25 @@ static void ParseExternListPrime() {
 static void ParseExternList() {
   auto Extern = ParseExtern();
   if (Extern) {
-    ExternAST.push_back(std::move(Extern));
-    fprintf(stderr, "Parsed a top-level external function declaration\n");
-    if (CurTok.type == EXTERN)
-      ParseExternListPrime();
+    CI->ExternAST.push_back(Extern);
+    logProgress(VERBOSE, "Parsed a top-level external function declaration\n");
   }
+  if (CI->Panicking)
+    synchronize(true);
+  if (CI->CurTok.type == EXTERN)
+    ParseExternListPrime();
 }
 
 // program ::= extern_list decl_list
 // Main parser entry: parse externs then declarations
 static void parser() {
-  if (CurTok.type == EOF_TOK)
+  if (CI->CurTok.type == EOF_TOK)
     return;
   ParseExternList();
-  if (CurTok.type == EOF_TOK)
+  if (CI->CurTok.type == EOF_TOK)
     return;
   ParseDeclList();
-  if (CurTok.type == EOF_TOK)
+  if (CI->CurTok.type == EOF_TOK)
     return;
 }
 
@@ -2772,112 +4093,1279 @@ static void parser() {
 //===----------------------------------------------------------------------===//
 
 // Function to print the complete AST
-static void PrintAST() {
-  fprintf(stderr, "\n");
-  fprintf(stderr, "==================== COMPLETE AST ====================\n");
-  fprintf(stderr, "\n");
+static void PrintAST(raw_ostream& OS) {
+  OS << "\n";
+  OS << "==================== COMPLETE AST ====================\n";
+  OS << "\n";
   
   // Print extern declarations
-  if (!ExternAST.empty()) {
-    fprintf(stderr, "=== Extern Declarations ===\n");
-    for (size_t i = 0; i < ExternAST.size(); i++) {
-      bool isLast = (i == ExternAST.size() - 1);
-      fprintf(stderr, "%s\n\n", ExternAST[i]->to_string("", isLast).c_str());
+  if (!CI->ExternAST.empty()) {
+    OS << "=== Extern Declarations ===\n";
+    for (size_t i = 0; i < CI->ExternAST.size(); i++) {
+      bool isLast = (i == CI->ExternAST.size() - 1);
+      CI->ExternAST[i]->print(OS, "", isLast);
+      OS << "\n";
     }
   }
   
   // Print top-level declarations
-  if (!ProgramAST.empty()) {
-    fprintf(stderr, "=== Top-Level Declarations ===\n");
-    for (size_t i = 0; i < ProgramAST.size(); i++) {
-      bool isLast = (i == ProgramAST.size() -1);
-      fprintf(stderr, "%s\n", ProgramAST[i]->to_string("", isLast).c_str());
+  if (!CI->ProgramAST.empty()) {
+    OS << "=== Top-Level Declarations ===\n";
+    for (size_t i = 0; i < CI->ProgramAST.size(); i++) {
+      bool isLast = (i == CI->ProgramAST.size() -1);
+      CI->ProgramAST[i]->print(OS, "", isLast);
     }
   }
   
-  fprintf(stderr, "======================================================\n");
-  fprintf(stderr, "\n");
+  OS << "======================================================\n";
+  OS << "\n";
 }
 
 //===----------------------------------------------------------------------===//
-// Main driver code.
+// Optimisation Pipeline
 //===----------------------------------------------------------------------===//
 
-int main(int argc, char **argv) {
-  if (argc == 2) {
-    pFile = fopen(argv[1], "r");
-    if (pFile == NULL)
-      perror("Error opening file");
-  } else {
-    std::cout << "Usage: ./code InputFile\n";
+// Map a numeric -O level onto the backend's code generation levels
+static CodeGenOptLevel getCodeGenOptLevel(unsigned Level) {
+  switch (Level) {
+    case 0: return CodeGenOptLevel::None;
+    case 1: return CodeGenOptLevel::Less;
+    case 2: return CodeGenOptLevel::Default;
+    default: return CodeGenOptLevel::Aggressive;
+  }
+}
+
+// Create a TargetMachine so the optimiser gets real cost models (vector
+// widths, legal types) and the backend can emit code directly. The host is
+// used unless -march picks another architecture. Like clang, the default
+// CPU is generic, so objects run on any machine of the architecture;
+// -mcpu=native tunes for the host CPU and enables every feature it reports.
+static std::unique_ptr<TargetMachine> createTargetMachine(const std::string& March,
+                                                          const std::string& Mcpu,
+                                                          unsigned OptLevel) {
+  Triple TT(sys::getDefaultTargetTriple());
+  std::string Error;
+  const Target* T = TargetRegistry::lookupTarget(March, TT, Error);
+  if (!T) {
+    errs() << "Could not find target: " << Error << "\n";
+    return nullptr;
+  }
+
+  std::string CPU = Mcpu;
+  SubtargetFeatures Features;
+  if (CPU == "native") {
+    CPU = sys::getHostCPUName().str();
+    for (auto& Feature : sys::getHostCPUFeatures())
+      Features.AddFeature(Feature.first(), Feature.second);
+  }
+
+  TargetOptions Options;
+  return std::unique_ptr<TargetMachine>(T->createTargetMachine(
+      TT, CPU, Features.getString(), Options, Reloc::PIC_, std::nullopt,
+      getCodeGenOptLevel(OptLevel)));
+}
+
+// Map a numeric -O level onto the new pass manager's optimisation levels
+static OptimizationLevel getOptimizationLevel(unsigned Level) {
+  switch (Level) {
+    case 0: return OptimizationLevel::O0;
+    case 1: return OptimizationLevel::O1;
+    case 2: return OptimizationLevel::O2;
+    default: return OptimizationLevel::O3;
+  }
+}
+
+// Run the standard new-PM module pipeline for the given -O level over M.
+// Under -time-passes a per-pass timing report headed with ReportName is
+// printed to stderr afterwards.
+static void optimiseModule(Module& M, TargetMachine* TM, unsigned OptLevel,
+                           StringRef ReportName) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  // StandardInstrumentations reads TimePassesIsEnabled when constructed; main
+  // sets it once, before any thread can get here. The report is collected
+  // here rather than printed when SI goes out of scope.
+  std::string Report;
+  raw_string_ostream ReportOS(Report);
+  PassInstrumentationCallbacks PIC;
+  StandardInstrumentations SI(M.getContext(), /*DebugLogging=*/false);
+  SI.registerCallbacks(PIC, &MAM);
+  SI.getTimePasses().setOutStream(ReportOS);
+
+  // Match clang's defaults: vectorisers from -O2, unrolling from -O1
+  PipelineTuningOptions PTO;
+  PTO.LoopUnrolling = OptLevel >= 1;
+  PTO.LoopVectorization = OptLevel >= 2;
+  PTO.SLPVectorization = OptLevel >= 2;
+
+  PassBuilder PB(TM, PTO, std::nullopt, &PIC);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (OptLevel == 0)
+    MPM = PB.buildO0DefaultPipeline(OptimizationLevel::O0);
+  else
+    MPM = PB.buildPerModuleDefaultPipeline(getOptimizationLevel(OptLevel));
+
+  MPM.run(M, MAM);
+
+  // Written in one go, like printTimeReport, so that modules optimised in
+  // parallel do not interleave
+  if (TimePassesIsEnabled) {
+    SI.getTimePasses().print();
+    fputs(("Pass timing report for " + ReportName + ":\n" + ReportOS.str()).str().c_str(), stderr);
+  }
+}
+
+// Optimise each of the modules held as bitcode in Parts on up to Threads
+// threads, leaving the optimised bitcode in its place. LLVMContexts and
+// TargetMachines are not shared between threads, so each part is parsed into
+// a context of its own and gets a TargetMachine of its own. Names label each
+// part's -time-passes report and --time-trace span. Like compileFile, each
+// worker records spans in a profiler of its own, and counts its allocations
+// for -ftime-report, which only sees the calling thread's.
+static void optimiseBitcodeInParallel(MutableArrayRef<SmallVector<char, 0>> Parts,
+                                      ArrayRef<std::string> Names, const std::string& March,
+                                      const std::string& Mcpu, unsigned OptLevel,
+                                      unsigned Threads) {
+  bool TimeTrace = timeTraceProfilerEnabled();
+  std::vector<PhaseStats> PartStats(Parts.size());
+  DefaultThreadPool Pool(hardware_concurrency(Threads));
+  for (size_t i = 0; i < Parts.size(); i++) {
+    Pool.async([&, i, Buffer = &Parts[i]] {
+      uint64_t StartAllocations = NumAllocations;
+      uint64_t StartBytes = BytesAllocated;
+      if (TimeTrace)
+        timeTraceProfilerInitialize(/*TimeTraceGranularity=*/0, "mccomp");
+      {
+        TimeTraceScope Trace("Optimise Partition", Names[i]);
+        LLVMContext Ctx;
+        std::unique_ptr<Module> Part = cantFail(parseBitcodeFile(
+            MemoryBufferRef(StringRef(Buffer->data(), Buffer->size()), "partition"), Ctx));
+        std::unique_ptr<TargetMachine> TM = createTargetMachine(March, Mcpu, OptLevel);
+        optimiseModule(*Part, TM.get(), OptLevel, Names[i]);
+        Buffer->clear();
+        raw_svector_ostream OS(*Buffer);
+        WriteBitcodeToFile(*Part, OS, /*ShouldPreserveUseListOrder=*/true);
+      }
+      if (TimeTrace)
+        timeTraceProfilerFinishThread();
+      PartStats[i].Allocations = NumAllocations - StartAllocations;
+      PartStats[i].Bytes = BytesAllocated - StartBytes;
+    });
+  }
+  Pool.wait();
+  for (const PhaseStats& Stats : PartStats) {
+    CI->Phases[PHASE_OPTIMISE].Allocations += Stats.Allocations;
+    CI->Phases[PHASE_OPTIMISE].Bytes += Stats.Bytes;
+  }
+}
+
+// Optimise M on up to Threads threads. M is split into that many partitions
+// of whole functions, each partition is optimised in its own LLVMContext, and
+// the results are linked back into one module in M's context. Only the IR
+// pipeline runs in parallel: -c and -S write a single file, and the objects
+// of separate partitions could only be joined by a linker, so the backend
+// emits the relinked module on one thread. A partition
+// only sees the bodies of its own functions, so calls between partitions are
+// not inlined; in exchange the pipeline runs on every thread at once.
+static std::unique_ptr<Module> optimiseModuleInParallel(std::unique_ptr<Module> M,
+                                                        const std::string& March,
+                                                        const std::string& Mcpu,
+                                                        unsigned OptLevel, StringRef ReportName,
+                                                        unsigned Threads) {
+  // Partitions move between contexts as in-memory bitcode
+  std::vector<SmallVector<char, 0>> Parts;
+  std::vector<std::string> Names;
+  SplitModule(*M, Threads, [&](std::unique_ptr<Module> Part) {
+    Names.push_back((ReportName + " (partition " + Twine(Parts.size()) + ")").str());
+    Parts.emplace_back();
+    raw_svector_ostream OS(Parts.back());
+    WriteBitcodeToFile(*Part, OS);
+  }, /*PreserveLocals=*/false, /*RoundRobin=*/true);
+  optimiseBitcodeInParallel(Parts, Names, March, Mcpu, OptLevel, Threads);
+
+  // Link in partition order so the output does not depend on scheduling
+  auto Linked = std::make_unique<Module>(M->getModuleIdentifier(), M->getContext());
+  Linked->setTargetTriple(M->getTargetTriple());
+  Linked->setDataLayout(M->getDataLayout());
+  Linker L(*Linked);
+  for (SmallVector<char, 0>& Buffer : Parts) {
+    std::unique_ptr<Module> Part = cantFail(parseBitcodeFile(
+        MemoryBufferRef(StringRef(Buffer.data(), Buffer.size()), "partition"), M->getContext()));
+    if (L.linkInModule(std::move(Part)))
+      report_fatal_error("failed to link the optimised partitions");
+  }
+  return Linked;
+}
+
+// The attribute Name of loop ID, e.g. !{!"llvm.loop.unroll.count", i32 4}
+static MDNode* findLoopAttribute(MDNode* LoopID, StringRef Name) {
+  for (const MDOperand& Op : drop_begin(LoopID->operands())) {
+    auto* Attr = dyn_cast<MDNode>(Op);
+    if (Attr && Attr->getNumOperands()) {
+      auto* AttrName = dyn_cast<MDString>(Attr->getOperand(0));
+      if (AttrName && AttrName->getString() == Name)
+        return Attr;
+    }
+  }
+  return nullptr;
+}
+
+// -Rloop-hints: say for each loop hint whether the optimised module M shows
+// it was followed. The copies of a hinted loop keep its minic.loop.hint
+// marker, and the passes mark the loops they transform: the unroller with
+// llvm.loop.unroll.disable, the vectoriser with llvm.loop.isvectorized. A
+// loop that was fully unrolled is gone altogether.
+static void reportLoopHints(const Module& M) {
+  std::map<std::pair<StringRef, uint64_t>, SmallVector<MDNode*, 2>> Copies;
+  for (const Function& F : M) {
+    for (const BasicBlock& BB : F) {
+      const Instruction* Term = BB.getTerminator();
+      MDNode* LoopID = Term ? Term->getMetadata(LLVMContext::MD_loop) : nullptr;
+      MDNode* Marker = LoopID ? findLoopAttribute(LoopID, "minic.loop.hint") : nullptr;
+      if (!Marker)
+        continue;
+      uint64_t Index = mdconst::extract<ConstantInt>(Marker->getOperand(1))->getZExtValue();
+      SmallVector<MDNode*, 2>& IDs = Copies[{F.getName(), Index}];
+      if (!is_contained(IDs, LoopID)) // a loop may have several latches
+        IDs.push_back(LoopID);
+    }
+  }
+
+  // Written in one go, like the diagnostics
+  std::string Report;
+  for (const LoopHintSite& Site : CI->HintedLoops) {
+    ArrayRef<MDNode*> IDs = Copies[{Site.Function, Site.Index}];
+    auto anyCopyHas = [&](StringRef Attr) {
+      return any_of(IDs, [&](MDNode* ID) { return findLoopAttribute(ID, Attr); });
+    };
+    auto remark = [&](SourceLoc Loc, bool Unroll, bool Honoured, const char* Why) {
+      if (CI->Diags.ShowFileName)
+        Report += CI->Diags.FileName + ":";
+      Report += std::to_string(Loc.Line) + ":" + std::to_string(Loc.Col) + " Remark: '#pragma " +
+                getLoopHintSpelling(Site.Hints, Unroll) + "' " +
+                (Honoured ? "honoured: " : "not honoured: ") + Why + "\n";
+    };
+
+    const LoopHints& H = Site.Hints;
+    if (H.Unroll != LoopHints::NONE) {
+      bool Unrolled = IDs.empty() ||
+                      all_of(IDs, [](MDNode* ID) {
+                        return findLoopAttribute(ID, "llvm.loop.unroll.disable");
+                      });
+      if (H.Unroll == LoopHints::DISABLE && IDs.empty())
+        remark(H.UnrollLoc, true, false, "loop removed by the optimiser");
+      else if (H.Unroll == LoopHints::DISABLE)
+        remark(H.UnrollLoc, true, true, "loop not unrolled");
+      else if (IDs.empty())
+        remark(H.UnrollLoc, true, true, "loop fully unrolled");
+      else
+        remark(H.UnrollLoc, true, Unrolled, Unrolled ? "loop unrolled" : "loop not unrolled");
+    }
+    if (H.Vectorize != LoopHints::NONE) {
+      bool Vectorized = anyCopyHas("llvm.loop.isvectorized");
+      bool Honoured = Vectorized == (H.Vectorize == LoopHints::ENABLE);
+      if (IDs.empty())
+        remark(H.VectorizeLoc, false, false, "loop removed by the optimiser");
+      else
+        remark(H.VectorizeLoc, false, Honoured, Vectorized ? "loop vectorized" : "loop not vectorized");
+    }
+  }
+  fputs(Report.c_str(), stderr);
+}
+
+//===----------------------------------------------------------------------===//
+// Function Cache
+//===----------------------------------------------------------------------===//
+
+/// FunctionCache - On-disk store of optimised functions (--cache-dir). Each
+/// entry is the bitcode of a module holding one optimised function, filed
+/// under a key that covers everything that optimised form depends on, so an
+/// entry is never stale and is never invalidated, only left unused.
+class FunctionCache {
+  std::string Dir;
+
+  std::string getPath(StringRef Key) const { return Dir + "/" + Key.str() + ".bc"; }
+
+public:
+  unsigned Hits = 0;
+  unsigned Misses = 0;
+
+  explicit FunctionCache(std::string Dir) : Dir(std::move(Dir)) {}
+
+  // The bitcode filed under Key, or null on a miss
+  std::unique_ptr<MemoryBuffer> lookup(StringRef Key) const {
+    auto BufOrErr = MemoryBuffer::getFile(getPath(Key));
+    if (!BufOrErr)
+      return nullptr;
+    return std::move(*BufOrErr);
+  }
+
+  // File M under Key. The bitcode goes to a temporary file that is renamed
+  // into place, so a compiler running in parallel never reads half an entry.
+  // A failed write only means a miss next time.
+  void store(StringRef Key, const Module& M) const {
+    SmallString<128> TempPath;
+    int FD;
+    if (sys::fs::createUniqueFile(Dir + "/%%%%%%%%%%%%.tmp", FD, TempPath))
+      return;
+    bool Written;
+    {
+      raw_fd_ostream OS(FD, /*shouldClose=*/true);
+      // Keep use-list order so a hit prints exactly like the original
+      WriteBitcodeToFile(M, OS, /*ShouldPreserveUseListOrder=*/true);
+      OS.close();
+      Written = !OS.has_error();
+      OS.clear_error();
+    }
+    if (!Written || sys::fs::rename(TempPath, getPath(Key)))
+      sys::fs::remove(TempPath);
+  }
+};
+
+// Everything besides the function body that shapes the optimised code: the
+// compiler build, the -O level, flags that change the IR and the target. The build time stands in for
+// a version, so a rebuilt mccomp never reuses entries from an older one.
+static std::string getCacheSettings(const Module& M, const TargetMachine* TM,
+                                    unsigned OptLevel, StringRef CodegenFlags) {
+  std::string Settings = "mccomp " __DATE__ " " __TIME__ " LLVM " LLVM_VERSION_STRING;
+  Settings += " -O" + std::to_string(OptLevel);
+  Settings += CodegenFlags;
+  Settings += " " + M.getDataLayoutStr();
+  if (TM)
+    Settings += " " + TM->getTargetTriple().str() + " " + TM->getTargetCPU().str() + " " +
+                TM->getTargetFeatureString().str();
+  return Settings;
+}
+
+// Every function and global variable F refers to, in order of first use.
+// Constant expressions are looked through, as a global's address can be
+// folded into one.
+static SmallVector<GlobalValue*, 8> getReferencedGlobals(Function& F) {
+  SmallSetVector<GlobalValue*, 8> Refs;
+  SmallVector<const Constant*, 8> Worklist;
+  for (Instruction& I : instructions(F)) {
+    for (Value* Op : I.operands()) {
+      if (auto* C = dyn_cast<Constant>(Op))
+        Worklist.push_back(C);
+    }
+    while (!Worklist.empty()) {
+      const Constant* C = Worklist.pop_back_val();
+      if (auto* GV = dyn_cast<GlobalValue>(C))
+        Refs.insert(const_cast<GlobalValue*>(GV));
+      else
+        for (const Use& Op : C->operands())
+          Worklist.push_back(cast<Constant>(Op));
+    }
+  }
+  return SmallVector<GlobalValue*, 8>(Refs.begin(), Refs.end());
+}
+
+// Cache key for F: a hash of the settings, F's tokens (from Source) and the
+// name and type of every global it refers to, which covers the prototypes it
+// calls and the globals it reads
+static std::string getFunctionCacheKey(StringRef Settings, std::string_view Source,
+                                       ArrayRef<GlobalValue*> Refs) {
+  MD5 Hash;
+  Hash.update(Settings);
+  Hash.update(StringRef("", 1));
+  hashTokens(Source, Hash);
+  for (GlobalValue* GV : Refs) {
+    std::string Type;
+    raw_string_ostream OS(Type);
+    GV->getValueType()->print(OS);
+    Hash.update(GV->getName());
+    Hash.update(StringRef("", 1));
+    Hash.update(OS.str());
+    Hash.update(StringRef("", 1));
+  }
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str().str();
+}
+
+// Copy F into a module of its own, in which everything else it refers to is
+// only declared
+static std::unique_ptr<Module> extractFunction(Function& F, ArrayRef<GlobalValue*> Refs) {
+  Module& M = *F.getParent();
+  auto Part = std::make_unique<Module>(F.getName(), M.getContext());
+  Part->setTargetTriple(M.getTargetTriple());
+  Part->setDataLayout(M.getDataLayout());
+
+  ValueToValueMapTy VMap;
+  for (GlobalValue* GV : Refs) {
+    if (GV == &F)
+      continue;
+    if (auto* Callee = dyn_cast<Function>(GV))
+      VMap[GV] = Function::Create(Callee->getFunctionType(), GlobalValue::ExternalLinkage,
+                                  Callee->getName(), Part.get());
+    else
+      VMap[GV] = new GlobalVariable(*Part, GV->getValueType(), /*isConstant=*/false,
+                                    GlobalValue::ExternalLinkage, nullptr, GV->getName());
+  }
+
+  Function* NewF = Function::Create(F.getFunctionType(), F.getLinkage(), F.getName(), Part.get());
+  VMap[&F] = NewF;
+  Function::arg_iterator NewArg = NewF->arg_begin();
+  for (Argument& Arg : F.args()) {
+    NewArg->setName(Arg.getName());
+    VMap[&Arg] = &*NewArg++;
+  }
+  SmallVector<ReturnInst*, 4> Returns;
+  CloneFunctionInto(NewF, &F, VMap, CloneFunctionChangeType::DifferentModule, Returns);
+
+  // Cloning into another module adds an empty llvm.dbg.cu list, which
+  // bitcode does not keep; drop it so a hit links the same module as a miss
+  if (NamedMDNode* CUs = Part->getNamedMetadata("llvm.dbg.cu"))
+    if (CUs->getNumOperands() == 0)
+      Part->eraseNamedMetadata(CUs);
+  return Part;
+}
+
+// Optimise M one function at a time, taking each function from Cache when an
+// earlier run has already optimised it and filing the rest there. Sources maps
+// each function to its definition in the input, for the key. Like
+// optimiseModuleInParallel this optimises functions without their callees'
+// bodies, so nothing is inlined across functions; that is what makes a
+// function's optimised form independent of edits elsewhere in the file.
+// With Threads above 1 the misses are optimised on a thread pool, as
+// optimiseModuleInParallel optimises its partitions.
+static std::unique_ptr<Module> optimiseModuleWithCache(std::unique_ptr<Module> M,
+                                                       TargetMachine* TM, const std::string& March,
+                                                       const std::string& Mcpu, unsigned OptLevel,
+                                                       unsigned Threads, StringRef ReportName,
+                                                       FunctionCache& Cache,
+                                                       const StringMap<std::string_view>& Sources,
+                                                       StringRef CodegenFlags) {
+  std::string Settings = getCacheSettings(*M, TM, OptLevel, CodegenFlags);
+  std::vector<std::unique_ptr<Module>> Parts;
+  // Misses left for the thread pool: their place in Parts, key and bitcode
+  std::vector<size_t> MissSlots;
+  std::vector<std::string> MissKeys, MissNames;
+  std::vector<SmallVector<char, 0>> MissBitcode;
+  for (Function& F : *M) {
+    if (F.isDeclaration())
+      continue;
+    SmallVector<GlobalValue*, 8> Refs = getReferencedGlobals(F);
+    std::string Key = getFunctionCacheKey(Settings, Sources.lookup(F.getName()), Refs);
+
+    if (std::unique_ptr<MemoryBuffer> Buffer = Cache.lookup(Key)) {
+      Expected<std::unique_ptr<Module>> Part = parseBitcodeFile(*Buffer, M->getContext());
+      if (Part) {
+        Cache.Hits++;
+        Parts.push_back(std::move(*Part));
+        continue;
+      }
+      consumeError(Part.takeError()); // unreadable entry: recompile and overwrite it
+    }
+
+    Cache.Misses++;
+    std::unique_ptr<Module> Part = extractFunction(F, Refs);
+    std::string Name = (ReportName + " (" + F.getName() + ")").str();
+    if (Threads > 1) {
+      MissSlots.push_back(Parts.size());
+      MissKeys.push_back(std::move(Key));
+      MissNames.push_back(std::move(Name));
+      MissBitcode.emplace_back();
+      raw_svector_ostream OS(MissBitcode.back());
+      WriteBitcodeToFile(*Part, OS, /*ShouldPreserveUseListOrder=*/true);
+      Parts.emplace_back();
+      continue;
+    }
+    optimiseModule(*Part, TM, OptLevel, Name);
+    Cache.store(Key, *Part);
+    Parts.push_back(std::move(Part));
+  }
+
+  if (!MissBitcode.empty()) {
+    optimiseBitcodeInParallel(MissBitcode, MissNames, March, Mcpu, OptLevel,
+                              std::min<size_t>(Threads, MissBitcode.size()));
+    for (size_t i = 0; i < MissBitcode.size(); i++) {
+      std::unique_ptr<Module>& Part = Parts[MissSlots[i]];
+      Part = cantFail(parseBitcodeFile(
+          MemoryBufferRef(StringRef(MissBitcode[i].data(), MissBitcode[i].size()), "partition"),
+          M->getContext()));
+      Cache.store(MissKeys[i], *Part);
+    }
+  }
+
+  // M keeps the global variables; the bodies come from the parts
+  for (Function& F : *M) {
+    if (!F.isDeclaration())
+      F.deleteBody();
+  }
+  Linker L(*M);
+  for (std::unique_ptr<Module>& Part : Parts) {
+    if (L.linkInModule(std::move(Part)))
+      report_fatal_error("failed to link the cached functions");
+  }
+  return M;
+}
+
+//===----------------------------------------------------------------------===//
+// Output Emission
+//===----------------------------------------------------------------------===//
+
+// What the driver writes once the module has been optimised
+enum OutputKind {
+  EMIT_LLVM_IR, // textual IR (default)
+  EMIT_LLVM_BC, // -emit-llvm-bc
+  EMIT_ASM,     // -S
+  EMIT_OBJ      // -c
+};
+
+// File name extension for each output kind
+static const char* getOutputExtension(OutputKind Kind) {
+  switch (Kind) {
+    case EMIT_LLVM_BC: return ".bc";
+    case EMIT_ASM: return ".s";
+    case EMIT_OBJ: return ".o";
+    default: return ".ll";
+  }
+}
+
+// Output file name when -o is not given: output.ll (.bc/.s/.o) for a single
+// input, or the input's stem with the same extension for each of several
+static std::string getDefaultOutputName(OutputKind Kind, StringRef InputFile,
+                                        bool MultipleInputs) {
+  StringRef Stem = MultipleInputs ? sys::path::stem(InputFile) : StringRef("output");
+  return (Stem + getOutputExtension(Kind)).str();
+}
+
+// Write M to Filename in the requested form. Assembly and object files are
+// produced in-process by the TargetMachine's code generator, so no second
+// tool has to re-parse the IR.
+static bool emitModule(Module& M, TargetMachine* TM, OutputKind Kind,
+                       const std::string& Filename) {
+  std::error_code EC;
+  sys::fs::OpenFlags Flags = (Kind == EMIT_LLVM_IR || Kind == EMIT_ASM)
+                                 ? sys::fs::OF_Text
+                                 : sys::fs::OF_None;
+  raw_fd_ostream dest(Filename, EC, Flags);
+  if (EC) {
+    errs() << "Could not open file: " << EC.message() << "\n";
+    return false;
+  }
+
+  switch (Kind) {
+    case EMIT_LLVM_IR:
+      M.print(dest, nullptr);
+      break;
+    case EMIT_LLVM_BC:
+      WriteBitcodeToFile(M, dest);
+      break;
+    case EMIT_ASM:
+    case EMIT_OBJ: {
+      if (!TM) {
+        errs() << "No target machine available to emit " << Filename << "\n";
+        return false;
+      }
+      legacy::PassManager CodeGenPasses;
+      CodeGenFileType FileType = (Kind == EMIT_OBJ) ? CodeGenFileType::ObjectFile
+                                                    : CodeGenFileType::AssemblyFile;
+      if (TM->addPassesToEmitFile(CodeGenPasses, dest, nullptr, FileType)) {
+        errs() << "Target machine cannot emit a file of this type\n";
+        return false;
+      }
+      CodeGenPasses.run(M);
+      break;
+    }
+  }
+
+  dest.flush();
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// JIT Execution
+//===----------------------------------------------------------------------===//
+
+static ExitOnError ExitOnErr("mccomp: ");
+
+// Runtime library for JIT-compiled programs, behaving like the test drivers
+extern "C" int mccomp_print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" float mccomp_print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+// Built-in symbols resolved before falling back to the mccomp process itself
+struct RuntimeSymbol {
+  const char* Name;
+  void* Address;
+};
+
+static const RuntimeSymbol RuntimeSymbols[] = {
+    {"print_int", (void*)&mccomp_print_int},
+    {"print_float", (void*)&mccomp_print_float},
+};
+
+// Name of the nullary wrapper that --run calls into
+static const char* JITEntryWrapperName = "__mccomp_run";
+
+// Build a nullary function that calls Entry with Args converted to its
+// parameter types. A bool result is widened to int so the host can read it
+// back through a plain C function pointer.
+static Function* createEntryWrapper(Module& M, Function* Entry,
+                                    const std::vector<std::string>& Args) {
+  if (Entry->arg_size() != Args.size()) {
+    errs() << "Entry function '" << Entry->getName() << "' takes "
+           << Entry->arg_size() << " argument(s), " << Args.size() << " given\n";
+    return nullptr;
+  }
+
+  std::vector<Value*> ArgVals;
+  auto ArgIt = Entry->arg_begin();
+  for (unsigned i = 0; i < Args.size(); ++i, ++ArgIt) {
+    Type* T = ArgIt->getType();
+    StringRef A = Args[i];
+    // The whole argument must parse, and fit the parameter's type
+    int32_t IntVal;
+    double FloatVal;
+    const char* Expected = nullptr;
+    if (T->isIntegerTy(32)) {
+      if (!A.getAsInteger(10, IntVal))
+        ArgVals.push_back(ConstantInt::get(T, IntVal, true));
+      else
+        Expected = "int";
+    } else if (T->isFloatTy()) {
+      if (!A.getAsDouble(FloatVal) && std::isfinite(float(FloatVal)))
+        ArgVals.push_back(ConstantFP::get(T, float(FloatVal)));
+      else
+        Expected = "float";
+    } else if (T->isIntegerTy(1)) {
+      if (A == "true" || A == "1" || A == "false" || A == "0")
+        ArgVals.push_back(ConstantInt::get(T, A == "true" || A == "1"));
+      else
+        Expected = "bool";
+    } else {
+      errs() << "Argument " << i << " of '" << Entry->getName()
+             << "' cannot be passed from the command line\n";
+      return nullptr;
+    }
+    if (Expected) {
+      errs() << "Argument " << i << " ('" << A << "') is not a valid " << Expected << "\n";
+      return nullptr;
+    }
+  }
+
+  Type* RetType = Entry->getReturnType();
+  Type* WrapperRetType = RetType->isIntegerTy(1) ? Type::getInt32Ty(M.getContext())
+                                                 : RetType;
+  Function* Wrapper = Function::Create(FunctionType::get(WrapperRetType, false),
+                                       Function::ExternalLinkage,
+                                       JITEntryWrapperName, &M);
+  IRBuilder<> B(BasicBlock::Create(M.getContext(), "entry", Wrapper));
+  Value* Result = B.CreateCall(Entry, ArgVals);
+  if (RetType->isVoidTy())
+    B.CreateRetVoid();
+  else if (RetType->isIntegerTy(1))
+    B.CreateRet(B.CreateZExt(Result, WrapperRetType));
+  else
+    B.CreateRet(Result);
+  return Wrapper;
+}
+
+// Compile M in memory with ORC LLJIT and call EntryName with Args. Externs
+// are resolved from RuntimeSymbols first and then from the current process.
+// Start is when the driver began, used to report compile-to-first-result latency.
+static int runWithJIT(std::unique_ptr<Module> M, std::unique_ptr<LLVMContext> Ctx,
+                      const std::string& EntryName,
+                      const std::vector<std::string>& Args,
+                      std::chrono::steady_clock::time_point Start) {
+  Function* Entry = M->getFunction(EntryName);
+  if (!Entry || Entry->isDeclaration()) {
+    errs() << "Entry function '" << EntryName << "' is not defined\n";
+    return 1;
+  }
+  Type* RetType = Entry->getReturnType();
+  if (!createEntryWrapper(*M, Entry, Args))
     return 1;
+
+  auto J = ExitOnErr(orc::LLJITBuilder().create());
+  orc::JITDylib& MainJD = J->getMainJITDylib();
+
+  orc::SymbolMap Runtime;
+  for (const RuntimeSymbol& RS : RuntimeSymbols)
+    Runtime[J->mangleAndIntern(RS.Name)] = orc::ExecutorSymbolDef(
+        orc::ExecutorAddr::fromPtr(RS.Address),
+        JITSymbolFlags::Exported | JITSymbolFlags::Callable);
+  ExitOnErr(MainJD.define(orc::absoluteSymbols(std::move(Runtime))));
+  MainJD.addGenerator(ExitOnErr(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      J->getDataLayout().getGlobalPrefix())));
+
+  ExitOnErr(J->addIRModule(orc::ThreadSafeModule(std::move(M), std::move(Ctx))));
+  auto WrapperSym = ExitOnErr(J->lookup(JITEntryWrapperName));
+
+  // Call through a pointer matching the wrapper's return type
+  if (RetType->isFloatTy()) {
+    float Result = WrapperSym.toPtr<float (*)()>()();
+    printf("Result: %f\n", Result);
+  } else if (RetType->isVoidTy()) {
+    WrapperSym.toPtr<void (*)()>()();
+    printf("Result: void\n");
+  } else {
+    int Result = WrapperSym.toPtr<int (*)()>()();
+    printf("Result: %d\n", Result);
+  }
+
+  double LatencyMs = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - Start).count();
+  logProgress(NORMAL, "Compile-to-first-result latency: %.3f ms\n", LatencyMs);
+  return 0;
+}
+
+//===----------------------------------------------------------------------===//
+// Main driver code.
+//===----------------------------------------------------------------------===//
+
+// Lex the whole input without parsing and report token count and throughput
+// (used by bench/lexer.sh)
+static int lexOnly() {
+  auto Start = std::chrono::steady_clock::now();
+  size_t NumTokens = 0;
+  while (gettok().type != EOF_TOK)
+    NumTokens++;
+  double Secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  double MBytes = CI->SourceBuffer->getBufferSize() / (1024.0 * 1024.0);
+  fprintf(stderr, "Lexed %zu tokens (%.2f MB) in %.3f ms: %.1f MB/s, %.1f Mtokens/s, peak RSS %.1f MB\n",
+          NumTokens, MBytes, Secs * 1000, MBytes / Secs, NumTokens / Secs / 1e6, getPeakRSSMB());
+  return 0;
+}
+
+// Options collected from the command line
+struct DriverOptions {
+  std::vector<std::string> InputFiles;
+  std::string OutputFile;            // -o, single input only; defaults per output kind
+  OutputKind Emit = EMIT_LLVM_IR;    // -c, -S, -emit-llvm-bc
+  std::string March;                 // -march, empty selects the host
+  std::string Mcpu = "generic";      // -mcpu, "native" for the host CPU
+  unsigned OptLevel = 0;             // -O0 .. -O3
+  bool TimePasses = false;           // -time-passes
+  bool NoAliasArrayParams = false;   // -fno-alias-array-params
+  bool BoundsCheck = false;          // -fbounds-check
+  bool RemarkLoopHints = false;      // -Rloop-hints
+  unsigned Jobs = 0;                 // -j, inputs compiled at once, 0 for one per core
+  unsigned CodegenThreads = 1;       // --codegen-threads, 0 for one per core
+  std::string CacheDir;              // --cache-dir or --cache, empty for no cache
+  bool Run = false;                  // --run: JIT and execute instead of emitting
+  std::string Entry = "main";        // --entry, function called by --run
+  std::vector<std::string> RunArgs;  // arguments after "--" passed to the entry
+  bool LexOnly = false;              // --lex-only: lexer benchmark mode
+  bool SyntaxOnly = false;           // -fsyntax-only: stop after parsing
+  bool DumpAST = false;              // --dump-ast: print the AST to stderr
+  bool DumpIR = false;               // --dump-ir: print the final IR to stderr
+  unsigned MaxErrors = 20;           // --max-errors
+  bool JSONDiagnostics = false;      // -fdiagnostics-format=json
+  bool TimeReport = false;           // -ftime-report
+  bool TimeTrace = false;            // --time-trace
+  std::string TimeTraceFile;         // --time-trace=, empty until main picks a default
+};
+
+// The options that change the IR generated for a function, as flags
+static std::string getCodegenFlags(const DriverOptions& Opts) {
+  std::string Flags;
+  if (Opts.NoAliasArrayParams)
+    Flags += " -fno-alias-array-params";
+  if (Opts.BoundsCheck)
+    Flags += " -fbounds-check";
+  if (Opts.RemarkLoopHints)
+    Flags += " -Rloop-hints"; // marks the hinted loops
+  return Flags;
+}
+
+static void printUsage() {
+  std::cout << "Usage: ./mccomp [options] InputFile...\n"
+            << "Options:\n"
+            << "  -O0, -O1, -O2, -O3   Optimisation level (default -O0)\n"
+            << "  -time-passes         Report time spent in each optimisation pass\n"
+            << "  -fno-alias-array-params\n"
+            << "                       Assume array parameters never overlap each other or\n"
+            << "                       globals, like C restrict, so loops over them vectorise\n"
+            << "  -fbounds-check       Trap on out-of-range array indices\n"
+            << "  -Rloop-hints         Report whether each #pragma unroll or vectorize was\n"
+            << "                       honoured by the optimiser\n"
+            << "  -ftime-report        Report time and heap allocations of each compiler phase\n"
+            << "  --time-trace[=<file>]\n"
+            << "                       Write a Chrome trace of phases, functions and passes\n"
+            << "                       (default <output stem>.json, or mccomp-trace.json)\n"
+            << "  -c                   Emit an object file\n"
+            << "  -S                   Emit an assembly file\n"
+            << "  -emit-llvm-bc        Emit an LLVM bitcode file\n"
+            << "  -o <file>            Output file (default output.ll/.bc/.s/.o, or\n"
+            << "                       <input stem>.ll etc. for each of several inputs)\n"
+            << "  -j <n>               Compile up to n input files at once (default one per core)\n"
+            << "  --codegen-threads=<n>\n"
+            << "                       Optimise the functions of each file on n threads, 0 for\n"
+            << "                       one per core (default 1; -O1 and above). The backend\n"
+            << "                       (-c, -S) still runs on one thread\n"
+            << "  --cache-dir=<dir>    Reuse functions optimised by earlier runs from dir\n"
+            << "                       (-O1 and above); with --codegen-threads the misses\n"
+            << "                       are optimised on that many threads\n"
+            << "  --cache              Same as --cache-dir=<user cache directory>/mccomp\n"
+            << "  -march=<arch>        Target architecture (default host)\n"
+            << "  -mcpu=<cpu>          Target CPU (default generic; native for the host's, with\n"
+            << "                       all its features)\n"
+            << "  --run                JIT-compile and run the program in-process\n"
+            << "  --entry=<function>   Function called by --run (default main)\n"
+            << "  -- <args>...         Arguments passed to the entry function\n"
+            << "  --lex-only           Only run the lexer and report its throughput\n"
+            << "  -fsyntax-only        Only parse, then report parse time and AST size\n"
+            << "  -q                   Quiet: only report errors\n"
+            << "  -v                   Verbose: trace parsing and code generation\n"
+            << "  --max-errors=<n>     Stop after n errors per file, 0 for no limit (default 20)\n"
+            << "  -fdiagnostics-format=<text|json>\n"
+            << "                       Print errors as text lines on stderr or as one JSON\n"
+            << "                       array on stdout\n"
+            << "  --dump-ast           Print the AST to stderr\n"
+            << "  --dump-ir            Print the final IR to stderr\n";
+}
+
+// Parse argv into Opts. Returns false on a malformed command line.
+static bool parseCommandLine(int argc, char** argv, DriverOptions& Opts) {
+  for (int i = 1; i < argc; i++) {
+    std::string Arg = argv[i];
+    if (Arg.size() == 3 && Arg[0] == '-' && Arg[1] == 'O' &&
+        Arg[2] >= '0' && Arg[2] <= '3') {
+      Opts.OptLevel = Arg[2] - '0';
+    } else if (Arg == "-time-passes" || Arg == "--time-passes") {
+      Opts.TimePasses = true;
+    } else if (Arg == "-fno-alias-array-params") {
+      Opts.NoAliasArrayParams = true;
+    } else if (Arg == "-fbounds-check") {
+      Opts.BoundsCheck = true;
+    } else if (Arg == "-Rloop-hints") {
+      Opts.RemarkLoopHints = true;
+    } else if (Arg == "-ftime-report") {
+      Opts.TimeReport = true;
+    } else if (Arg == "--time-trace" || Arg.rfind("--time-trace=", 0) == 0) {
+      // An empty name is filled in once the output file is known
+      Opts.TimeTraceFile = Arg.size() > 13 ? Arg.substr(13) : "";
+      Opts.TimeTrace = true;
+    } else if (Arg == "-c") {
+      Opts.Emit = EMIT_OBJ;
+    } else if (Arg == "-S") {
+      Opts.Emit = EMIT_ASM;
+    } else if (Arg == "-emit-llvm-bc") {
+      Opts.Emit = EMIT_LLVM_BC;
+    } else if (Arg == "-o") {
+      if (i + 1 >= argc) {
+        std::cout << "Missing file name after -o\n";
+        return false;
+      }
+      Opts.OutputFile = argv[++i];
+    } else if (Arg.rfind("-j", 0) == 0) {
+      // -j <n> or -j<n>
+      std::string Count = Arg.size() > 2 ? Arg.substr(2) : (i + 1 < argc ? argv[++i] : "");
+      if (StringRef(Count).getAsInteger(10, Opts.Jobs) || Opts.Jobs == 0) {
+        std::cout << "Invalid job count: " << Arg << (Arg.size() > 2 ? "" : " " + Count) << "\n";
+        return false;
+      }
+    } else if (Arg.rfind("--codegen-threads=", 0) == 0) {
+      if (StringRef(Arg).substr(18).getAsInteger(10, Opts.CodegenThreads)) {
+        std::cout << "Invalid thread count: " << Arg << "\n";
+        return false;
+      }
+    } else if (Arg.rfind("--cache-dir=", 0) == 0) {
+      Opts.CacheDir = Arg.substr(12);
+    } else if (Arg == "--cache") {
+      SmallString<128> Dir;
+      if (!sys::path::cache_directory(Dir)) {
+        std::cout << "No user cache directory; pass --cache-dir instead\n";
+        return false;
+      }
+      sys::path::append(Dir, "mccomp");
+      Opts.CacheDir = std::string(Dir);
+    } else if (Arg.rfind("-march=", 0) == 0) {
+      Opts.March = Arg.substr(7);
+    } else if (Arg.rfind("-mcpu=", 0) == 0) {
+      Opts.Mcpu = Arg.substr(6);
+    } else if (Arg == "--lex-only") {
+      Opts.LexOnly = true;
+    } else if (Arg == "-fsyntax-only") {
+      Opts.SyntaxOnly = true;
+    } else if (Arg == "-q") {
+      Verbosity = QUIET;
+    } else if (Arg == "-v") {
+      Verbosity = VERBOSE;
+    } else if (Arg.rfind("--max-errors=", 0) == 0) {
+      if (StringRef(Arg).substr(13).getAsInteger(10, Opts.MaxErrors)) {
+        std::cout << "Invalid error limit: " << Arg << "\n";
+        return false;
+      }
+    } else if (Arg == "-fdiagnostics-format=text" || Arg == "-fdiagnostics-format=json") {
+      Opts.JSONDiagnostics = (Arg == "-fdiagnostics-format=json");
+    } else if (Arg == "--dump-ast") {
+      Opts.DumpAST = true;
+    } else if (Arg == "--dump-ir") {
+      Opts.DumpIR = true;
+    } else if (Arg == "--run") {
+      Opts.Run = true;
+    } else if (Arg.rfind("--entry=", 0) == 0) {
+      Opts.Entry = Arg.substr(8);
+    } else if (Arg == "--") {
+      Opts.RunArgs.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (!Arg.empty() && Arg[0] == '-') {
+      std::cout << "Unknown option: " << Arg << "\n";
+      return false;
+    } else {
+      Opts.InputFiles.push_back(Arg);
+    }
+  }
+  // The host CPU's name and features mean nothing to another architecture
+  if (Opts.Mcpu == "native" && !Opts.March.empty() &&
+      Triple::getArchTypeForLLVMName(Opts.March) != Triple(sys::getProcessTriple()).getArch()) {
+    std::cout << "-mcpu=native cannot be used with -march=" << Opts.March
+              << ", which is not the host architecture\n";
+    return false;
+  }
+  if (Opts.Run && !Opts.March.empty()) {
+    std::cout << "--run executes on the host and cannot be combined with -march\n";
+    return false;
+  }
+  // The JSON array must be all there is on stdout
+  if (Opts.JSONDiagnostics && (Opts.Run || Opts.OutputFile == "-")) {
+    std::cout << (Opts.Run ? "--run" : "-o -") << " writes to stdout and cannot be "
+              << "combined with -fdiagnostics-format=json\n";
+    return false;
+  }
+  if (Opts.InputFiles.size() > 1) {
+    if (!Opts.OutputFile.empty()) {
+      std::cout << "-o cannot be used with more than one input file\n";
+      return false;
+    }
+    if (Opts.Run) {
+      std::cout << "--run takes a single input file\n";
+      return false;
+    }
   }
+  return !Opts.InputFiles.empty();
+}
 
-  // initialize line number and column numbers to zero
-  lineNo = 1;
-  columnNo = 1;
+// Compile the source file already loaded into CI, from lexing through to
+// writing OutputFile. Returns the exit status for this file; diagnostics are
+// only collected here and summarised by main once every file is done.
+static int compileInstance(const DriverOptions& Opts, const std::string& OutputFile,
+                           std::chrono::steady_clock::time_point StartTime) {
+  // --lex-only: measure raw lexer throughput and stop
+  if (Opts.LexOnly)
+    return lexOnly();
 
   // Make the module, which holds all the code.
-  TheModule = std::make_unique<Module>("mini-c", TheContext);
+  CI->TheModule = std::make_unique<Module>("mini-c", CI->TheContext);
+
+  // Fix the target up front so the optimiser, the emitted IR and any object
+  // code all agree on the data layout
+  std::unique_ptr<TargetMachine> TM =
+      createTargetMachine(Opts.March, Opts.Mcpu, Opts.OptLevel);
+  if (TM) {
+    CI->TheModule->setTargetTriple(TM->getTargetTriple());
+    CI->TheModule->setDataLayout(TM->createDataLayout());
+  }
 
-  // get the first token
-  getNextToken();
+  // get the first token, then run the parser. Lexing happens on demand, so
+  // the parse phase includes it.
+  logProgress(NORMAL, "Starting parser...\n");
+  auto ParseStart = std::chrono::steady_clock::now();
+  {
+    PhaseTimer Timer(PHASE_PARSE);
+    getNextToken();
+    parser();
+  }
+  logProgress(NORMAL, "Parsing Finished\n");
+
+  // -fsyntax-only: report how long parsing took and how big the tree is
+  if (Opts.SyntaxOnly) {
+    if (CI->Diags.hasErrors())
+      return 2;
+    double Secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - ParseStart).count();
+    fprintf(stderr, "Parsed %zu declarations in %.3f ms, AST arena %.2f MB, peak RSS %.1f MB\n",
+            CI->ExternAST.size() + CI->ProgramAST.size(), Secs * 1000,
+            CI->ASTArena.getBytesAllocated() / (1024.0 * 1024.0), getPeakRSSMB());
+    return 0;
+  }
 
-  // Run the parser now
-  fprintf(stderr, "Starting parser...\n");
-  parser();
-  fprintf(stderr, "Parsing Finished\n");
+  // Print the complete AST after successful parse
+  if (Opts.DumpAST && !CI->Diags.hasErrors()) {
+    PhaseTimer Timer(PHASE_PRINT_AST);
+    PrintAST(errs());
+  }
 
-  // Build and print the complete AST after successful parse
-  PrintAST();
+  // Check the whole program, even after syntax errors, and stop before
+  // codegen if anything was reported
+  if (CI->Diags.hasReachedLimit())
+    return 2;
+  {
+    PhaseTimer Timer(PHASE_SEMA);
+    analyseProgram();
+  }
+  logProgress(VERBOSE, "Semantic analysis finished\n");
+  if (CI->Diags.hasErrors())
+    return 2;
 
-  fprintf(stderr, "Starting code generation...\n");
+  logProgress(NORMAL, "Starting code generation...\n");
 
   // Generate code for extern declarations
-  fprintf(stderr, "Number of extern declarations: %zu\n", ExternAST.size());
-  for (size_t i = 0; i < ExternAST.size(); i++) {
-    fprintf(stderr, "  Generating extern %zu: %s\n", i, ExternAST[i]->getName().c_str());
-    Function* F = ExternAST[i]->codegen();
+  logProgress(VERBOSE, "Number of extern declarations: %zu\n", CI->ExternAST.size());
+  std::optional<PhaseTimer> Timer(std::in_place, PHASE_CODEGEN_EXTERNS);
+  for (size_t i = 0; i < CI->ExternAST.size(); i++) {
+    logProgress(VERBOSE, "  Generating extern %zu: %s\n", i, symbolName(CI->ExternAST[i]->getName()).str().c_str());
+    Function* F = CI->ExternAST[i]->codegen();
     if (!F) {
       fprintf(stderr, "\n*** COMPILATION FAILED: Error in extern declaration ***\n");
-      fclose(pFile);
       return 1;
     }
   }
 
   // Generate code for all top-level declarations
-  fprintf(stderr, "Number of top-level declarations: %zu\n", ProgramAST.size());
-  for (size_t i = 0; i < ProgramAST.size(); i++) {
-    fprintf(stderr, "  Generating top-level declaration %zu\n", i);
-    Value* V = ProgramAST[i]->codegen();
+  logProgress(VERBOSE, "Number of top-level declarations: %zu\n", CI->ProgramAST.size());
+  Timer.emplace(PHASE_CODEGEN_DECLS);
+  for (size_t i = 0; i < CI->ProgramAST.size(); i++) {
+    logProgress(VERBOSE, "  Generating top-level declaration %zu\n", i);
+    Value* V = CI->ProgramAST[i]->codegen();
     if (!V) {
       fprintf(stderr, "\n*** COMPILATION FAILED: Semantic error detected ***\n");
-      fclose(pFile);
       return 1;
     }
   }
 
-  fprintf(stderr, "Code generation finished\n");
+  Timer.reset();
+  logProgress(NORMAL, "Code generation finished\n");
+  if (CI->BoundsCheck)
+    logProgress(NORMAL, "Bounds checks: %u of %u eliminated, %u loops versioned\n",
+                CI->BoundsChecksEliminated, CI->BoundsChecks, CI->LoopsVersioned);
+
+  // The optimiser assumes well-formed IR, so check before running it
+  Timer.emplace(PHASE_VERIFY);
+  bool Broken = verifyModule(*CI->TheModule, &errs());
+  Timer.reset();
+  if (Broken) {
+    fprintf(stderr, "\n*** COMPILATION FAILED: Generated IR is invalid ***\n");
+    return 1;
+  }
 
-  printf(
-      "********************* FINAL IR (begin) ****************************\n");
+  // --cache-dir: reuse functions optimised by earlier runs. --codegen-threads:
+  // optimise partitions of the module, or with a cache its misses,
+  // concurrently; emission below stays serial. -O0 has nothing worth caching
+  // or splitting.
+  unsigned Threads = Opts.CodegenThreads ? Opts.CodegenThreads
+                                         : hardware_concurrency().compute_thread_count();
+  unsigned NumBodies = count_if(CI->TheModule->functions(),
+                                [](const Function& F) { return !F.isDeclaration(); });
+  Timer.emplace(PHASE_OPTIMISE);
+  if (Opts.OptLevel > 0 && !Opts.CacheDir.empty()) {
+    StringMap<std::string_view> Sources;
+    for (ASTnode* Decl : CI->ProgramAST) {
+      if (auto* FD = dynamic_cast<FunctionDeclAST*>(Decl))
+        Sources[symbolName(FD->getName())] = FD->getSource();
+    }
+    FunctionCache Cache(Opts.CacheDir);
+    CI->TheModule = optimiseModuleWithCache(std::move(CI->TheModule), TM.get(), Opts.March,
+                                            Opts.Mcpu, Opts.OptLevel, Threads,
+                                            CI->Diags.FileName, Cache, Sources,
+                                            getCodegenFlags(Opts));
+    logProgress(NORMAL, "Function cache: %u hits, %u misses\n", Cache.Hits, Cache.Misses);
+  } else if (Opts.OptLevel > 0 && std::min(Threads, NumBodies) > 1) {
+    CI->TheModule = optimiseModuleInParallel(std::move(CI->TheModule), Opts.March, Opts.Mcpu,
+                                             Opts.OptLevel, CI->Diags.FileName,
+                                             std::min(Threads, NumBodies));
+  } else {
+    optimiseModule(*CI->TheModule, TM.get(), Opts.OptLevel, CI->Diags.FileName);
+  }
+  Timer.reset();
 
-  // Print out all of the generated code into a file called output.ll
-  auto Filename = "output.ll";
-  std::error_code EC;
-  raw_fd_ostream dest(Filename, EC, sys::fs::OF_None);
+  if (CI->RemarkLoopHints)
+    reportLoopHints(*CI->TheModule);
 
-  if (EC) {
-    errs() << "Could not open file: " << EC.message();
-    return 1;
+  // Print to stderr for debugging (before the backend lowers the module)
+  if (Opts.DumpIR) {
+    errs() << "********************* FINAL IR (begin) ****************************\n";
+    CI->TheModule->print(errs(), nullptr);
+    errs() << "********************* FINAL IR (end) ******************************\n";
   }
 
-  TheModule->print(dest, nullptr);
-  // Print to stderr for debugging
-  TheModule->print(errs(), nullptr);
+  // --run executes the program instead of writing an output file
+  if (Opts.Run) {
+    return runWithJIT(std::move(CI->TheModule), std::move(CI->TheContextPtr), Opts.Entry,
+                      Opts.RunArgs, StartTime);
+  }
 
-  printf("********************* FINAL IR (end) ******************************\n");
+  // Write the module out in the requested form
+  Timer.emplace(PHASE_EMIT);
+  if (!emitModule(*CI->TheModule, TM.get(), Opts.Emit, OutputFile)) {
+    return 1;
+  }
 
-  fclose(pFile);
   return 0;
 }
+
+// -ftime-report: print where the time and heap allocations of one file went.
+// The table is written in one go so that files compiled in parallel do not
+// interleave.
+static void printTimeReport(StringRef InputFile) {
+  const PhaseStats* Phases = CI->Phases;
+  double Total = 0;
+  for (unsigned P = PHASE_PARSE; P < NUM_PHASES; P++)
+    Total += Phases[P].Seconds;
+
+  std::string Report;
+  raw_string_ostream OS(Report);
+  OS << "===-------------------------------------------------------------------------===\n"
+     << "  Compile time report for " << InputFile << "\n"
+     << "===-------------------------------------------------------------------------===\n"
+     << "  Phase                               Wall (ms)       %       Allocs           KB\n";
+  for (unsigned P = PHASE_LEX; P < NUM_PHASES; P++) {
+    // Lexing runs inside parsing, so show parsing without it
+    PhaseStats Stats = Phases[P];
+    if (P == PHASE_PARSE) {
+      Stats.Seconds -= Phases[PHASE_LEX].Seconds;
+      Stats.Allocations -= Phases[PHASE_LEX].Allocations;
+      Stats.Bytes -= Phases[PHASE_LEX].Bytes;
+    }
+    OS << format("  %-34s %10.3f %6.1f%% %12llu %12.1f\n", getPhaseName(CompilerPhase(P)),
+                 Stats.Seconds * 1000, Total > 0 ? Stats.Seconds / Total * 100 : 0.0,
+                 (unsigned long long)Stats.Allocations, Stats.Bytes / 1024.0);
+  }
+  OS << format("  Total                              %10.3f\n", Total * 1000)
+     << format("  Peak RSS (whole process)           %10.1f MB\n", getPeakRSSMB());
+  fputs(OS.str().c_str(), stderr);
+}
+
+// Compile one input file in a fresh CompilerInstance, which is current on the
+// calling thread until the file is done. Safe to call from several threads.
+static int compileFile(const DriverOptions& Opts, const std::string& InputFile,
+                       const std::string& OutputFile, DiagnosticsEngine& Diags,
+                       std::chrono::steady_clock::time_point StartTime) {
+  CompilerInstance Instance(Diags);
+  CI = &Instance;
+  CI->TimeReport = Opts.TimeReport;
+  CI->NoAliasArrayParams = Opts.NoAliasArrayParams;
+  CI->BoundsCheck = Opts.BoundsCheck;
+  CI->RemarkLoopHints = Opts.RemarkLoopHints;
+
+  // --time-trace: pool threads need a profiler of their own, which is merged
+  // into the main thread's when it finishes
+  bool OwnProfiler = Opts.TimeTrace && !timeTraceProfilerEnabled();
+  if (OwnProfiler)
+    timeTraceProfilerInitialize(/*TimeTraceGranularity=*/0, "mccomp");
+
+  int Status;
+  {
+    TimeTraceScope Trace("Compile File", InputFile);
+    // Load the whole input; the lexer starts at line 1, column 1
+    Status = openSourceFile(InputFile) ? compileInstance(Opts, OutputFile, StartTime) : 1;
+  }
+  if (Opts.TimeReport)
+    printTimeReport(InputFile);
+
+  if (OwnProfiler)
+    timeTraceProfilerFinishThread();
+  CI = nullptr;
+  return Status;
+}
+
+int main(int argc, char **argv) {
+  auto StartTime = std::chrono::steady_clock::now();
+  DriverOptions Opts;
+  if (!parseCommandLine(argc, argv, Opts)) {
+    printUsage();
+    return 1;
+  }
+
+  if (!Opts.CacheDir.empty()) {
+    if (std::error_code EC = sys::fs::create_directories(Opts.CacheDir)) {
+      std::cout << "Cannot create cache directory " << Opts.CacheDir << ": " << EC.message() << "\n";
+      return 1;
+    }
+  }
+
+  // Register the targets once, before any compile thread looks them up
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmPrinters();
+
+  // Read by every pass manager from then on, so it is set before any thread
+  // starts
+  TimePassesIsEnabled = Opts.TimePasses;
+
+  // One output and one set of diagnostics per input. Several inputs each
+  // write <stem>.ll (.bc/.s/.o), so two inputs with the same stem would
+  // overwrite each other's output.
+  size_t NumInputs = Opts.InputFiles.size();
+  bool MultipleInputs = NumInputs > 1;
+  std::vector<std::string> OutputFiles;
+  std::vector<DiagnosticsEngine> Diags(NumInputs);
+  StringMap<StringRef> InputForOutput;
+  for (size_t i = 0; i < NumInputs; i++) {
+    const std::string& Input = Opts.InputFiles[i];
+    OutputFiles.push_back(Opts.OutputFile.empty()
+                              ? getDefaultOutputName(Opts.Emit, Input, MultipleInputs)
+                              : Opts.OutputFile);
+    auto Inserted = InputForOutput.try_emplace(OutputFiles.back(), Input);
+    if (!Inserted.second && !Opts.SyntaxOnly && !Opts.LexOnly && !Opts.Run) {
+      std::cout << "Input files " << Inserted.first->second.str() << " and " << Input
+                << " would both be written to " << OutputFiles.back() << "\n";
+      return 1;
+    }
+    Diags[i].FileName = Input;
+    Diags[i].MaxErrors = Opts.MaxErrors;
+    Diags[i].JSONOutput = Opts.JSONDiagnostics;
+    Diags[i].ShowFileName = MultipleInputs;
+  }
+
+  // --time-trace: every span is recorded, however short, so that small
+  // functions still show up
+  if (Opts.TimeTrace) {
+    if (Opts.TimeTraceFile.empty() && MultipleInputs) {
+      Opts.TimeTraceFile = "mccomp-trace.json";
+    } else if (Opts.TimeTraceFile.empty()) {
+      SmallString<128> Path(OutputFiles[0]);
+      sys::path::replace_extension(Path, "json");
+      Opts.TimeTraceFile = std::string(Path);
+    }
+    timeTraceProfilerInitialize(/*TimeTraceGranularity=*/0, argv[0]);
+  }
+
+  // Compile the inputs on a thread pool. Each file has its own instance and
+  // shares nothing with the others, so no locking is needed; a single input
+  // stays on the main thread.
+  std::vector<int> Status(NumInputs, 0);
+  if (NumInputs == 1 || Opts.Jobs == 1) {
+    for (size_t i = 0; i < NumInputs; i++)
+      Status[i] = compileFile(Opts, Opts.InputFiles[i], OutputFiles[i], Diags[i], StartTime);
+  } else {
+    DefaultThreadPool Pool(hardware_concurrency(Opts.Jobs));
+    for (size_t i = 0; i < NumInputs; i++)
+      Pool.async([&, i] {
+        Status[i] = compileFile(Opts, Opts.InputFiles[i], OutputFiles[i], Diags[i], StartTime);
+      });
+    Pool.wait();
+  }
+
+  if (Opts.TimeTrace) {
+    if (Error E = timeTraceProfilerWrite(Opts.TimeTraceFile, Opts.TimeTraceFile)) {
+      errs() << "Cannot write time trace: " << toString(std::move(E)) << "\n";
+      Status.push_back(1);
+    }
+    timeTraceProfilerCleanup();
+  }
+
+  // Summarise the diagnostics of every file, then fail if any file did
+  int DiagStatus = finishDiagnostics(Diags, Opts.JSONDiagnostics);
+  return std::max(DiagStatus, *std::max_element(Status.begin(), Status.end()));
+}
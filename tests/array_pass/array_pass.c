@@ -0,0 +1,55 @@
+// MiniC program to test passing arrays on through calls
+extern int print_int(int X);
+
+int grid[3][4];
+
+int sum_row(int a[3][4], int r) {
+    return a[r][0] + a[r][1] + a[r][2] + a[r][3];
+}
+
+// An array parameter passed on unchanged
+int sum_rows(int a[3][4]) {
+    return sum_row(a, 0) + sum_row(a, 1) + sum_row(a, 2);
+}
+
+float first(float v[4]) {
+    return v[0];
+}
+
+float pass_on(float v[4]) {
+    return first(v);
+}
+
+// Local and global arrays passed by address; the callee's stores are seen
+void fill(int a[3][4], int x) {
+    a[0][0] = x;
+    a[1][1] = x;
+    a[2][3] = x;
+}
+
+int array_pass() {
+    int local[3][4];
+    float f[4];
+    int i;
+    int j;
+    int k;
+    i = 0;
+    while (i < 3) {
+        j = 0;
+        while (j < 4) {
+            local[i][j] = 0;
+            grid[i][j] = 0;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    f[0] = 2.5;
+    fill(local, 5);
+    fill(grid, 7);
+    k = 0;
+    if (pass_on(f) == 2.5) {
+        k = 2;
+    }
+    // 3*5 + 3*7 + 2 = 38
+    return sum_rows(local) + sum_rows(grid) + k;
+}
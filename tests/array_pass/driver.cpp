@@ -0,0 +1,31 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o array_pass
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int array_pass();
+}
+
+int main() {
+    if (array_pass() == 38)
+        std::cout << "PASSED Result: " << array_pass() << std::endl;
+    else
+        std::cout << "FAILED Result: " << array_pass() << std::endl;
+}
@@ -0,0 +1,18 @@
+// Arithmetic on bools wraps in one bit, the same at every -O level
+extern int print_int(int X);
+
+int negb(bool a) {
+  return -a;
+}
+
+int addb(bool a, bool b) {
+  return a + b;
+}
+
+int subb(bool a, bool b) {
+  return a - b;
+}
+
+int mulb(bool a, bool b) {
+  return a * b;
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o bool_arith
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int negb(bool a);
+    int addb(bool a, bool b);
+    int subb(bool a, bool b);
+    int mulb(bool a, bool b);
+}
+
+int main() {
+    bool Passed = negb(true) == 1 && negb(false) == 0 &&
+                  addb(true, true) == 0 && addb(true, false) == 1 &&
+                  subb(false, true) == 1 && subb(true, true) == 0 &&
+                  mulb(true, true) == 1 && mulb(true, false) == 0;
+    if (Passed)
+        std::cout << "PASSED Result: " << negb(true) << std::endl;
+    else
+        std::cout << "FAILED Result: " << negb(true) << " " << addb(true, true) << " "
+                  << subb(false, true) << " " << mulb(true, true) << std::endl;
+}
@@ -0,0 +1,30 @@
+// MiniC program to test -fbounds-check
+extern int print_int(int X);
+
+int g[8];
+
+// Squares 0..n-1 into a and g and sums them back. Past 8 the indices are
+// out of range, which must trap.
+int fill_sum(int n) {
+    int a[8];
+    int i;
+    int sum;
+
+    // Every index here is i below n, so one check of n before the loop
+    // covers them all
+    i = 0;
+    while (i < n) {
+        a[i] = i * i;
+        g[i] = a[i] + 1;
+        i = i + 1;
+    }
+
+    // n - 1 is not a plain variable, so each access is checked
+    i = 0;
+    sum = 0;
+    while (i <= n - 1) {
+        sum = sum + a[i] + g[i];
+        i = i + 1;
+    }
+    return sum;
+}
@@ -0,0 +1,37 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o bounds_check
+// ./bounds_check overflow must be killed by a trap
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int fill_sum(int n);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        fill_sum(9);
+        std::cout << "FAILED Result: index 8 did not trap" << std::endl;
+        return 0;
+    }
+    if (fill_sum(8) == 288 && fill_sum(3) == 13)
+        std::cout << "PASSED Result: " << fill_sum(8) << std::endl;
+    else
+        std::cout << "FAILED Result: " << fill_sum(8) << " " << fill_sum(3) << std::endl;
+}
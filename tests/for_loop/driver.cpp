@@ -0,0 +1,49 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o for_loop
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int triangle(int n);
+    int sum_products(int n);
+    int first_power_above(int n);
+    int countdown(int n);
+}
+
+// The same sum as sum_products, in C++
+static int expected_products(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++)
+        for (int j = i; j < n; j++)
+            s += i * i * (j * j) % 7;
+    return s;
+}
+
+int main() {
+    bool Passed = triangle(0) == 0 && triangle(1) == 0 && triangle(100) == 4950 &&
+                  first_power_above(0) == 1 && first_power_above(100) == 128 &&
+                  countdown(0) == 0 && countdown(-5) == 0 && countdown(10) == 4;
+    for (int n : {0, 1, 2, 7, 16})
+        Passed = Passed && sum_products(n) == expected_products(n);
+    if (Passed)
+        std::cout << "PASSED Result: " << triangle(100) + sum_products(16) << std::endl;
+    else
+        std::cout << "FAILED Result: " << triangle(100) << " " << sum_products(16) << " "
+                  << first_power_above(100) << " " << countdown(10) << std::endl;
+}
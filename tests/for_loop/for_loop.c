@@ -0,0 +1,56 @@
+// for loops, emitted in rotated form with a guard, preheader and latch
+extern int print_int(int X);
+
+int squares[16];
+
+// 0 + 1 + ... + n-1
+int triangle(int n) {
+  int i;
+  int s;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+    s = s + i;
+  }
+  return s;
+}
+
+// A nested loop over an array, with a hint on the inner loop
+int sum_products(int n) {
+  int i;
+  int j;
+  int s;
+  for (i = 0; i < n; i = i + 1)
+    squares[i] = i * i;
+  s = 0;
+  for (i = 0; i < n; i = i + 1) {
+#pragma unroll 2
+    for (j = i; j < n; j = j + 1) {
+      s = s + squares[i] * squares[j] % 7;
+    }
+  }
+  return s;
+}
+
+// Every part left out: only the return leaves the loop
+int first_power_above(int n) {
+  int p;
+  p = 1;
+  for (;;) {
+    if (p > n) {
+      return p;
+    }
+    p = p * 2;
+  }
+  return 0;
+}
+
+// Counting down, with the initialiser and increment left out
+int countdown(int n) {
+  int steps;
+  steps = 0;
+  for (; n > 0;) {
+    n = n - 3;
+    steps = steps + 1;
+  }
+  return steps;
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o loop_hints
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int hinted_sums(int n);
+}
+
+// Sum of i % 7 * (i % 3) for i below n
+static int expected(int n) {
+    int Sum = 0;
+    for (int i = 0; i < n; i++)
+        Sum += i % 7 * (i % 3);
+    return Sum;
+}
+
+int main() {
+    // Counts that leave unrolled and vectorised loops a remainder
+    bool Passed = true;
+    for (int n : {0, 1, 3, 4, 17, 1001})
+        Passed = Passed && hinted_sums(n) == expected(n);
+    if (Passed)
+        std::cout << "PASSED Result: " << hinted_sums(1001) << std::endl;
+    else
+        std::cout << "FAILED Result: " << hinted_sums(1001) << " expected " << expected(1001) << std::endl;
+}
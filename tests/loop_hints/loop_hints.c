@@ -0,0 +1,52 @@
+// Loop hints, lowered to llvm.loop metadata; -Rloop-hints reports which
+// ones the optimiser followed
+extern int print_int(int X);
+
+// The same sum computed under each hint; returns it if all agree, else -1
+int hinted_sums(int n) {
+  int i;
+  int a;
+  int b;
+  int c;
+  int d;
+
+  i = 0;
+  a = 0;
+#pragma vectorize
+  while (i < n) {
+    a = a + i % 7 * (i % 3);
+    i = i + 1;
+  }
+
+  i = 0;
+  b = 0;
+#pragma unroll 4
+  while (i < n) {
+    b = b + i % 7 * (i % 3);
+    i = i + 1;
+  }
+
+  i = 0;
+  c = 0;
+#pragma nounroll
+#pragma novectorize
+  while (i < n) {
+    c = c + i % 7 * (i % 3);
+    i = i + 1;
+  }
+
+  // Calls cannot be vectorised
+  i = 0;
+  d = 0;
+#pragma unroll(2)
+#pragma vectorize 4
+  while (i < n) {
+    d = d + i % 7 * (i % 3) + print_int(i) * 0;
+    i = i + 1;
+  }
+
+  if (a == b && b == c && c == d) {
+    return a;
+  }
+  return -1;
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <cstdio>
+
+// clang++ driver.cpp output.ll -o short_circuit
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+extern "C" DLLEXPORT int print_int(int X) {
+  fprintf(stderr, "%d\n", X);
+  return 0;
+}
+
+extern "C" DLLEXPORT float print_float(float X) {
+  fprintf(stderr, "%f\n", X);
+  return 0;
+}
+
+extern "C" {
+    int short_circuit(int n);
+}
+
+int main() {
+    if (short_circuit(5) == 13) {
+    	std::cout << "PASSED Result: " << short_circuit(5) << std::endl;
+    }
+    else {
+    	std::cout << "FAILED Result: " << short_circuit(5) << std::endl;
+    }
+}
@@ -0,0 +1,30 @@
+// MiniC program to test short-circuit evaluation of && and ||
+
+extern int print_int(int X);
+
+int calls;
+
+// Records that it was evaluated
+bool touch(bool v) {
+  calls = calls + 1;
+  return v;
+}
+
+int short_circuit(int n) {
+  bool r;
+  calls = 0;
+
+  r = false && touch(true);          // RHS skipped
+  r = true || touch(false);          // RHS skipped
+  r = true && touch(true);           // RHS evaluated
+  r = false || touch(false);         // RHS evaluated
+  r = (n > 0 && touch(true)) || touch(true); // only the first call runs
+
+  // cheap right operand, evaluated either way
+  if (n > 0 && n < 10) {
+    calls = calls + 10;
+  }
+
+  print_int(calls);
+  return calls;
+}
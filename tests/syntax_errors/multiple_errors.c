@@ -0,0 +1,17 @@
+// Self written test: every error in the file is reported in one run
+
+int test(int n) {
+    int x
+    x = n +;
+    if (x > ) {
+        x = 1;
+    }
+    y = 2;
+    return x;
+}
+
+float scale(float a) {
+    int i;
+    i = a;
+    return undefined(i);
+}
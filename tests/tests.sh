@@ -10,9 +10,15 @@ CLANG=$LLVM_INSTALL_PATH/bin/clang++
 module load GCC/13.3.0
 
 TEST_COMPILE_ONLY=0
+MCCOMP_FLAGS=""
+OUT=output.ll
 
 # set compile_only by command line argument -compile_only
 # ./tests.sh -compile_only
+# pass an optimisation level through to mccomp
+# ./tests.sh -O2
+# link the drivers against object files emitted by mccomp -c instead of output.ll
+# ./tests.sh -object
 
 while [[ $# -gt 0 ]]; do
   case $1 in
@@ -20,6 +26,15 @@ while [[ $# -gt 0 ]]; do
       TEST_COMPILE_ONLY=1
       shift # past argument
       ;;
+    -O0|-O1|-O2|-O3)
+      MCCOMP_FLAGS="$MCCOMP_FLAGS $1"
+      shift # past argument
+      ;;
+    -object)
+      OUT=output.o
+      MCCOMP_FLAGS="$MCCOMP_FLAGS -c -o $OUT"
+      shift # past argument
+      ;;
     *)
       echo "Unknown option: $1"
       exit 1
@@ -68,8 +83,38 @@ leap=1
 # array tests -- set to 1 after completing Part 3 - Grand Finale
 array_addition=1
 array_func_arg_1d=1
+# arrays passed on whole to array parameters
+array_pass=1
 matrix_mul=1
 global_array=1
+# && and || only evaluate their right operand when needed
+short_circuit=1
+# in-process JIT execution (mccomp --run)
+jit=1
+# parser stress test: one function with a million statements
+stress=1
+# error recovery: one run reports every error in the file
+diagnostics=1
+# several input files compiled in one run on a thread pool
+multifile=1
+# one module optimised in partitions on several threads, then relinked
+parallel_opt=1
+# optimised functions reused from an on-disk cache
+cache=1
+# per-phase time report and Chrome trace (-ftime-report, --time-trace)
+time_report=1
+# scalar locals built directly in SSA form, even at -O0
+ssa=1
+# noalias array parameters and TBAA metadata (-fno-alias-array-params)
+noalias=1
+# array bounds checks, removed from loops that prove them (-fbounds-check)
+bounds_check=1
+# nsw int arithmetic and inbounds GEPs on pointer-width indices
+index_arith=1
+# #pragma unroll/vectorize loop hints and their report (-Rloop-hints)
+loop_hints=1
+# for loops emitted in rotated form (guard, preheader, single latch)
+for_loop=1
 
 
 cd tests/addition/
@@ -78,10 +123,10 @@ if [ $addition == 1 ]
 then	
 	cd ../addition/
 	pwd
-	rm -rf output.ll add
-	"$COMP" ./addition.c
+	rm -rf $OUT add
+	"$COMP" $MCCOMP_FLAGS ./addition.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll  -o add
+        $CLANG driver.cpp $OUT  -o add
         validate "./add"
     fi
 fi
@@ -91,10 +136,10 @@ if [ $factorial == 1 ];
 then	
 	cd ../factorial
 	pwd
-	rm -rf output.ll fact
-	"$COMP" ./factorial.c
+	rm -rf $OUT fact
+	"$COMP" $MCCOMP_FLAGS ./factorial.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o fact
+        $CLANG driver.cpp $OUT -o fact
         validate "./fact"
     fi
 fi
@@ -103,10 +148,10 @@ if [ $fibonacci == 1 ];
 then	
 	cd ../fibonacci
 	pwd
-	rm -rf output.ll fib
-	"$COMP" ./fibonacci.c
+	rm -rf $OUT fib
+	"$COMP" $MCCOMP_FLAGS ./fibonacci.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o fib
+        $CLANG driver.cpp $OUT -o fib
         validate "./fib"
     fi
 fi
@@ -115,10 +160,10 @@ if [ $pi == 1 ];
 then	
 	cd ../pi
 	pwd
-	rm -rf output.ll pi
-	"$COMP" ./pi.c
+	rm -rf $OUT pi
+	"$COMP" $MCCOMP_FLAGS ./pi.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o pi
+        $CLANG driver.cpp $OUT -o pi
         validate "./pi"
     fi
 fi
@@ -127,10 +172,10 @@ if [ $while == 1 ];
 then	
 	cd ../while
 	pwd
-	rm -rf output.ll while
-	"$COMP" ./while.c
+	rm -rf $OUT while
+	"$COMP" $MCCOMP_FLAGS ./while.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o while
+        $CLANG driver.cpp $OUT -o while
         validate "./while"
     fi
 fi
@@ -139,10 +184,10 @@ if [ $void == 1 ];
 then	
 	cd ../void
 	pwd
-	rm -rf output.ll void
-	"$COMP" ./void.c 
+	rm -rf $OUT void
+	"$COMP" $MCCOMP_FLAGS ./void.c 
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o void
+        $CLANG driver.cpp $OUT -o void
         validate "./void"
     fi
 fi
@@ -151,10 +196,10 @@ if [ $cosine == 1 ];
 then	
 	cd ../cosine
 	pwd
-	rm -rf output.ll cosine
-	"$COMP" ./cosine.c
+	rm -rf $OUT cosine
+	"$COMP" $MCCOMP_FLAGS ./cosine.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o cosine
+        $CLANG driver.cpp $OUT -o cosine
         validate "./cosine"
     fi
 fi
@@ -163,10 +208,10 @@ if [ $unary == 1 ];
 then	
 	cd ../unary
 	pwd
-	rm -rf output.ll unary
-	"$COMP" ./unary.c
+	rm -rf $OUT unary
+	"$COMP" $MCCOMP_FLAGS ./unary.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o unary
+        $CLANG driver.cpp $OUT -o unary
         validate "./unary"
     fi
 fi
@@ -175,10 +220,10 @@ if [ $recurse == 1 ];
 then	
 	cd ../recurse
 	pwd
-	rm -rf output.ll recurse
-	"$COMP" ./recurse.c
+	rm -rf $OUT recurse
+	"$COMP" $MCCOMP_FLAGS ./recurse.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o recurse
+        $CLANG driver.cpp $OUT -o recurse
         validate "./recurse"
     fi
 fi
@@ -187,10 +232,10 @@ if [ $rfact == 1 ];
 then	
 	cd ../rfact
 	pwd
-	rm -rf output.ll rfact
-	"$COMP" ./rfact.c
+	rm -rf $OUT rfact
+	"$COMP" $MCCOMP_FLAGS ./rfact.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o rfact
+        $CLANG driver.cpp $OUT -o rfact
         validate "./rfact"
     fi
 fi
@@ -199,10 +244,10 @@ if [ $palindrome == 1 ];
 then	
 	cd ../palindrome
 	pwd
-	rm -rf output.ll palindrome
-	"$COMP" ./palindrome.c
+	rm -rf $OUT palindrome
+	"$COMP" $MCCOMP_FLAGS ./palindrome.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o palindrome
+        $CLANG driver.cpp $OUT -o palindrome
         validate "./palindrome"
     fi
 fi
@@ -211,8 +256,8 @@ if [ $null == 1 ];
 then
     cd ../null
     pwd
-    rm -rf output.ll null
-    "$COMP" ./null.c
+    rm -rf $OUT null
+    "$COMP" $MCCOMP_FLAGS ./null.c
     rc=$?
     if [[ $rc == 0 ]]; then
         echo "null test PASSED"
@@ -225,10 +270,10 @@ if [ $leap == 1 ];
 then
         cd ../leap
         pwd
-        rm -rf output.ll leap
-        "$COMP" ./leap.c
+        rm -rf $OUT leap
+        "$COMP" $MCCOMP_FLAGS ./leap.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG driver.cpp output.ll -o leap
+        $CLANG driver.cpp $OUT -o leap
         validate "./leap"
     fi
 fi
@@ -238,8 +283,8 @@ if [ $TEST_COMPILE_ONLY == 0 ]; then
     then	
         cd ../null
         pwd
-        rm -rf output.ll null
-        "$COMP" ./null.c 
+        rm -rf $OUT null
+        "$COMP" $MCCOMP_FLAGS ./null.c 
         rc=$?
         if [[ $rc == 0 ]]; then
             echo "null test PASSED"
@@ -253,10 +298,10 @@ if [ $array_addition == 1 ];
 then	
     cd ../array_addition
     pwd
-    rm -rf output.ll array_addition
-    "$COMP" ./arr_addition.c
+    rm -rf $OUT array_addition
+    "$COMP" $MCCOMP_FLAGS ./arr_addition.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG -g driver.cpp output.ll -o array_addition
+        $CLANG -g driver.cpp $OUT -o array_addition
         validate "./array_addition"
     fi
 fi
@@ -265,22 +310,34 @@ if [ $array_func_arg_1d == 1 ];
 then	
     cd ../array_func_arg_1d
     pwd
-    rm -rf output.ll array_func_arg
-    "$COMP" ./arr_func_arg.c
+    rm -rf $OUT array_func_arg
+    "$COMP" $MCCOMP_FLAGS ./arr_func_arg.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG -g driver.cpp output.ll -o array_func_arg
+        $CLANG -g driver.cpp $OUT -o array_func_arg
         validate "./array_func_arg"
     fi
 fi
 
+if [ $array_pass == 1 ];
+then
+    cd ../array_pass
+    pwd
+    rm -rf $OUT array_pass
+    "$COMP" $MCCOMP_FLAGS ./array_pass.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o array_pass
+        validate "./array_pass"
+    fi
+fi
+
 if [ $matrix_mul == 1 ];
 then	
     cd ../matrix_multiplication
     pwd
-    rm -rf output.ll matrix_mul
-    "$COMP" ./matrix_mul.c
+    rm -rf $OUT matrix_mul
+    "$COMP" $MCCOMP_FLAGS ./matrix_mul.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG -g driver.cpp output.ll -o matrix_mul
+        $CLANG -g driver.cpp $OUT -o matrix_mul
         validate "./matrix_mul"
     fi
 fi
@@ -288,12 +345,313 @@ if [ $global_array == 1 ];
 then	
     cd ../global_array
     pwd
-    rm -rf output.ll global_array
-    "$COMP" ./global_array.c
+    rm -rf $OUT global_array
+    "$COMP" $MCCOMP_FLAGS ./global_array.c
     if [ $TEST_COMPILE_ONLY == 0 ]; then
-        $CLANG -g driver.cpp output.ll -o global_array
+        $CLANG -g driver.cpp $OUT -o global_array
         validate "./global_array"
     fi
 fi
 
+if [ $short_circuit == 1 ];
+then
+	cd ../short_circuit
+	pwd
+	rm -rf $OUT short_circuit
+	"$COMP" $MCCOMP_FLAGS ./short_circuit.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o short_circuit
+        validate "./short_circuit"
+    fi
+fi
+
+if [ $jit == 1 ];
+then
+    cd ../addition
+    pwd
+    "$COMP" $MCCOMP_FLAGS --run --entry=addition ./addition.c -- 4 5 > perf_out
+    if grep -q "Result: 9" perf_out; then
+        echo "jit test PASSED"
+        rm perf_out
+    else
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    # Malformed arguments must be rejected, not silently read as 0
+    if "$COMP" $MCCOMP_FLAGS --run --entry=addition ./addition.c -- 4x 5 > perf_out 2>&1 \
+        || ! grep -q "Argument 0 ('4x') is not a valid int" perf_out; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm perf_out
+fi
+
+if [ $stress == 1 ];
+then
+    pwd
+    # Generated on the fly; recursive list parsing used to overflow the stack here
+    STRESS_SRC=$(mktemp /tmp/mccomp_stress_XXXXXX.c)
+    awk 'BEGIN {
+        print "int stress(int x) {"
+        print "    int y;"
+        print "    y = 0;"
+        for (i = 0; i < 1000000; i++)
+            print "    y = y + x * " i % 7 ";"
+        print "    return y;"
+        print "}"
+    }' > $STRESS_SRC
+    if "$COMP" -fsyntax-only $STRESS_SRC 2> perf_out && tail -1 perf_out | grep -q "Parsed 1 declarations"; then
+        echo "stress test PASSED"
+        rm perf_out $STRESS_SRC
+    else
+        echo "TEST FAILED *****"
+        rm -f $STRESS_SRC
+        exit 1
+    fi
+fi
+
+if [ $diagnostics == 1 ];
+then
+    cd ../syntax_errors
+    pwd
+    # Three syntax and three semantic errors; the compile must fail and list all
+    # six, and stdout must hold nothing but the JSON array
+    if ! "$COMP" -fdiagnostics-format=json ./multiple_errors.c > perf_out 2> /dev/null \
+        && python3 -c 'import json, sys; Kinds = sorted(D["category"] for D in json.load(sys.stdin)); sys.exit(Kinds != ["semantic"] * 3 + ["syntax"] * 3)' < perf_out; then
+        echo "diagnostics test PASSED"
+        rm perf_out
+    else
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+fi
+
+if [ $multifile == 1 ];
+then
+    cd ../addition
+    pwd
+    # Three inputs on two threads, each written to its own <stem>.ll
+    rm -f addition.ll factorial.ll fibonacci.ll add fact fib
+    "$COMP" -j 2 ./addition.c ../factorial/factorial.c ../fibonacci/fibonacci.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp addition.ll -o add
+        validate "./add"
+        $CLANG ../factorial/driver.cpp factorial.ll -o fact
+        validate "./fact"
+        $CLANG ../fibonacci/driver.cpp fibonacci.ll -o fib
+        validate "./fib"
+    fi
+    # -time-passes gives each file its own report, headed with its name
+    "$COMP" -q -O2 -j 2 -time-passes ./addition.c ../factorial/factorial.c 2> perf_out
+    if ! grep -q "^Pass timing report for ./addition.c:" perf_out \
+        || ! grep -q "^Pass timing report for ../factorial/factorial.c:" perf_out; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm -f perf_out addition.ll factorial.ll fibonacci.ll fact fib
+fi
+
+if [ $parallel_opt == 1 ];
+then
+    cd ../short_circuit
+    pwd
+    rm -rf output.ll short_circuit
+    "$COMP" -O2 --codegen-threads=2 ./short_circuit.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp output.ll -o short_circuit
+        validate "./short_circuit"
+    fi
+fi
+
+if [ $cache == 1 ];
+then
+    cd ../factorial
+    pwd
+    # The second compile finds every function in the cache the first one filled,
+    # on two threads, and gives the same module
+    CACHE_DIR=$(mktemp -d /tmp/mccomp_cache_XXXXXX)
+    rm -rf output.ll fact
+    "$COMP" -O2 --cache-dir=$CACHE_DIR --codegen-threads=2 -o threaded.ll ./factorial.c 2> /dev/null
+    "$COMP" -O2 --cache-dir=$CACHE_DIR ./factorial.c 2> perf_out
+    rm -rf $CACHE_DIR
+    if ! grep -q "Function cache: [1-9][0-9]* hits, 0 misses" perf_out || ! cmp -s threaded.ll output.ll; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm perf_out threaded.ll
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp output.ll -o fact
+        validate "./fact"
+    fi
+fi
+
+if [ $time_report == 1 ];
+then
+    cd ../fibonacci
+    pwd
+    # Every phase is reported and the trace has a span for the function
+    rm -rf output.ll output.json fib
+    "$COMP" -ftime-report --time-trace ./fibonacci.c 2> perf_out
+    for Phase in "Lexing" "Parsing" "Semantic analysis" "Optimisation" "Emission"; do
+        if ! grep -q "^  $Phase  " perf_out; then
+            echo "TEST FAILED *****"
+            exit 1
+        fi
+    done
+    if ! grep -q '"traceEvents"' output.json || ! grep -q '"detail":"fibonacci"' output.json; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm perf_out output.json
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp output.ll -o fib
+        validate "./fib"
+    fi
+    # --codegen-threads workers trace their partitions too
+    cd ../short_circuit
+    rm -rf output.json
+    "$COMP" -O2 --codegen-threads=2 --time-trace ./short_circuit.c 2> /dev/null
+    if ! grep -q '"detail":"./short_circuit.c (partition 1)"' output.json; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm output.json
+fi
+
+if [ $ssa == 1 ];
+then
+    cd ../pi
+    pwd
+    # pi only has scalar locals, so -O0 code has PHIs and no stack traffic
+    rm -rf output.ll pi
+    "$COMP" -O0 ./pi.c
+    if grep -q "alloca\|load\|store" output.ll || ! grep -q "phi float" output.ll; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp output.ll -o pi
+        validate "./pi"
+    fi
+fi
+
+if [ $noalias == 1 ];
+then
+    cd ../matrix_multiplication
+    pwd
+    # Array parameters are noalias and every element access carries TBAA
+    rm -rf output.ll matrix_mul
+    "$COMP" -O0 -fno-alias-array-params ./matrix_mul.c
+    if ! grep -q "ptr noalias %a, ptr noalias %b, ptr noalias %c, i32 %n" output.ll ||
+       grep "load float\|store float" output.ll | grep -qv "!tbaa"; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG -g driver.cpp output.ll -o matrix_mul
+        validate "./matrix_mul"
+    fi
+fi
+
+if [ $bounds_check == 1 ];
+then
+    cd ../bounds_check
+    pwd
+    # The first loop proves its three indices in range before it starts; the
+    # second keeps its two checks
+    rm -rf $OUT bounds_check
+    "$COMP" $MCCOMP_FLAGS -fbounds-check ./bounds_check.c 2> perf_out
+    if ! grep -q "Bounds checks: 3 of 5 eliminated, 1 loops versioned" perf_out; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    rm perf_out
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o bounds_check
+        validate "./bounds_check"
+        # Indexing past the end must trap
+        if ./bounds_check overflow > /dev/null 2>&1; then
+            echo "TEST FAILED *****"
+            exit 1
+        fi
+    fi
+fi
+
+if [ $index_arith == 1 ];
+then
+    cd ../matrix_multiplication
+    pwd
+    # a[i][k] is one GEP over [10 x float] rows, indexed by i64
+    rm -rf output.ll matrix_mul
+    "$COMP" -O0 ./matrix_mul.c
+    if ! grep -q "getelementptr inbounds \[10 x float\], ptr %a, i64" output.ll ||
+       ! grep -q "add nsw i32" output.ll || grep -q "getelementptr float\|mul i32" output.ll; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG -g driver.cpp output.ll -o matrix_mul
+        validate "./matrix_mul"
+    fi
+    # Bool arithmetic wraps in i1, so it must not be nsw; -O2 would fold
+    # true + true and -true to poison
+    cd ../bool_arith
+    pwd
+    rm -rf output.ll $OUT bool_arith
+    "$COMP" -O0 ./bool_arith.c
+    if grep -q "nsw i1" output.ll; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    "$COMP" $MCCOMP_FLAGS -O2 ./bool_arith.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o bool_arith
+        validate "./bool_arith"
+    fi
+fi
+
+if [ $loop_hints == 1 ];
+then
+    cd ../loop_hints
+    pwd
+    # Every hint is followed except vectorising the loop that makes calls
+    rm -rf $OUT loop_hints
+    "$COMP" $MCCOMP_FLAGS -O2 -Rloop-hints ./loop_hints.c 2> perf_out
+    for Remark in "15:1 Remark: '#pragma vectorize' honoured: loop vectorized" \
+                  "23:1 Remark: '#pragma unroll 4' honoured: loop unrolled" \
+                  "31:1 Remark: '#pragma nounroll' honoured: loop not unrolled" \
+                  "32:1 Remark: '#pragma novectorize' honoured: loop not vectorized" \
+                  "41:1 Remark: '#pragma unroll 2' honoured: loop unrolled" \
+                  "42:1 Remark: '#pragma vectorize 4' not honoured: loop not vectorized"; do
+        if ! grep -qF "$Remark" perf_out; then
+            echo "TEST FAILED *****"
+            exit 1
+        fi
+    done
+    rm perf_out
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o loop_hints
+        validate "./loop_hints"
+    fi
+fi
+
+if [ $for_loop == 1 ];
+then
+    cd ../for_loop
+    pwd
+    # The latch tests the condition and branches back to the body
+    rm -rf output.ll $OUT for_loop
+    "$COMP" -O0 ./for_loop.c
+    if ! grep -q "label %forpreheader, label %afterloop" output.ll ||
+       ! grep -q "label %forbody, label %forexit" output.ll; then
+        echo "TEST FAILED *****"
+        exit 1
+    fi
+    "$COMP" $MCCOMP_FLAGS ./for_loop.c
+    if [ $TEST_COMPILE_ONLY == 0 ]; then
+        $CLANG driver.cpp $OUT -o for_loop
+        validate "./for_loop"
+    fi
+fi
+
 echo "***** ALL TESTS PASSED *****"